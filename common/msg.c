@@ -45,6 +45,9 @@
 
 #define TERM_BUF 100
 
+// Messages shorter than this are formatted without allocating memory.
+#define MSG_STACK_BUF 1024
+
 struct mp_log_root {
     struct mpv_global *global;
     pthread_mutex_t lock;
@@ -336,9 +339,30 @@ static struct mp_log_buffer_entry *log_buffer_read(struct mp_log_buffer *buffer)
     return res;
 }
 
+// Allocate the entry and its strings as a single memory block.
+static struct mp_log_buffer_entry *new_log_entry(bstr prefix, int lev,
+                                                 bstr text)
+{
+    struct mp_log_buffer_entry *entry =
+        talloc_size(NULL, sizeof(*entry) + prefix.len + 1 + text.len + 1);
+    char *strings = (char *)(entry + 1);
+    *entry = (struct mp_log_buffer_entry) {
+        .prefix = strings,
+        .level = lev,
+        .text = strings + prefix.len + 1,
+    };
+    memcpy(entry->prefix, prefix.start, prefix.len);
+    entry->prefix[prefix.len] = '\0';
+    memcpy(entry->text, text.start, text.len);
+    entry->text[text.len] = '\0';
+    return entry;
+}
+
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
+    bstr prefix_str = bstr0(log->verbose_prefix);
+    bstr text_str = bstr0(text);
     for (int n = 0; n < root->num_buffers; n++) {
         struct mp_log_buffer *buffer = root->buffers[n];
         bool wakeup = false;
@@ -372,12 +396,8 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
                 talloc_free(skip);
                 buffer->dropped += 1;
             }
-            struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
-            *entry = (struct mp_log_buffer_entry) {
-                .prefix = talloc_strdup(entry, log->verbose_prefix),
-                .level = lev,
-                .text = talloc_strdup(entry, text),
-            };
+            struct mp_log_buffer_entry *entry =
+                new_log_entry(prefix_str, lev, text_str);
             int pos = (buffer->entry0 + buffer->num_entries) % buffer->capacity;
             buffer->entries[pos] = entry;
             buffer->num_entries += 1;
@@ -404,17 +424,31 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 
     struct mp_log_root *root = log->root;
 
-    pthread_mutex_lock(&root->lock);
-
-    root->buffer.len = 0;
-
-    if (log->partial[0])
-        bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
-    log->partial[0] = '\0';
+    // Format the message before taking the lock, so that threads don't have
+    // to wait for each other's formatting. Usually this doesn't allocate.
+    char stack_buf[MSG_STACK_BUF];
+    char *msg = stack_buf;
+    va_list copy;
+    va_copy(copy, va);
+    int msg_len = vsnprintf(stack_buf, sizeof(stack_buf), format, copy);
+    va_end(copy);
+    if (msg_len < 0) {
+        stack_buf[0] = '\0';
+    } else if (msg_len >= sizeof(stack_buf)) {
+        msg = talloc_size(NULL, msg_len + 1);
+        vsnprintf(msg, msg_len + 1, format, va);
+    }
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    pthread_mutex_lock(&root->lock);
 
-    char *text = root->buffer.start;
+    char *text = msg;
+    if (log->partial[0]) {
+        root->buffer.len = 0;
+        bstr_xappend(root, &root->buffer, bstr0(log->partial));
+        bstr_xappend(root, &root->buffer, bstr0(msg));
+        text = root->buffer.start;
+        log->partial[0] = '\0';
+    }
 
     if (lev == MSGL_STATS) {
         dump_stats(log, lev, text);
@@ -451,6 +485,9 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
     }
 
     pthread_mutex_unlock(&root->lock);
+
+    if (msg != stack_buf)
+        talloc_free(msg);
 }
 
 static void destroy_log(void *ptr)
@@ -289,6 +289,17 @@ int64_t playlist_append_entries(struct playlist *pl, struct playlist *source_pl)
     return playlist_transfer_entries_to(pl, pl->num_entries, source_pl);
 }
 
+// Like playlist_transfer_entries(), but add the entries after the given entry
+// (which must be on pl). If after is NULL, append them to the end.
+int64_t playlist_transfer_entries_after(struct playlist *pl,
+                                        struct playlist_entry *after,
+                                        struct playlist *source_pl)
+{
+    assert(!after || after->pl == pl);
+    int add_at = after ? after->pl_index + 1 : pl->num_entries;
+    return playlist_transfer_entries_to(pl, add_at, source_pl);
+}
+
 // Return number of entries between list start and e.
 // Return -1 if e is not on the list, or if e is NULL.
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
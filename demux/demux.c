@@ -48,6 +48,7 @@
 
 #include "stream/stream.h"
 #include "demux.h"
+#include "dump_queue.h"
 #include "timeline.h"
 #include "stheader.h"
 #include "cue.h"
@@ -87,6 +88,9 @@ static const demuxer_desc_t *const demuxer_list[] = {
 struct demux_opts {
     int enable_cache;
     int disk_cache;
+    int disk_spill;
+    int cache_eviction;
+    int64_t dump_rate_limit;
     int64_t max_bytes;
     int64_t max_bytes_bw;
     int donate_fw;
@@ -114,6 +118,13 @@ const struct m_sub_options demux_conf = {
         {"cache", OPT_CHOICE(enable_cache,
             {"no", 0}, {"auto", -1}, {"yes", 1})},
         {"cache-on-disk", OPT_FLAG(disk_cache)},
+        {"cache-spill-to-disk", OPT_FLAG(disk_spill)},
+        {"cache-dump-rate-limit", OPT_BYTE_SIZE(dump_rate_limit),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"demuxer-cache-eviction", OPT_CHOICE(cache_eviction,
+            {"lru", DEMUX_EVICT_LRU},
+            {"distance", DEMUX_EVICT_DISTANCE},
+            {"pinned", DEMUX_EVICT_PINNED})},
         {"demuxer-readahead-secs", OPT_DOUBLE(min_secs), M_RANGE(0, DBL_MAX)},
         {"demuxer-max-bytes", OPT_BYTE_SIZE(max_bytes),
             M_RANGE(0, M_MAX_MEM_BYTES)},
@@ -254,11 +265,21 @@ struct demux_internal {
 
     double ts_offset;           // timestamp offset to apply to everything
 
+    int eviction_policy;        // DEMUX_EVICT_*
+    struct demux_eviction_stats eviction_stats[DEMUX_EVICT_COUNT];
+    // Spans which DEMUX_EVICT_PINNED tries to keep (with ts_offset applied).
+    struct demux_seek_range *pins;
+    int num_pins;
+
     // (sorted by least recent use: index 0 is least recently used)
     struct demux_cached_range **ranges;
     int num_ranges;
 
     size_t total_bytes;         // total sum of packet data buffered
+    // Part of total_bytes moved to the disk cache by spill_packet(). The
+    // difference is the memory actually in use.
+    size_t spilled_bytes;
+    bool spill_failed;
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is normally never NULL. This is always ranges[num_ranges - 1].
     // This is can be NULL during initialization or deinitialization.
@@ -282,8 +303,9 @@ struct demux_internal {
     bool force_metadata_update;
     int cached_metadata_index;  // speed up repeated lookups
 
-    struct mp_recorder *dumper;
+    struct demux_dumper *dumper;
     int dumper_status;
+    struct demux_cache_dump_progress dumper_progress; // of last closed dumper
 
     bool owns_stream;
 
@@ -331,6 +353,9 @@ struct demux_cached_range {
 // this amount of time (it's better to seek them manually).
 #define INDEX_STEP_SIZE 1.0
 
+// Maximum number of packets in demux_stream.handoff.
+#define HANDOFF_SIZE 8
+
 struct index_entry {
     double pts;
     struct demux_packet *pkt;
@@ -366,6 +391,10 @@ struct demux_queue {
     bool is_bof;            // started demuxing at beginning of file
     bool is_eof;            // received true EOF here
 
+    // Packets up to and including this were moved to the disk cache (NULL if
+    // unknown, i.e. scan from head).
+    struct demux_packet *spill_next;
+
     // Complete index, though it may skip some entries to reduce density.
     struct index_entry *index;  // ring buffer
     size_t index_size;          // size of index[] (0 or a power of 2)
@@ -410,7 +439,7 @@ struct demux_stream {
     bool need_wakeup;       // call wakeup_cb on next reader_head state change
     double force_read_until;// eager=false streams (subs): force read-ahead
 
-    // For demux_internal.dumper. Currently, this is used only temporarily
+    // For dump_cache(). Currently, this is used only temporarily
     // during blocking dumping.
     struct demux_packet *dump_pos;
 
@@ -447,6 +476,19 @@ struct demux_stream {
     // for closed captions (demuxer_feed_caption)
     struct sh_stream *cc;
     bool ignore_eof;        // ignore stream in underrun detection
+
+    // --- Lock-free handoff of packets to the reader (see handoff_fill()).
+    //     Pushed with in->lock held, popped by the reader with or without
+    //     in->lock. The packets were already removed from the reader position
+    //     and are owned by the queue.
+    struct demux_packet *handoff[HANDOFF_SIZE];
+    atomic_uint handoff_rd, handoff_wr; // ring indexes (not wrapped)
+    // Set if the reader position was reset. The reader must discard the
+    // queued packets (with in->lock held) before popping new ones.
+    atomic_bool handoff_flush;
+    // File position of the last packet popped without in->lock (-1 if none).
+    // Applied to d_user->filepos by the next locked read.
+    mp_atomic_int64 handoff_pos;
 };
 
 static void switch_to_fresh_cache_range(struct demux_internal *in);
@@ -464,6 +506,8 @@ static void find_backward_restart_pos(struct demux_stream *ds);
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags);
 static void prune_old_packets(struct demux_internal *in);
+static void handoff_fill(struct demux_stream *ds);
+static struct demux_packet *read_reader_packet(struct demux_stream *ds);
 static void dumper_close(struct demux_internal *in);
 static void demux_convert_tags_charset(struct demuxer *demuxer);
 
@@ -505,7 +549,8 @@ static void check_queue_consistency(struct demux_internal *in)
                 kf_found |= dp == queue->keyframe_latest;
                 kf1_found |= dp == queue->keyframe_first;
 
-                size_t bytes = demux_packet_estimate_total_size(dp);
+                size_t bytes = demux_packet_estimate_total_size(dp) +
+                               get_spilled_size(queue, dp);
                 total_bytes += bytes;
                 queue_total_bytes += bytes;
                 if (is_forward) {
@@ -695,6 +740,18 @@ broken:
     prune_metadata(range);
 }
 
+// Memory freed by moving the packet data to the disk cache with spill_packet().
+// (Packets written to the disk cache on creation were never accounted with
+// their data, so this is 0 for them.)
+static size_t get_spilled_size(struct demux_queue *queue,
+                               struct demux_packet *dp)
+{
+    if (!dp->is_cached)
+        return 0;
+    uint64_t end_pos = dp->next ? dp->next->cum_pos : queue->tail_cum_pos;
+    return end_pos - dp->cum_pos - demux_packet_estimate_total_size(dp);
+}
+
 // Remove queue->head from the queue.
 static void remove_head_packet(struct demux_queue *queue)
 {
@@ -705,10 +762,13 @@ static void remove_head_packet(struct demux_queue *queue)
         queue->keyframe_first = NULL;
     if (queue->keyframe_latest == dp)
         queue->keyframe_latest = NULL;
+    if (queue->spill_next == dp)
+        queue->spill_next = NULL;
     queue->is_bof = false;
 
     uint64_t end_pos = dp->next ? dp->next->cum_pos : queue->tail_cum_pos;
     queue->ds->in->total_bytes -= end_pos - dp->cum_pos;
+    queue->ds->in->spilled_bytes -= get_spilled_size(queue, dp);
 
     if (queue->num_index && queue->index[queue->index0].pkt == dp) {
         queue->index0 = (queue->index0 + 1) & QUEUE_INDEX_SIZE_MASK(queue);
@@ -748,12 +808,14 @@ static void clear_queue(struct demux_queue *queue)
     while (dp) {
         struct demux_packet *dn = dp->next;
         assert(ds->reader_head != dp);
+        in->spilled_bytes -= get_spilled_size(queue, dp);
         talloc_free(dp);
         dp = dn;
     }
     queue->head = queue->tail = NULL;
     queue->keyframe_first = NULL;
     queue->keyframe_latest = NULL;
+    queue->spill_next = NULL;
     queue->seek_start = queue->seek_end = queue->last_pruned = MP_NOPTS_VALUE;
 
     queue->correct_dts = queue->correct_pos = true;
@@ -816,8 +878,53 @@ static void free_empty_cached_ranges(struct demux_internal *in)
     }
 }
 
+static bool handoff_is_empty(struct demux_stream *ds)
+{
+    return atomic_load(&ds->handoff_rd) == atomic_load(&ds->handoff_wr);
+}
+
+// Whether the reader has packets available (possibly through the handoff).
+static bool ds_has_packets(struct demux_stream *ds)
+{
+    return ds->reader_head || !handoff_is_empty(ds);
+}
+
+// Called locked.
+static void handoff_request_flush(struct demux_stream *ds)
+{
+    if (!handoff_is_empty(ds))
+        atomic_store(&ds->handoff_flush, true);
+}
+
+// Free all packets in the handoff queue. Must be called with in->lock held,
+// and only by the reader (or if there is no reader anymore).
+static void handoff_discard(struct demux_stream *ds)
+{
+    unsigned int rd = atomic_load(&ds->handoff_rd);
+    unsigned int wr = atomic_load(&ds->handoff_wr);
+    for (; rd != wr; rd++)
+        talloc_free(ds->handoff[rd % HANDOFF_SIZE]);
+    atomic_store(&ds->handoff_rd, rd);
+    atomic_store(&ds->handoff_flush, false);
+}
+
+// Return the next packet from the handoff queue, or NULL. Can be called
+// without in->lock, but only by the reader.
+static struct demux_packet *handoff_pop(struct demux_stream *ds)
+{
+    if (atomic_load(&ds->handoff_flush))
+        return NULL;
+    unsigned int rd = atomic_load(&ds->handoff_rd);
+    if (rd == atomic_load(&ds->handoff_wr))
+        return NULL;
+    struct demux_packet *pkt = ds->handoff[rd % HANDOFF_SIZE];
+    atomic_store(&ds->handoff_rd, rd + 1);
+    return pkt;
+}
+
 static void ds_clear_reader_queue_state(struct demux_stream *ds)
 {
+    handoff_request_flush(ds);
     ds->reader_head = NULL;
     ds->eof = false;
     ds->need_wakeup = true;
@@ -945,6 +1052,25 @@ void demux_set_ts_offset(struct demuxer *demuxer, double offset)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Replace the set of pinned spans (in playback time, i.e. with the ts offset
+// applied). These are used by --demuxer-cache-eviction=pinned only.
+void demux_set_cache_pins(struct demuxer *demuxer,
+                          struct demux_seek_range *pins, int num_pins)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    in->num_pins = 0;
+    for (int n = 0; n < num_pins; n++) {
+        if (pins[n].start == MP_NOPTS_VALUE || pins[n].end == MP_NOPTS_VALUE ||
+            pins[n].start >= pins[n].end)
+            continue;
+        MP_TARRAY_APPEND(in, in->pins, in->num_pins, pins[n]);
+    }
+    pthread_mutex_unlock(&in->lock);
+}
+
 static void add_missing_streams(struct demux_internal *in,
                                 struct demux_cached_range *range)
 {
@@ -1002,6 +1128,7 @@ static void demux_add_sh_stream_locked(struct demux_internal *in,
     };
 
     struct demux_stream *ds = sh->ds;
+    atomic_store(&ds->handoff_pos, (int64_t)-1);
 
     if (!sh->codec->codec)
         sh->codec->codec = "";
@@ -1094,7 +1221,9 @@ static void demux_shutdown(struct demux_internal *in)
         in->recorder = NULL;
     }
 
+    pthread_mutex_lock(&in->lock);
     dumper_close(in);
+    pthread_mutex_unlock(&in->lock);
 
     if (demuxer->desc->close)
         demuxer->desc->close(in->d_thread);
@@ -1102,7 +1231,10 @@ static void demux_shutdown(struct demux_internal *in)
     in->d_thread->priv = NULL;
 
     demux_flush(demuxer);
+    for (int n = 0; n < in->num_streams; n++)
+        handoff_discard(in->streams[n]->ds);
     assert(in->total_bytes == 0);
+    assert(in->spilled_bytes == 0);
 
     in->current_range = NULL;
     free_empty_cached_ranges(in);
@@ -1651,6 +1783,38 @@ static void add_index_entry(struct demux_queue *queue, struct demux_packet *dp,
     };
 }
 
+// Whether dp is certainly before end (using the correct pos/dts of the stream).
+static bool packet_is_before(struct demux_stream *ds, struct demux_packet *dp,
+                             struct demux_packet *end)
+{
+    return (!ds->global_correct_dts || dp->dts < end->dts) &&
+           (!ds->global_correct_pos || dp->pos < end->pos);
+}
+
+// Remove the keyframe runs at the start of q2 that precede the run containing
+// end (a packet of the range before q2). The keyframe index is used to find
+// this run with a binary search, instead of comparing packet by packet.
+static void skip_to_join_run(struct demux_stream *ds, struct demux_queue *q2,
+                             struct demux_packet *end)
+{
+    size_t lo = 0, hi = q2->num_index;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (packet_is_before(ds, QUEUE_INDEX_ENTRY(q2, mid).pkt, end)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo)
+        return;
+
+    // Index packets are always before q2->keyframe_latest.
+    struct demux_packet *run = QUEUE_INDEX_ENTRY(q2, lo - 1).pkt;
+    while (q2->head != run)
+        remove_head_packet(q2);
+}
+
 // Check whether the next range in the list is, and if it appears to overlap,
 // try joining it into a single range.
 static void attempt_range_joining(struct demux_internal *in)
@@ -1682,8 +1846,10 @@ static void attempt_range_joining(struct demux_internal *in)
                current->seek_start, current->seek_end,
                next->seek_start, next->seek_end);
 
-    // Try to find a join point, where packets obviously overlap. (It would be
-    // better and faster to do this incrementally, but probably too complex.)
+    stats_time_start(in->stats, "range-join");
+
+    // Try to find a join point, where packets obviously overlap. Whole keyframe
+    // runs before the overlap are skipped using the index.
     // The current range can overlap arbitrarily with the next one, not only by
     // the seek overlap, but for arbitrary packet readahead as well.
     // We also drop the overlapping packets (if joining fails, we discard the
@@ -1702,6 +1868,7 @@ static void attempt_range_joining(struct demux_internal *in)
         struct demux_packet *end = q1->tail;
         bool join_point_found = !end; // no packets yet -> joining will work
         if (end) {
+            skip_to_join_run(ds, q2, end);
             while (q2->head) {
                 struct demux_packet *dp = q2->head;
 
@@ -1765,6 +1932,26 @@ static void attempt_range_joining(struct demux_internal *in)
         // First new packet that is appended to the current range.
         struct demux_packet *join_point = q2->head;
 
+        // Make the cum_pos values of the joined queue continuous. Only the
+        // packets of the smaller part need to be renumbered. (cum_pos is only
+        // used for differences, so unsigned wraparound is harmless.)
+        uint64_t q1_bytes = q1->head ? q1->tail_cum_pos - q1->head->cum_pos : 0;
+        uint64_t q2_bytes = join_point ? q2->tail_cum_pos - join_point->cum_pos : 0;
+        if (q1_bytes < q2_bytes) {
+            uint64_t delta = join_point->cum_pos - q1->tail_cum_pos;
+            for (struct demux_packet *dp = q1->head; dp; dp = dp->next)
+                dp->cum_pos += delta;
+            q1->tail_cum_pos = q2->tail_cum_pos;
+        } else {
+            for (struct demux_packet *dp = join_point; dp; dp = dp->next) {
+                uint64_t next_pos = dp->next ? dp->next->cum_pos
+                                             : q2->tail_cum_pos;
+                uint64_t size = next_pos - dp->cum_pos;
+                dp->cum_pos = q1->tail_cum_pos;
+                q1->tail_cum_pos += size;
+            }
+        }
+
         if (q2->head) {
             if (q1->head) {
                 q1->tail->next = q2->head;
@@ -1788,25 +1975,27 @@ static void attempt_range_joining(struct demux_internal *in)
         q2->head = q2->tail = NULL;
         q2->keyframe_first = NULL;
         q2->keyframe_latest = NULL;
+        q2->spill_next = NULL;
 
         if (ds->selected && !ds->reader_head)
             ds->reader_head = join_point;
         ds->skip_to_keyframe = false;
 
-        // Make the cum_pos values in all q2 packets continuous.
-        for (struct demux_packet *dp = join_point; dp; dp = dp->next) {
-            uint64_t next_pos = dp->next ? dp->next->cum_pos : q2->tail_cum_pos;
-            uint64_t size = next_pos - dp->cum_pos;
-            dp->cum_pos = q1->tail_cum_pos;
-            q1->tail_cum_pos += size;
-        }
-
-        // And update the index with packets from q2.
-        for (size_t i = 0; i < q2->num_index; i++) {
-            struct index_entry *e = &QUEUE_INDEX_ENTRY(q2, i);
-            add_index_entry(q1, e->pkt, e->pts);
+        // And update the index with packets from q2. If q1 has no index yet,
+        // take over the q2 one.
+        if (!q1->num_index) {
+            free_index(q1);
+            MPSWAP(struct index_entry *, q1->index, q2->index);
+            MPSWAP(size_t, q1->index_size, q2->index_size);
+            MPSWAP(size_t, q1->index0, q2->index0);
+            MPSWAP(size_t, q1->num_index, q2->num_index);
+        } else {
+            for (size_t i = 0; i < q2->num_index; i++) {
+                struct index_entry *e = &QUEUE_INDEX_ENTRY(q2, i);
+                add_index_entry(q1, e->pkt, e->pts);
+            }
+            free_index(q2);
         }
-        free_index(q2);
 
         // For moving demuxer position.
         ds->refreshing = ds->selected;
@@ -1833,6 +2022,8 @@ static void attempt_range_joining(struct demux_internal *in)
 failed:
     clear_cached_range(in, next);
     free_empty_cached_ranges(in);
+
+    stats_time_end(in->stats, "range-join");
 }
 
 // Compute the assumed first and last frame timestamp for keyframe range
@@ -1959,19 +2150,102 @@ static struct mp_recorder *recorder_create(struct demux_internal *in,
     return res;
 }
 
-static void write_dump_packet(struct demux_internal *in, struct demux_packet *dp)
+// Writes cache dumps on a separate thread, so that the demuxer thread (and
+// with it, playback) is not blocked by writing a large part of the cache.
+// The packets are queued as new references (or as disk cache positions), so
+// the cache can be pruned while dumping is still in progress. Memory held by
+// the queue counts against the backward cache size, and the queue is limited
+// to the total cache size.
+struct demux_dumper {
+    struct demux_internal *in;
+    struct mp_recorder *recorder;   // owned by the dumper thread
+    int64_t rate_limit;             // bytes per second, 0 for unlimited
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    struct dump_queue *queue;
+    bool live;                      // newly demuxed packets are appended
+    bool terminate;
+    int64_t start_time;
+    int64_t end_time;               // set when the thread is done writing
+    struct demux_cache_dump_progress progress;
+};
+
+// Called locked (in->lock), with in->dumper_status == CONTROL_TRUE.
+static void dumper_queue(struct demux_internal *in, struct dump_item item)
+{
+    struct demux_dumper *d = in->dumper;
+
+    pthread_mutex_lock(&d->lock);
+    dump_queue_push(d->queue, item);
+    if (item.pkt)
+        d->progress.packets_total += 1;
+    pthread_cond_signal(&d->wakeup);
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Stop dumping with an error. Called locked.
+static void dumper_fail(struct demux_internal *in)
 {
-    assert(in->dumper);
-    assert(in->dumper_status == CONTROL_TRUE);
+    in->dumper_status = CONTROL_ERROR;
+    pthread_mutex_lock(&in->dumper->lock);
+    in->dumper->terminate = true;
+    pthread_cond_signal(&in->dumper->wakeup);
+    pthread_mutex_unlock(&in->dumper->lock);
+}
 
-    struct mp_recorder_sink *sink =
-        mp_recorder_get_sink(in->dumper, in->streams[dp->stream]);
-    if (sink) {
-        mp_recorder_feed_packet(sink, dp);
+// Memory used by the dumper queue. Called locked.
+static int64_t dumper_queued_bytes(struct demux_internal *in)
+{
+    if (!in->dumper)
+        return 0;
+    pthread_mutex_lock(&in->dumper->lock);
+    int64_t bytes = in->dumper->queue->bytes;
+    pthread_mutex_unlock(&in->dumper->lock);
+    return bytes;
+}
+
+// Queue a new reference to dp. Called locked.
+static void dumper_queue_packet(struct demux_internal *in,
+                                struct demux_packet *dp)
+{
+    struct dump_item item = {
+        .sh = in->streams[dp->stream],
+        .cache_pos = -1,
+    };
+    if (dp->is_cached) {
+        // Just remember the position; the data is read on the dumper thread.
+        item.pkt = new_demux_packet(0);
+        item.cache_pos = dp->cached_data.pos;
+        if (item.pkt)
+            demux_packet_copy_attribs(item.pkt, dp);
     } else {
-        MP_ERR(in, "New stream appeared; stopping recording.\n");
-        in->dumper_status = CONTROL_ERROR;
+        item.pkt = demux_copy_packet(dp);
+    }
+    if (!item.pkt) {
+        MP_ERR(in, "Out of memory; stopping cache dumping.\n");
+        dumper_fail(in);
+        return;
     }
+    dumper_queue(in, item);
+}
+
+// Queue a newly demuxed packet, unless writing can't keep up. Called locked.
+static void dumper_queue_live_packet(struct demux_internal *in,
+                                     struct demux_packet *dp)
+{
+    pthread_mutex_lock(&in->dumper->lock);
+    bool full = dump_queue_is_full(in->dumper->queue);
+    pthread_mutex_unlock(&in->dumper->lock);
+    if (full) {
+        MP_ERR(in, "Writing the cache dump can't keep up with the demuxer; "
+               "stopping cache dumping.\n");
+        dumper_fail(in);
+        return;
+    }
+    dumper_queue_packet(in, dp);
 }
 
 static void record_packet(struct demux_internal *in, struct demux_packet *dp)
@@ -2001,8 +2275,8 @@ static void record_packet(struct demux_internal *in, struct demux_packet *dp)
         }
     }
 
-    if (in->dumper_status == CONTROL_OK)
-        write_dump_packet(in, dp);
+    if (in->dumper_status == CONTROL_OK && in->dumper->live)
+        dumper_queue_live_packet(in, dp);
 }
 
 static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
@@ -2150,6 +2424,8 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 
     back_demux_see_packets(ds);
 
+    handoff_fill(ds);
+
     wakeup_ds(ds);
 }
 
@@ -2168,7 +2444,7 @@ static bool lazy_stream_needs_wait(struct demux_stream *ds)
     struct demux_internal *in = ds->in;
     // Attempt to read until force_read_until was reached, or reading has
     // stopped for some reason (true EOF, queue overflow).
-    return !ds->eager && !ds->reader_head && !in->back_demuxing &&
+    return !ds->eager && !ds_has_packets(ds) && !in->back_demuxing &&
            !in->eof && ds->force_read_until != MP_NOPTS_VALUE &&
            (in->demux_ts == MP_NOPTS_VALUE ||
             in->demux_ts <= ds->force_read_until);
@@ -2191,7 +2467,7 @@ static bool read_packet(struct demux_internal *in)
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
         if (ds->eager) {
-            read_more |= !ds->reader_head;
+            read_more |= !ds_has_packets(ds);
             if (in->back_demuxing)
                 read_more |= ds->back_restarting || ds->back_resuming;
         } else {
@@ -2239,7 +2515,7 @@ static bool read_packet(struct demux_internal *in)
         }
         for (int n = 0; n < in->num_streams; n++) {
             struct demux_stream *ds = in->streams[n]->ds;
-            if (!ds->reader_head)
+            if (!ds_has_packets(ds))
                 mark_stream_eof(ds);
         }
         return false;
@@ -2296,29 +2572,166 @@ static bool read_packet(struct demux_internal *in)
     return true;
 }
 
+// Whether the memory used by the backward cache exceeds the limits.
+static bool back_cache_over_limit(struct demux_internal *in)
+{
+    uint64_t fw_bytes = 0;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        fw_bytes += get_foward_buffered_bytes(ds);
+    }
+    uint64_t max_avail = in->max_bytes_bw;
+    // Backward cache (if enabled at all) can use unused forward cache.
+    // Still leave 1 byte free, so the read_packet logic doesn't get stuck.
+    if (max_avail && in->max_bytes > (fw_bytes + 1) && in->opts->donate_fw)
+        max_avail += in->max_bytes - (fw_bytes + 1);
+    // fw_bytes includes the full size of spilled packets after the reader
+    // (e.g. after seeking back into spilled data), which spilled_bytes also
+    // subtracts. This underestimates the backward cache in this case, but
+    // only until the reader has passed the spilled packets.
+    int64_t back_bytes = (int64_t)in->total_bytes - (int64_t)in->spilled_bytes -
+                         (int64_t)fw_bytes;
+    // Packets queued for dumping may still be referenced after pruning.
+    uint64_t used = MPMAX(back_bytes, 0) + dumper_queued_bytes(in);
+    return used > max_avail;
+}
+
+// Move the packet data to the disk cache, and keep only the metadata.
+static bool spill_packet(struct demux_internal *in, struct demux_queue *queue,
+                         struct demux_packet *dp)
+{
+    assert(!dp->is_cached);
+    int64_t pos = demux_cache_write(in->cache, dp);
+    if (pos < 0)
+        return false;
+    demux_packet_unref_contents(dp);
+    dp->is_cached = true;
+    dp->cached_data.pos = pos;
+    in->spilled_bytes += get_spilled_size(queue, dp);
+    return true;
+}
+
+// With --cache-spill-to-disk, move old packets to the disk cache, as long as
+// the backward cache uses too much memory. Packets are spilled in the same
+// order they would be pruned, but they remain seekable.
+static void spill_old_packets(struct demux_internal *in)
+{
+    for (int r = 0; r < in->num_ranges; r++) {
+        struct demux_cached_range *range = in->ranges[r];
+        for (int n = 0; n < range->num_streams; n++) {
+            struct demux_queue *queue = range->streams[n];
+            struct demux_packet *dp =
+                queue->spill_next ? queue->spill_next : queue->head;
+            while (dp && dp != queue->ds->reader_head) {
+                if (!dp->is_cached) {
+                    if (!back_cache_over_limit(in))
+                        return;
+                    if (!spill_packet(in, queue, dp)) {
+                        MP_ERR(in, "Failed to write packet to cache file, "
+                               "pruning instead.\n");
+                        in->spill_failed = true;
+                        return;
+                    }
+                }
+                queue->spill_next = dp;
+                dp = dp->next;
+            }
+        }
+    }
+}
+
+// Whether range has packets that prune_old_packets() may remove.
+static bool range_can_prune(struct demux_cached_range *range)
+{
+    for (int n = 0; n < range->num_streams; n++) {
+        struct demux_queue *queue = range->streams[n];
+        if (queue->head && queue->head != queue->ds->reader_head)
+            return true;
+    }
+    return false;
+}
+
+// Whether pruning range would remove packets from a pinned span. Since
+// packets are always removed from the start of a range, this checks only the
+// range's start.
+static bool range_is_pinned(struct demux_internal *in,
+                            struct demux_cached_range *range)
+{
+    double ts = MP_ADD_PTS(range->seek_start, in->ts_offset);
+    if (ts == MP_NOPTS_VALUE)
+        return false;
+    for (int n = 0; n < in->num_pins; n++) {
+        if (ts >= in->pins[n].start && ts < in->pins[n].end)
+            return true;
+    }
+    return false;
+}
+
+// Return the range prune_old_packets() should remove packets from next, or
+// NULL if nothing can be pruned.
+static struct demux_cached_range *select_prune_range(struct demux_internal *in,
+                                                     double playhead)
+{
+    struct demux_cached_range *lru = NULL, *best = NULL;
+    double best_dist = -1;
+
+    for (int n = 0; n < in->num_ranges; n++) {
+        struct demux_cached_range *range = in->ranges[n];
+        if (!range_can_prune(range))
+            continue;
+        if (!lru)
+            lru = range;
+
+        switch (in->eviction_policy) {
+        case DEMUX_EVICT_DISTANCE: {
+            if (playhead == MP_NOPTS_VALUE)
+                break;
+            // Ranges without valid seek range are useless; prune them first.
+            double dist = range->seek_start == MP_NOPTS_VALUE
+                        ? INFINITY : fabs(playhead - range->seek_start);
+            if (dist > best_dist) {
+                best = range;
+                best_dist = dist;
+            }
+            break;
+        }
+        case DEMUX_EVICT_PINNED:
+            if (!best && !range_is_pinned(in, range))
+                best = range;
+            break;
+        }
+    }
+
+    // If everything is pinned, the cache limit still has to be enforced.
+    return best ? best : lru;
+}
+
 static void prune_old_packets(struct demux_internal *in)
 {
     assert(in->current_range == in->ranges[in->num_ranges - 1]);
 
+    double playhead = MP_NOPTS_VALUE;
+    for (int n = 0; n < in->num_streams; n++) {
+        struct demux_stream *ds = in->streams[n]->ds;
+        if (ds->selected)
+            playhead = MP_PTS_MAX(playhead, ds->base_ts);
+    }
+
+    if (in->cache && in->opts->disk_spill && in->max_bytes_bw &&
+        !in->spill_failed)
+        spill_old_packets(in);
+
     // It's not clear what the ideal way to prune old packets is. For now, we
-    // prune the oldest packet runs, as long as the total cache amount is too
-    // big.
+    // prune the oldest packet runs of the range picked by the eviction policy,
+    // as long as the total cache amount is too big.
     while (1) {
-        uint64_t fw_bytes = 0;
-        for (int n = 0; n < in->num_streams; n++) {
-            struct demux_stream *ds = in->streams[n]->ds;
-            fw_bytes += get_foward_buffered_bytes(ds);
-        }
-        uint64_t max_avail = in->max_bytes_bw;
-        // Backward cache (if enabled at all) can use unused forward cache.
-        // Still leave 1 byte free, so the read_packet logic doesn't get stuck.
-        if (max_avail && in->max_bytes > (fw_bytes + 1) && in->opts->donate_fw)
-            max_avail += in->max_bytes - (fw_bytes + 1);
-        if (in->total_bytes - fw_bytes <= max_avail)
+        if (!back_cache_over_limit(in))
+            break;
+
+        struct demux_cached_range *range = select_prune_range(in, playhead);
+        if (!range)
             break;
 
-        // (Start from least recently used range.)
-        struct demux_cached_range *range = in->ranges[0];
         double earliest_ts = MP_NOPTS_VALUE;
         struct demux_stream *earliest_stream = NULL;
 
@@ -2466,6 +2879,7 @@ static void update_opts(struct demux_internal *in)
     struct demux_opts *opts = in->opts;
 
     in->min_secs = opts->min_secs;
+    in->eviction_policy = opts->cache_eviction;
     in->max_bytes = opts->max_bytes;
     in->max_bytes_bw = opts->max_bytes_bw;
 
@@ -2494,7 +2908,9 @@ static void update_opts(struct demux_internal *in)
         in->using_network_cache_opts = false;
     }
 
-    if (in->seekable_cache && opts->disk_cache && !in->cache) {
+    if (in->seekable_cache && (opts->disk_cache || opts->disk_spill) &&
+        !in->cache)
+    {
         in->cache = demux_cache_create(in->global, in->log);
         if (!in->cache)
             MP_ERR(in, "Failed to create file cache.\n");
@@ -2627,6 +3043,14 @@ static struct demux_packet *read_packet_from_cache(struct demux_internal *in,
     return pkt;
 }
 
+// This implies this function is actually called from "the" user thread.
+static void update_reader_filepos(struct demux_internal *in,
+                                  struct demux_packet *pkt)
+{
+    if (pkt->pos >= in->d_user->filepos)
+        in->d_user->filepos = pkt->pos;
+}
+
 // Returns:
 //   < 0: EOF was reached, *res is not set
 //  == 0: no new packet yet, wait, *res is not set
@@ -2661,6 +3085,25 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
 
     ds->force_read_until = min_pts;
 
+    if (atomic_load(&ds->handoff_flush))
+        handoff_discard(ds);
+
+    // Position of packets returned by demux_read_packet_async_until()'s fast
+    // path.
+    int64_t handoff_pos = atomic_load(&ds->handoff_pos);
+    if (handoff_pos >= in->d_user->filepos)
+        in->d_user->filepos = handoff_pos;
+
+    // Packets already moved out of the queue by handoff_fill() come first.
+    struct demux_packet *handoff_pkt = handoff_pop(ds);
+    if (handoff_pkt) {
+        ds->need_wakeup = false;
+        update_reader_filepos(in, handoff_pkt);
+        in->d_user->filesize = in->stream_size;
+        *res = handoff_pkt;
+        return 1;
+    }
+
     if (ds->back_resuming || ds->back_restarting) {
         assert(in->back_demuxing);
         return 0;
@@ -2705,11 +3148,29 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
         return eof ? -1 : 0;
     }
 
+    struct demux_packet *pkt = read_reader_packet(ds);
+    if (!pkt)
+        return 0;
+
+    update_reader_filepos(in, pkt);
+    in->d_user->filesize = in->stream_size;
+
+    prune_old_packets(in);
+    *res = pkt;
+    return 1;
+}
+
+// Move the packet at the reader position out of the queue, and return a new
+// reference to it, adjusted for the reader. Updates the reader state. Returns
+// NULL if there was no packet or on failure.
+static struct demux_packet *read_reader_packet(struct demux_stream *ds)
+{
+    struct demux_internal *in = ds->in;
+
     struct demux_packet *pkt = advance_reader_head(ds);
-    assert(pkt);
     pkt = read_packet_from_cache(in, pkt);
     if (!pkt)
-        return 0;
+        return NULL;
 
     if (in->back_demuxing) {
         if (pkt->keyframe) {
@@ -2748,11 +3209,6 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
     }
     ds->last_br_bytes += pkt->len;
 
-    // This implies this function is actually called from "the" user thread.
-    if (pkt->pos >= in->d_user->filepos)
-        in->d_user->filepos = pkt->pos;
-    in->d_user->filesize = in->stream_size;
-
     pkt->pts = MP_ADD_PTS(pkt->pts, in->ts_offset);
     pkt->dts = MP_ADD_PTS(pkt->dts, in->ts_offset);
 
@@ -2761,9 +3217,35 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
         pkt->end = MP_ADD_PTS(pkt->end, in->ts_offset);
     }
 
-    prune_old_packets(in);
-    *res = pkt;
-    return 1;
+    return pkt;
+}
+
+// Move packets from the reader position to the handoff queue, from where the
+// reader can fetch them without taking in->lock. This is done only for normal
+// forward playback with the demuxer thread enabled; everything else (and the
+// case when the queue ran empty) goes through dequeue_packet(). Called locked.
+static void handoff_fill(struct demux_stream *ds)
+{
+    struct demux_internal *in = ds->in;
+
+    if (!in->threading || in->blocked || in->back_demuxing || !ds->selected ||
+        ds->sh->attached_picture || atomic_load(&ds->handoff_flush))
+        return;
+
+    unsigned int rd = atomic_load(&ds->handoff_rd);
+    unsigned int wr = atomic_load(&ds->handoff_wr);
+    bool added = false;
+    while (ds->reader_head && wr - rd < HANDOFF_SIZE) {
+        struct demux_packet *pkt = read_reader_packet(ds);
+        if (!pkt)
+            break;
+        ds->handoff[wr % HANDOFF_SIZE] = pkt;
+        atomic_store(&ds->handoff_wr, ++wr);
+        added = true;
+    }
+
+    if (added)
+        prune_old_packets(in);
 }
 
 // Poll the demuxer queue, and if there's a packet, return it. Otherwise, just
@@ -2795,6 +3277,16 @@ int demux_read_packet_async_until(struct sh_stream *sh, double min_pts,
         return -1;
     struct demux_internal *in = ds->in;
 
+    // Fast path without locking. d_user->filepos and filesize are protected
+    // by in->lock, so they are updated on the next locked read only.
+    struct demux_packet *pkt = handoff_pop(ds);
+    if (pkt) {
+        if (pkt->pos >= 0)
+            atomic_store(&ds->handoff_pos, pkt->pos);
+        *out_pkt = pkt;
+        return 1;
+    }
+
     pthread_mutex_lock(&in->lock);
     int r = -1;
     while (1) {
@@ -2804,6 +3296,8 @@ int demux_read_packet_async_until(struct sh_stream *sh, double min_pts,
         // Needs to actually read packets until we got a packet or EOF.
         thread_work(in);
     }
+    if (r > 0)
+        handoff_fill(ds);
     pthread_mutex_unlock(&in->lock);
     return r;
 }
@@ -2988,6 +3482,7 @@ static void demux_copy(struct demuxer *dst, struct demuxer *src)
     dst->num_attachments = src->num_attachments;
     dst->matroska_data = src->matroska_data;
     dst->playlist = src->playlist;
+    dst->playlist_partial = src->playlist_partial;
     dst->seekable = src->seekable;
     dst->partially_seekable = src->partially_seekable;
     dst->filetype = src->filetype;
@@ -3219,6 +3714,48 @@ void demux_close_stream(struct demuxer *demuxer)
     in->d_user->stream = NULL;
 }
 
+// For demuxer implementations only, during open. Like demux_close_stream(),
+// but instead of closing the stream, transfer its ownership to the caller. The
+// caller must free it before the demuxer is destroyed (i.e. in the close
+// callback at latest), because it is still bound to demuxer->cancel. Returns
+// NULL if the demuxer does not own the stream.
+struct stream *demux_detach_stream(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(!in->threading && demuxer == in->d_thread);
+
+    struct stream *s = demuxer->stream;
+    if (!s || !in->owns_stream)
+        return NULL;
+
+    demuxer->stream = NULL;
+    in->d_user->stream = NULL;
+    return s;
+}
+
+// Undo demux_detach_stream(). Only allowed during open.
+void demux_reattach_stream(struct demuxer *demuxer, struct stream *s)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(!in->threading && demuxer == in->d_thread);
+    assert(!demuxer->stream && in->owns_stream);
+
+    demuxer->stream = s;
+    in->d_user->stream = s;
+}
+
+// For demuxer implementations only. Can be called from any thread to notify
+// the user that some demuxer specific state changed asynchronously, e.g. that
+// demux_playlist_read_more() has new entries.
+void demux_wakeup(struct demuxer *demuxer)
+{
+    struct demux_internal *in = demuxer->in;
+    pthread_mutex_lock(&in->lock);
+    if (in->wakeup_cb)
+        in->wakeup_cb(in->wakeup_cb_ctx);
+    pthread_mutex_unlock(&in->lock);
+}
+
 static void demux_init_ccs(struct demuxer *demuxer, struct demux_opts *opts)
 {
     struct demux_internal *in = demuxer->in;
@@ -3837,6 +4374,15 @@ static bool queue_seek(struct demux_internal *in, double seek_pts, int flags,
         }
     }
 
+    if (in->seekable_cache) {
+        struct demux_eviction_stats *st =
+            &in->eviction_stats[in->eviction_policy];
+        if (cache_target)
+            st->hits += 1;
+        else
+            st->misses += 1;
+    }
+
     in->eof = false;
     in->reading = false;
     in->back_demuxing = set_backwards;
@@ -4102,6 +4648,8 @@ void demux_block_reading(struct demuxer *demuxer, bool block)
     pthread_mutex_lock(&in->lock);
     in->blocked = block;
     for (int n = 0; n < in->num_streams; n++) {
+        if (block)
+            handoff_request_flush(in->streams[n]->ds);
         in->streams[n]->ds->need_wakeup = true;
         wakeup_ds(in->streams[n]->ds);
     }
@@ -4179,13 +4727,150 @@ static void update_cache(struct demux_internal *in)
         in->next_cache_update = now + MP_SECOND_US + 1;
 }
 
+// Write a single item. Returns false on failure. Called unlocked.
+static bool dumper_write_item(struct demux_dumper *d, struct dump_item *item,
+                              int64_t *bytes)
+{
+    struct demux_internal *in = d->in;
+    struct demux_packet *pkt = item->pkt;
+
+    if (!pkt) {
+        mp_recorder_mark_discontinuity(d->recorder);
+        return true;
+    }
+
+    if (item->cache_pos >= 0) {
+        pthread_mutex_lock(&in->lock);
+        struct demux_packet *data =
+            in->cache ? demux_cache_read(in->cache, item->cache_pos) : NULL;
+        pthread_mutex_unlock(&in->lock);
+        if (!data) {
+            MP_ERR(in, "Failed to retrieve packet from cache.\n");
+            talloc_free(pkt);
+            return false;
+        }
+        demux_packet_copy_attribs(data, pkt);
+        talloc_free(pkt);
+        pkt = data;
+    }
+
+    bool ok = true;
+    struct mp_recorder_sink *sink = mp_recorder_get_sink(d->recorder, item->sh);
+    if (sink) {
+        mp_recorder_feed_packet(sink, pkt);
+        *bytes = pkt->len;
+    } else {
+        MP_ERR(in, "New stream appeared; stopping recording.\n");
+        ok = false;
+    }
+    talloc_free(pkt);
+    return ok;
+}
+
+// Sleep until writing more is allowed by the rate limit. Called locked
+// (d->lock).
+static void dumper_wait_rate_limit(struct demux_dumper *d)
+{
+    if (!d->rate_limit)
+        return;
+    int64_t until = d->start_time +
+        (int64_t)(d->progress.bytes_written / (double)d->rate_limit * 1e6);
+    while (!d->terminate && mp_time_us() < until) {
+        struct timespec ts = mp_time_us_to_timespec(until);
+        pthread_cond_timedwait(&d->wakeup, &d->lock, &ts);
+    }
+}
+
+static void *dumper_thread(void *p)
+{
+    struct demux_dumper *d = p;
+    struct demux_internal *in = d->in;
+
+    mpthread_set_name("dumper");
+
+    bool failed = false;
+
+    pthread_mutex_lock(&d->lock);
+    while (!d->terminate) {
+        struct dump_item item;
+        if (!dump_queue_pop(d->queue, &item)) {
+            if (!d->live)
+                break;
+            pthread_cond_wait(&d->wakeup, &d->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&d->lock);
+        int64_t bytes = 0;
+        bool ok = dumper_write_item(d, &item, &bytes);
+        pthread_mutex_lock(&d->lock);
+
+        if (!ok) {
+            failed = true;
+            break;
+        }
+        if (item.pkt) {
+            d->progress.packets_written += 1;
+            d->progress.bytes_written += bytes;
+        }
+        dumper_wait_rate_limit(d);
+    }
+    dump_queue_clear(d->queue);
+    d->end_time = mp_time_us();
+    pthread_mutex_unlock(&d->lock);
+
+    // Finish the file before reporting the status.
+    mp_recorder_destroy(d->recorder);
+    d->recorder = NULL;
+
+    pthread_mutex_lock(&in->lock);
+    if (in->dumper == d && in->dumper_status == CONTROL_TRUE) {
+        in->dumper_status = failed ? CONTROL_ERROR : CONTROL_FALSE;
+        if (in->wakeup_cb)
+            in->wakeup_cb(in->wakeup_cb_ctx);
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    return NULL;
+}
+
+static void dumper_get_progress(struct demux_dumper *d,
+                                struct demux_cache_dump_progress *progress)
+{
+    pthread_mutex_lock(&d->lock);
+    *progress = d->progress;
+    int64_t end = d->end_time ? d->end_time : mp_time_us();
+    double secs = (end - d->start_time) / 1e6;
+    if (secs > 0)
+        progress->bytes_per_second = progress->bytes_written / secs;
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Stop dumping, and wait until the dump file was closed. Called locked; the
+// lock is released temporarily.
 static void dumper_close(struct demux_internal *in)
 {
-    if (in->dumper)
-        mp_recorder_destroy(in->dumper);
+    struct demux_dumper *d = in->dumper;
     in->dumper = NULL;
     if (in->dumper_status == CONTROL_TRUE)
         in->dumper_status = CONTROL_FALSE; // make abort equal to success
+    if (!d)
+        return;
+
+    pthread_mutex_lock(&d->lock);
+    d->terminate = true;
+    pthread_cond_signal(&d->wakeup);
+    pthread_mutex_unlock(&d->lock);
+
+    pthread_mutex_unlock(&in->lock);
+    pthread_join(d->thread, NULL);
+    pthread_mutex_lock(&in->lock);
+
+    assert(!d->recorder);
+    dumper_get_progress(d, &in->dumper_progress);
+    pthread_cond_destroy(&d->wakeup);
+    pthread_mutex_destroy(&d->lock);
+    talloc_free(d);
 }
 
 static int range_time_compare(const void *p1, const void *p2)
@@ -4198,12 +4883,10 @@ static int range_time_compare(const void *p1, const void *p2)
     return r1->seek_start < r2->seek_start ? -1 : 1;
 }
 
+// Queue all cached packets between start and end to in->dumper, interleaved
+// by DTS. This only takes packet references, so it's relatively fast.
 static void dump_cache(struct demux_internal *in, double start, double end)
 {
-    in->dumper_status = in->dumper ? CONTROL_TRUE : CONTROL_ERROR;
-    if (!in->dumper)
-        return;
-
     // (only in pathological cases there might be more ranges than allowed)
     struct demux_cached_range *ranges[MAX_SEEK_RANGES];
     int num_ranges = 0;
@@ -4220,7 +4903,7 @@ static void dump_cache(struct demux_internal *in, double start, double end)
         if (end != MP_NOPTS_VALUE && r->seek_start >= end)
             continue;
 
-        mp_recorder_mark_discontinuity(in->dumper);
+        dumper_queue(in, (struct dump_item){.cache_pos = -1});
 
         double pts = start;
         int flags = 0;
@@ -4274,15 +4957,9 @@ static void dump_cache(struct demux_internal *in, double start, double end)
             struct demux_stream *ds = in->streams[next->stream]->ds;
             ds->dump_pos = next->next;
 
-            struct demux_packet *dp = read_packet_from_cache(in, next);
-            if (!dp) {
-                in->dumper_status = CONTROL_ERROR;
+            dumper_queue_packet(in, next);
+            if (in->dumper_status != CONTROL_OK)
                 break;
-            }
-
-            write_dump_packet(in, dp);
-
-            talloc_free(dp);
         }
 
         if (in->dumper_status != CONTROL_OK)
@@ -4296,12 +4973,7 @@ static void dump_cache(struct demux_internal *in, double start, double end)
     // If dumping (in end==NOPTS mode) doesn't continue at the range that
     // was written last, we have a discontinuity.
     if (num_ranges && ranges[num_ranges - 1] != in->current_range)
-        mp_recorder_mark_discontinuity(in->dumper);
-
-    // end=NOPTS means the demuxer output continues to be written to the
-    // dump file.
-    if (end != MP_NOPTS_VALUE || in->dumper_status != CONTROL_OK)
-        dumper_close(in);
+        dumper_queue(in, (struct dump_item){.cache_pos = -1});
 }
 
 // Set the current cache dumping mode. There is only at most 1 dump process
@@ -4329,15 +5001,41 @@ bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
     if (file && file[0] && start != MP_NOPTS_VALUE) {
         res = true;
 
-        in->dumper = recorder_create(in, file);
+        in->dumper_status = CONTROL_ERROR;
 
-        // This is not asynchronous and will freeze the shit for a while if the
-        // user is unlucky. It could be moved to a thread with some effort.
-        // General idea: iterate over all cache ranges, dump what intersects.
-        // After that, and if the user requested it, make it dump all newly
-        // received packets, even if it's awkward (consider the case if the
-        // current range is not the last range).
-        dump_cache(in, start, end);
+        struct mp_recorder *recorder = recorder_create(in, file);
+        if (recorder) {
+            struct demux_dumper *d = talloc_ptrtype(NULL, d);
+            *d = (struct demux_dumper){
+                .in = in,
+                .recorder = recorder,
+                .rate_limit = in->opts->dump_rate_limit,
+                .live = end == MP_NOPTS_VALUE,
+                .start_time = mp_time_us(),
+            };
+            d->queue = dump_queue_create(d, in->opts->max_bytes +
+                                            in->opts->max_bytes_bw);
+            pthread_mutex_init(&d->lock, NULL);
+            pthread_cond_init(&d->wakeup, NULL);
+
+            in->dumper = d;
+            in->dumper_status = CONTROL_TRUE;
+
+            // General idea: iterate over all cache ranges, queue what
+            // intersects. After that, and if the user requested it, make it
+            // dump all newly received packets, even if it's awkward (consider
+            // the case if the current range is not the last range).
+            dump_cache(in, start, end);
+
+            if (pthread_create(&d->thread, NULL, dumper_thread, d)) {
+                in->dumper = NULL;
+                in->dumper_status = CONTROL_ERROR;
+                mp_recorder_destroy(recorder);
+                pthread_cond_destroy(&d->wakeup);
+                pthread_mutex_destroy(&d->lock);
+                talloc_free(d);
+            }
+        }
     }
 
     pthread_mutex_unlock(&in->lock);
@@ -4346,11 +5044,21 @@ bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
 }
 
 // Returns one of CONTROL_*. CONTROL_TRUE means dumping is in progress.
-int demux_cache_dump_get_status(struct demuxer *demuxer)
+// If progress is not NULL, it is set to the state of the current or last dump
+// (all 0 if there was none).
+int demux_cache_dump_get_status(struct demuxer *demuxer,
+                                struct demux_cache_dump_progress *progress)
 {
     struct demux_internal *in = demuxer->in;
     pthread_mutex_lock(&in->lock);
     int status = in->dumper_status;
+    if (progress) {
+        if (in->dumper) {
+            dumper_get_progress(in->dumper, progress);
+        } else {
+            *progress = in->dumper_progress;
+        }
+    }
     pthread_mutex_unlock(&in->lock);
     return status;
 }
@@ -4490,22 +5198,25 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
         .ts_reader = MP_NOPTS_VALUE,
         .ts_end = MP_NOPTS_VALUE,
         .ts_duration = -1,
-        .total_bytes = in->total_bytes,
+        .total_bytes = in->total_bytes - in->spilled_bytes,
         .seeking = in->seeking_in_progress,
         .low_level_seeks = in->low_level_seeks,
         .ts_last = in->demux_ts,
         .bytes_per_second = in->bytes_per_second,
         .byte_level_seeks = in->byte_level_seeks,
         .file_cache_bytes = in->cache ? demux_cache_get_size(in->cache) : -1,
+        .eviction_policy = in->eviction_policy,
     };
+    for (int n = 0; n < DEMUX_EVICT_COUNT; n++)
+        r->eviction_stats[n] = in->eviction_stats[n];
     bool any_packets = false;
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
         if (ds->eager && !(!ds->queue->head && ds->eof) && !ds->ignore_eof) {
-            r->underrun |= !ds->reader_head && !ds->eof && !ds->still_image;
+            r->underrun |= !ds_has_packets(ds) && !ds->eof && !ds->still_image;
             r->ts_reader = MP_PTS_MAX(r->ts_reader, ds->base_ts);
             r->ts_end = MP_PTS_MAX(r->ts_end, ds->queue->last_ts);
-            any_packets |= !!ds->reader_head;
+            any_packets |= ds_has_packets(ds);
         }
         r->fw_bytes += get_foward_buffered_bytes(ds);
     }
@@ -36,6 +36,19 @@ struct demux_seek_range {
     double start, end;
 };
 
+// Values for --demuxer-cache-eviction.
+enum demux_cache_eviction {
+    DEMUX_EVICT_LRU,        // least recently used cached range first
+    DEMUX_EVICT_DISTANCE,   // range starting farthest from the playhead first
+    DEMUX_EVICT_PINNED,     // like LRU, but skip pinned ranges if possible
+    DEMUX_EVICT_COUNT,
+};
+
+struct demux_eviction_stats {
+    uint64_t hits;          // seeks served from the cache
+    uint64_t misses;        // seeks which needed a low level seek
+};
+
 struct demux_reader_state {
     bool eof, underrun, idle;
     bool bof_cached, eof_cached;
@@ -54,6 +67,9 @@ struct demux_reader_state {
     // level seek.
     int num_seek_ranges;
     struct demux_seek_range seek_ranges[MAX_SEEK_RANGES];
+    int eviction_policy; // current DEMUX_EVICT_* value
+    // Indexed by DEMUX_EVICT_*; each seek counts towards the active policy.
+    struct demux_eviction_stats eviction_stats[DEMUX_EVICT_COUNT];
 };
 
 #define SEEK_FACTOR   (1 << 1)      // argument is in range [0,1]
@@ -176,6 +192,7 @@ struct demuxer_params {
     bool disable_timeline;
     bstr init_fragment;
     bool skip_lavf_probing;
+    int max_probe_bytes; // if >0, limit stream info probing (libavformat)
     bool stream_record; // if true, enable stream recording if option is set
     int stream_flags;
     struct stream *external_stream; // if set, use this, don't open or close streams
@@ -222,6 +239,9 @@ typedef struct demuxer {
 
     // If the file is a playlist file
     struct playlist *playlist;
+    // If true, the playlist is still read in the background, and further
+    // entries can be retrieved with demux_playlist_read_more().
+    bool playlist_partial;
 
     struct mp_tags *metadata;
 
@@ -282,6 +302,8 @@ bool demux_cancel_test(struct demuxer *demuxer);
 void demux_flush(struct demuxer *demuxer);
 int demux_seek(struct demuxer *demuxer, double rel_seek_secs, int flags);
 void demux_set_ts_offset(struct demuxer *demuxer, double offset);
+void demux_set_cache_pins(struct demuxer *demuxer,
+                          struct demux_seek_range *pins, int num_pins);
 
 void demux_get_bitrate_stats(struct demuxer *demuxer, double *rates);
 void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *r);
@@ -302,13 +324,23 @@ int demuxer_add_chapter(demuxer_t *demuxer, char *name,
 void demux_stream_tags_changed(struct demuxer *demuxer, struct sh_stream *sh,
                                struct mp_tags *tags, double pts);
 void demux_close_stream(struct demuxer *demuxer);
+struct stream *demux_detach_stream(struct demuxer *demuxer);
+void demux_reattach_stream(struct demuxer *demuxer, struct stream *s);
+void demux_wakeup(struct demuxer *demuxer);
 
 void demux_metadata_changed(demuxer_t *demuxer);
 void demux_update(demuxer_t *demuxer, double playback_pts);
 
 bool demux_cache_dump_set(struct demuxer *demuxer, double start, double end,
                           char *file);
-int demux_cache_dump_get_status(struct demuxer *demuxer);
+struct demux_cache_dump_progress {
+    int64_t packets_total;      // packets queued for writing so far
+    int64_t packets_written;
+    int64_t bytes_written;      // packet payload bytes
+    double bytes_per_second;    // average since dumping was started
+};
+int demux_cache_dump_get_status(struct demuxer *demuxer,
+                                struct demux_cache_dump_progress *progress);
 
 double demux_probe_cache_dump_target(struct demuxer *demuxer, double pts,
                                      bool for_end);
@@ -328,4 +360,7 @@ bool demux_matroska_uid_cmp(struct matroska_segment_uid *a,
 
 const char *stream_type_name(enum stream_type type);
 
+struct playlist;
+bool demux_playlist_read_more(struct demuxer *demuxer, struct playlist *pl);
+
 #endif /* MPLAYER_DEMUXER_H */
@@ -974,10 +974,14 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     if (index_mode != 1)
         avfc->flags |= AVFMT_FLAG_IGNIDX;
 
-    if (lavfdopts->probesize) {
-        if (av_opt_set_int(avfc, "probesize", lavfdopts->probesize, 0) < 0)
+    int probesize = lavfdopts->probesize;
+    int max_probe = demuxer->params ? demuxer->params->max_probe_bytes : 0;
+    if (max_probe > 0 && (!probesize || probesize > max_probe))
+        probesize = MPMAX(max_probe, 32);
+    if (probesize) {
+        if (av_opt_set_int(avfc, "probesize", probesize, 0) < 0)
             MP_ERR(demuxer, "couldn't set option probesize to %u\n",
-                   lavfdopts->probesize);
+                   probesize);
     }
 
     if (priv->format_hack.analyzeduration)
@@ -15,22 +15,30 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 
 #include "osdep/io.h"
 
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
 #include "mpv_talloc.h"
 #include "common/msg.h"
 #include "options/options.h"
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -39,14 +47,35 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+// A frame being read (or already read) by a prefetch worker.
+struct mf_job {
+    struct mf *mf;
+    int frame;
+    struct demux_packet *pkt;   // result, NULL on error
+    bool done;                  // worker finished
+    bool abandoned;             // not in the window anymore; worker frees it
+};
+
 typedef struct mf {
     struct mp_log *log;
+    struct demuxer *demuxer;
     struct sh_stream *sh;
     int curr_frame;
     int nr_of_files;
     char **names;
     // optional
     struct stream **streams;
+    bool use_mmap;
+
+    // Prefetching (only if pool is set).
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- Protected by lock
+    int prefetch;               // max. window size and concurrent reads
+    struct mf_job **window;     // jobs for curr_frame, curr_frame + 1, ...
+    int num_window;
+    int num_running;            // jobs not done yet (including abandoned ones)
 } mf_t;
 
 
@@ -209,6 +238,140 @@ static mf_t *open_mf_single(void *talloc_ctx, struct mp_log *log, char *filename
     return mf;
 }
 
+#if HAVE_POSIX
+// Read a local file by mapping it, which avoids the stream layer's buffering
+// and the repeated reallocation of stream_read_complete(). Returns NULL on
+// any failure, in which case the caller falls back to the normal path.
+// The data is copied into the packet (which needs padding) while the file is
+// mapped. If the file is truncated during the copy, accessing the missing
+// pages raises SIGBUS and the player crashes; this is why --mf-mmap is off by
+// default.
+static struct demux_packet *read_file_mmap(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct demux_packet *dp = NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        st.st_size <= MF_MAX_FILE_SIZE)
+    {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            posix_madvise(p, st.st_size, POSIX_MADV_SEQUENTIAL);
+            dp = new_demux_packet_from(p, st.st_size);
+            munmap(p, st.st_size);
+        }
+    }
+    close(fd);
+    return dp;
+}
+#endif
+
+// Read the given frame. Returns NULL on error. Called on the demuxer thread,
+// or on prefetch workers (then mf->streams is never set).
+static struct demux_packet *read_frame(mf_t *mf, int frame)
+{
+    struct demuxer *demuxer = mf->demuxer;
+    struct demux_packet *dp = NULL;
+
+    struct stream *entry_stream = NULL;
+    if (mf->streams)
+        entry_stream = mf->streams[frame];
+    struct stream *stream = entry_stream;
+    char *filename = mf->names[frame];
+
+#if HAVE_POSIX
+    if (!stream && filename && mf->use_mmap) {
+        char *path = mp_file_get_path(NULL, bstr0(filename));
+        if (path)
+            dp = read_file_mmap(path);
+        talloc_free(path);
+    }
+#endif
+
+    if (!dp && !stream && filename) {
+        stream = stream_create(filename, demuxer->stream_origin | STREAM_READ,
+                               demuxer->cancel, demuxer->global);
+    }
+
+    if (!dp && stream) {
+        stream_seek(stream, 0);
+        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+        if (data.len)
+            dp = new_demux_packet_from(data.start, data.len);
+        talloc_free(data.start);
+    }
+
+    if (stream && stream != entry_stream)
+        free_stream(stream);
+
+    if (dp) {
+        dp->pts = frame / mf->sh->codec->fps;
+        dp->keyframe = true;
+        dp->stream = mf->sh->index;
+    }
+    return dp;
+}
+
+static void free_job(struct mf_job *job)
+{
+    if (job->pkt)
+        free_demux_packet(job->pkt);
+    talloc_free(job);
+}
+
+static void fill_window(mf_t *mf);
+
+static void prefetch_worker(void *ctx)
+{
+    struct mf_job *job = ctx;
+    mf_t *mf = job->mf;
+
+    struct demux_packet *pkt = read_frame(mf, job->frame);
+
+    pthread_mutex_lock(&mf->lock);
+    job->pkt = pkt;
+    job->done = true;
+    mf->num_running--;
+    if (job->abandoned)
+        free_job(job);
+    // A read slot was freed; continue prefetching in the background.
+    fill_window(mf);
+    pthread_cond_broadcast(&mf->wakeup);
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Start reads for frames following the window, as long as there are free
+// slots. Must be called locked.
+static void fill_window(mf_t *mf)
+{
+    while (mf->num_window < mf->prefetch && mf->num_running < mf->prefetch) {
+        int frame = mf->curr_frame + mf->num_window;
+        if (frame >= mf->nr_of_files)
+            break;
+        struct mf_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct mf_job){ .mf = mf, .frame = frame };
+        MP_TARRAY_APPEND(mf, mf->window, mf->num_window, job);
+        mf->num_running++;
+        // Can't fail, the pool was created with at least 1 thread.
+        mp_thread_pool_queue(mf->pool, prefetch_worker, job);
+    }
+}
+
+// Remove the first entry of the window. Must be called locked.
+static void drop_window_head(mf_t *mf)
+{
+    assert(mf->num_window > 0);
+    struct mf_job *job = mf->window[0];
+    MP_TARRAY_REMOVE_AT(mf->window, mf->num_window, 0);
+    if (job->done) {
+        free_job(job);
+    } else {
+        job->abandoned = true;
+    }
+}
+
 static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
 {
     mf_t *mf = demuxer->priv;
@@ -220,7 +383,20 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
     } else {
         newpos = MPMIN(floor(newpos), mf->nr_of_files - 1);
     }
+
+    if (!mf->pool) {
+        mf->curr_frame = MPCLAMP((int)newpos, 0, mf->nr_of_files);
+        return;
+    }
+
+    pthread_mutex_lock(&mf->lock);
     mf->curr_frame = MPCLAMP((int)newpos, 0, mf->nr_of_files);
+    // Keep frames which are still useful (e.g. small forward seeks), and
+    // start reading at the seek target right away.
+    while (mf->num_window && mf->window[0]->frame != mf->curr_frame)
+        drop_window_head(mf);
+    fill_window(mf);
+    pthread_mutex_unlock(&mf->lock);
 }
 
 static bool demux_mf_read_packet(struct demuxer *demuxer,
@@ -229,44 +405,32 @@ static bool demux_mf_read_packet(struct demuxer *demuxer,
     mf_t *mf = demuxer->priv;
     if (mf->curr_frame >= mf->nr_of_files)
         return false;
-    bool ok = false;
 
-    struct stream *entry_stream = NULL;
-    if (mf->streams)
-        entry_stream = mf->streams[mf->curr_frame];
-    struct stream *stream = entry_stream;
-    if (!stream) {
-        char *filename = mf->names[mf->curr_frame];
-        if (filename) {
-            stream = stream_create(filename, demuxer->stream_origin | STREAM_READ,
-                                   demuxer->cancel, demuxer->global);
-        }
-    }
-
-    if (stream) {
-        stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                dp->stream = mf->sh->index;
-                *pkt = dp;
-                ok = true;
-            }
-        }
-        talloc_free(data.start);
+    struct demux_packet *dp = NULL;
+    if (mf->pool) {
+        pthread_mutex_lock(&mf->lock);
+        fill_window(mf);
+        // If all read slots are taken by abandoned jobs, the window can be
+        // empty; the workers refill it as soon as they finish.
+        while (!mf->num_window || !mf->window[0]->done)
+            pthread_cond_wait(&mf->wakeup, &mf->lock);
+        assert(mf->window[0]->frame == mf->curr_frame);
+        dp = mf->window[0]->pkt;
+        mf->window[0]->pkt = NULL;
+        drop_window_head(mf);
+        mf->curr_frame++;
+        fill_window(mf);
+        pthread_mutex_unlock(&mf->lock);
+    } else {
+        dp = read_frame(mf, mf->curr_frame);
+        mf->curr_frame++;
     }
 
-    if (stream && stream != entry_stream)
-        free_stream(stream);
-
-    mf->curr_frame++;
-
-    if (!ok)
+    if (dp) {
+        *pkt = dp;
+    } else {
         MP_ERR(demuxer, "error reading image file\n");
+    }
 
     return true;
 }
@@ -367,8 +531,13 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch, mf_mmap;
     mp_read_option_raw(demuxer->global, "mf-fps", &m_option_type_double, &mf_fps);
     mp_read_option_raw(demuxer->global, "mf-type", &m_option_type_string, &mf_type);
+    mp_read_option_raw(demuxer->global, "mf-prefetch", &m_option_type_int,
+                       &mf_prefetch);
+    mp_read_option_raw(demuxer->global, "mf-mmap", &m_option_type_flag,
+                       &mf_mmap);
 
     const char *codec = mp_map_mimetype_to_video_codec(demuxer->stream->mime_type);
     if (!codec || (mf_type && mf_type[0]))
@@ -396,10 +565,24 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demux_add_sh_stream(demuxer, sh);
 
     mf->sh = sh;
+    mf->demuxer = demuxer;
+    mf->use_mmap = mf_mmap;
     demuxer->priv = (void *)mf;
     demuxer->seekable = true;
     demuxer->duration = mf->nr_of_files / mf->sh->codec->fps;
 
+    if (!mf->streams && mf->nr_of_files > 1 && mf_prefetch > 0) {
+        pthread_mutex_init(&mf->lock, NULL);
+        pthread_cond_init(&mf->wakeup, NULL);
+        mf->prefetch = mf_prefetch;
+        mf->pool = mp_thread_pool_create(mf, 1, 1, mf_prefetch);
+        if (!mf->pool) {
+            MP_WARN(demuxer, "could not create prefetch threads\n");
+            pthread_cond_destroy(&mf->wakeup);
+            pthread_mutex_destroy(&mf->lock);
+        }
+    }
+
     return 0;
 
 error:
@@ -408,6 +591,21 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (!mf || !mf->pool)
+        return;
+
+    pthread_mutex_lock(&mf->lock);
+    mf->prefetch = 0; // stop fill_window() in the workers
+    while (mf->num_window)
+        drop_window_head(mf);
+    while (mf->num_running)
+        pthread_cond_wait(&mf->wakeup, &mf->lock);
+    pthread_mutex_unlock(&mf->lock);
+
+    TA_FREEP(&mf->pool);
+    pthread_cond_destroy(&mf->wakeup);
+    pthread_mutex_destroy(&mf->lock);
 }
 
 const demuxer_desc_t demuxer_desc_mf = {
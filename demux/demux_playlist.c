@@ -15,27 +15,38 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include <libavutil/common.h>
 
 #include "config.h"
 #include "common/common.h"
-#include "options/options.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "common/msg.h"
 #include "common/playlist.h"
 #include "misc/thread_tools.h"
 #include "options/path.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "misc/natural_sort.h"
 #include "demux.h"
 
 #define PROBE_SIZE (8 * 1024)
 
+struct demux_playlist_opts {
+    int stream_batch;
+};
+
+#define OPT_BASE_STRUCT struct demux_playlist_opts
+
 static bool check_mimetype(struct stream *s, const char *const *list)
 {
     if (s->mime_type) {
@@ -60,6 +71,18 @@ struct pl_parser {
     enum demux_check check_level;
     struct stream *real_stream;
     char *format;
+
+    // Streaming mode: parse() runs on a separate thread, and new entries are
+    // appended to pl (under lock), from where the user fetches them.
+    bool streaming;
+    int stream_batch;
+    const struct pl_format *fmt;
+    struct demuxer *demuxer;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool thread_done;       // parse() returned (protected by lock)
+    bool thread_ok;         // parse() result (protected by lock)
 };
 
 
@@ -149,16 +172,43 @@ static bstr pl_get_line(struct pl_parser *p)
     return bstr0(pl_get_line0(p));
 }
 
+// Terminate a bstr that points into p->buffer (as returned by pl_get_line())
+// in place, so that it can be used as C string without copying it.
+static char *pl_line0(struct pl_parser *p, bstr line)
+{
+    char *s = (char *)line.start;
+    assert(s >= p->buffer && s + line.len < p->buffer + sizeof(p->buffer));
+    s[line.len] = '\0';
+    return s;
+}
+
+static void pl_add_entry(struct pl_parser *p, struct playlist_entry *e)
+{
+    if (!p->streaming) {
+        playlist_add(p->pl, e);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    playlist_add(p->pl, e);
+    // Wake up the user once per batch, not for every entry.
+    bool notify = p->pl->num_entries == p->stream_batch;
+    if (notify)
+        pthread_cond_signal(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    if (notify)
+        demux_wakeup(p->demuxer);
+}
+
 static void pl_add(struct pl_parser *p, bstr entry)
 {
-    char *s = bstrto0(NULL, entry);
-    playlist_add_file(p->pl, s);
-    talloc_free(s);
+    pl_add_entry(p, playlist_entry_new(pl_line0(p, entry)));
 }
 
 static bool pl_eof(struct pl_parser *p)
 {
-    return p->error || p->s->eof;
+    return p->error || p->s->eof || mp_cancel_test(p->s->cancel);
 }
 
 static bool maybe_text(bstr d)
@@ -207,12 +257,10 @@ ok:
         } else if (bstr_startswith0(line, "#EXT-X-")) {
             p->format = "hls";
         } else if (line.len > 0 && !bstr_startswith0(line, "#")) {
-            char *fn = bstrto0(NULL, line);
-            struct playlist_entry *e = playlist_entry_new(fn);
-            talloc_free(fn);
+            struct playlist_entry *e = playlist_entry_new(pl_line0(p, line));
             e->title = talloc_steal(e, title);
             title = NULL;
-            playlist_add(p->pl, e);
+            pl_add_entry(p, e);
         }
         line = bstr_strip(pl_get_line(p));
     }
@@ -237,7 +285,9 @@ static int parse_ref_init(struct pl_parser *p)
     bstr burl = bstr0(p->s->url);
     if (bstr_eatstart0(&burl, "http://") && check_mimetype(p->s, mmsh_types)) {
         MP_INFO(p, "Redirecting to mmsh://\n");
-        playlist_add_file(p->pl, talloc_asprintf(p, "mmsh://%.*s", BSTR_P(burl)));
+        char *url = talloc_asprintf(NULL, "mmsh://%.*s", BSTR_P(burl));
+        pl_add_entry(p, playlist_entry_new(url));
+        talloc_free(url);
         return 0;
     }
 
@@ -382,7 +432,7 @@ static int parse_dir(struct pl_parser *p)
         qsort(files, num_files, sizeof(files[0]), cmp_filename);
 
     for (int n = 0; n < num_files; n++)
-        playlist_add_file(p->pl, files[n]);
+        pl_add_entry(p, playlist_entry_new(files[n]));
 
     p->add_base = false;
 
@@ -426,6 +476,110 @@ static const struct pl_format *probe_pl(struct pl_parser *p)
     return NULL;
 }
 
+static void *parse_thread(void *arg)
+{
+    struct pl_parser *p = arg;
+    mpthread_set_name("playlist");
+
+    bool ok = p->fmt->parse(p) >= 0 && !p->error;
+
+    pthread_mutex_lock(&p->lock);
+    p->thread_done = true;
+    p->thread_ok = ok;
+    pthread_cond_signal(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    demux_wakeup(p->demuxer);
+    return NULL;
+}
+
+static void stop_parse_thread(struct pl_parser *p)
+{
+    pthread_join(p->thread, NULL);
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    p->streaming = false;
+}
+
+// Run fmt->parse() on a separate thread, and wait until the first stream_batch
+// entries were read (then p->pl contains them). If the parser finishes before
+// that, the thread is stopped, the stream is returned to the demuxer, and the
+// parse result is returned (as if parse() was called directly). Otherwise
+// return 1; the remaining entries are read in the background.
+static int parse_streaming(struct demuxer *demuxer, struct pl_parser *p,
+                           const struct pl_format *fmt)
+{
+    struct stream *s = demux_detach_stream(demuxer);
+    if (!s)
+        return fmt->parse(p);
+
+    p->fmt = fmt;
+    p->demuxer = demuxer;
+    p->streaming = true;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    if (pthread_create(&p->thread, NULL, parse_thread, p)) {
+        pthread_cond_destroy(&p->wakeup);
+        pthread_mutex_destroy(&p->lock);
+        p->streaming = false;
+        demux_reattach_stream(demuxer, s);
+        return fmt->parse(p);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->thread_done && p->pl->num_entries < p->stream_batch)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    bool done = p->thread_done;
+    bool ok = p->thread_ok;
+    pthread_mutex_unlock(&p->lock);
+
+    if (done) {
+        stop_parse_thread(p);
+        demux_reattach_stream(demuxer, s);
+        return ok ? 0 : -1;
+    }
+
+    return 1;
+}
+
+static void close_file(struct demuxer *demuxer)
+{
+    struct pl_parser *p = demuxer->priv;
+    if (!p)
+        return;
+
+    // Abort reading if the parser is still running.
+    mp_cancel_trigger(demuxer->cancel);
+    stop_parse_thread(p);
+    free_stream(p->s);
+    talloc_free(p);
+}
+
+// Move the entries that were read in the background since the last call to pl.
+// Returns false if the playlist was read completely (pl receives the last
+// entries), after which this must not be called anymore.
+bool demux_playlist_read_more(struct demuxer *demuxer, struct playlist *pl)
+{
+    if (!demuxer->playlist_partial)
+        return false;
+
+    struct pl_parser *p = demuxer->priv;
+    pthread_mutex_lock(&p->lock);
+    playlist_append_entries(pl, p->pl);
+    bool done = p->thread_done;
+    if (done && !p->thread_ok)
+        MP_WARN(demuxer, "Error while reading playlist.\n");
+    pthread_mutex_unlock(&p->lock);
+
+    playlist_add_base_path(pl, mp_dirname(demuxer->filename));
+    playlist_set_stream_flags(pl, demuxer->stream_origin);
+
+    if (done)
+        demuxer->playlist_partial = false;
+    return !done;
+}
+
 static int open_file(struct demuxer *demuxer, enum demux_check check)
 {
     if (!demuxer->access_references)
@@ -439,6 +593,10 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->real_stream = demuxer->stream;
     p->add_base = true;
 
+    struct demux_playlist_opts *opts =
+        mp_get_config_group(p, demuxer->global, demuxer->desc->options);
+    p->stream_batch = opts->stream_batch;
+
     char probe[PROBE_SIZE];
     int probe_len = stream_read_peek(p->real_stream, probe, sizeof(probe));
     p->s = stream_memory_open(demuxer->global, probe, probe_len);
@@ -459,13 +617,40 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     p->error = false;
     p->s = demuxer->stream;
     p->utf16 = stream_skip_bom(p->s);
-    bool ok = fmt->parse(p) >= 0 && !p->error;
-    if (p->add_base)
-        playlist_add_base_path(p->pl, mp_dirname(demuxer->filename));
-    playlist_set_stream_flags(p->pl, demuxer->stream_origin);
-    demuxer->playlist = talloc_steal(demuxer, p->pl);
+
+    // Only the player itself consumes entries incrementally. Directories are
+    // sorted, so they need to be scanned completely anyway.
+    int r;
+    if (p->stream_batch > 0 && fmt->parse != parse_dir &&
+        demuxer->params && demuxer->params->is_top_level)
+    {
+        r = parse_streaming(demuxer, p, fmt);
+    } else {
+        r = fmt->parse(p);
+    }
+
+    struct playlist *pl = talloc_zero(demuxer, struct playlist);
+    if (p->streaming)
+        pthread_mutex_lock(&p->lock);
+    bool ok = p->streaming || (r >= 0 && !p->error);
+    playlist_append_entries(pl, p->pl);
     demuxer->filetype = p->format ? p->format : fmt->name;
+    if (p->streaming)
+        pthread_mutex_unlock(&p->lock);
+
+    if (p->add_base)
+        playlist_add_base_path(pl, mp_dirname(demuxer->filename));
+    playlist_set_stream_flags(pl, demuxer->stream_origin);
+    demuxer->playlist = pl;
     demuxer->fully_read = true;
+
+    if (p->streaming) {
+        MP_VERBOSE(demuxer, "Reading further playlist entries in background.\n");
+        demuxer->playlist_partial = true;
+        demuxer->priv = p;
+        return 0;
+    }
+
     talloc_free(p);
     if (ok)
         demux_close_stream(demuxer);
@@ -476,4 +661,13 @@ const struct demuxer_desc demuxer_desc_playlist = {
     .name = "playlist",
     .desc = "Playlist file",
     .open = open_file,
+    .close = close_file,
+    .options = &(const struct m_sub_options){
+        .opts = (const struct m_option[]) {
+            {"playlist-stream-batch", OPT_INT(stream_batch),
+                M_RANGE(0, INT_MAX)},
+            {0}
+        },
+        .size = sizeof(OPT_BASE_STRUCT),
+    },
 };
@@ -0,0 +1,68 @@
+#include <string.h>
+
+#include "common/common.h"
+#include "mpv_talloc.h"
+
+#include "dump_queue.h"
+#include "packet.h"
+
+static size_t item_size(struct dump_item *item)
+{
+    // Items with cache_pos have no data, but this still covers the overhead.
+    return item->pkt ? demux_packet_estimate_total_size(item->pkt) : 0;
+}
+
+static void destroy_queue(void *p)
+{
+    dump_queue_clear(p);
+}
+
+struct dump_queue *dump_queue_create(void *ta_parent, int64_t max_bytes)
+{
+    struct dump_queue *q = talloc_zero(ta_parent, struct dump_queue);
+    q->max_bytes = max_bytes;
+    ta_set_destructor(q, destroy_queue);
+    return q;
+}
+
+void dump_queue_push(struct dump_queue *q, struct dump_item item)
+{
+    MP_TARRAY_APPEND(q, q->items, q->num, item);
+    q->bytes += item_size(&item);
+}
+
+bool dump_queue_pop(struct dump_queue *q, struct dump_item *item)
+{
+    if (q->pos == q->num) {
+        q->pos = q->num = 0;
+        return false;
+    }
+    *item = q->items[q->pos++];
+    q->bytes -= item_size(item);
+    // Don't let the array grow forever if the queue never runs empty.
+    if (q->pos >= 64 && q->pos * 2 >= q->num) {
+        memmove(q->items, q->items + q->pos,
+                (q->num - q->pos) * sizeof(q->items[0]));
+        q->num -= q->pos;
+        q->pos = 0;
+    }
+    return true;
+}
+
+int dump_queue_count(struct dump_queue *q)
+{
+    return q->num - q->pos;
+}
+
+bool dump_queue_is_full(struct dump_queue *q)
+{
+    return q->max_bytes && q->bytes >= q->max_bytes;
+}
+
+void dump_queue_clear(struct dump_queue *q)
+{
+    for (int n = q->pos; n < q->num; n++)
+        talloc_free(q->items[n].pkt);
+    q->pos = q->num = 0;
+    q->bytes = 0;
+}
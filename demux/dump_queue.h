@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct demux_packet;
+struct sh_stream;
+
+// One entry of the cache dumper's write queue.
+struct dump_item {
+    struct sh_stream *sh;
+    struct demux_packet *pkt;   // NULL: discontinuity marker
+    int64_t cache_pos;          // if >= 0, pkt has no data; read it from here
+};
+
+// FIFO of dump items, which keeps track of the memory used by the queued
+// packets. Not thread-safe.
+struct dump_queue {
+    int64_t bytes;              // estimated size of all queued packets
+    int64_t max_bytes;          // 0 for unlimited
+    // --- private
+    struct dump_item *items;
+    int pos;                    // index of next item to pop
+    int num;
+};
+
+// Free the queue with talloc_free(); this frees all queued packets as well.
+struct dump_queue *dump_queue_create(void *ta_parent, int64_t max_bytes);
+
+// Append item, which transfers ownership of item.pkt to the queue. This
+// always succeeds, even if the queue is full.
+void dump_queue_push(struct dump_queue *q, struct dump_item item);
+
+// Remove the oldest item, and pass ownership of it to the caller. Returns
+// false if the queue is empty.
+bool dump_queue_pop(struct dump_queue *q, struct dump_item *item);
+
+// Number of items in the queue.
+int dump_queue_count(struct dump_queue *q);
+
+// Whether the queued packets reach max_bytes.
+bool dump_queue_is_full(struct dump_queue *q);
+
+// Free all queued packets.
+void dump_queue_clear(struct dump_queue *q);
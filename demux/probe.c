@@ -0,0 +1,209 @@
+#include <limits.h>
+
+#include "audio/chmap.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/tags.h"
+#include "misc/node.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "stream/stream.h"
+
+#include "demux.h"
+#include "probe.h"
+#include "stheader.h"
+
+struct demux_probe_opts {
+    int threads;
+    int64_t max_bytes;
+};
+
+#define OPT_BASE_STRUCT struct demux_probe_opts
+
+const struct m_sub_options demux_probe_conf = {
+    .opts = (const struct m_option[]){
+        {"demuxer-probe-threads", OPT_INT(threads), M_RANGE(1, 64)},
+        {"demuxer-probe-max-bytes", OPT_BYTE_SIZE(max_bytes),
+            M_RANGE(0, INT_MAX)},
+        {0}
+    },
+    .size = sizeof(struct demux_probe_opts),
+    .defaults = &(const struct demux_probe_opts){
+        // Mostly waiting for I/O, so this is not tied to the CPU count.
+        .threads = 8,
+        .max_bytes = 1024 * 1024,
+    },
+};
+
+struct probe_job {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    const char *url;
+    int max_bytes;
+    bool rebase;
+    struct mpv_node node; // result (map)
+};
+
+static void add_tags(struct mpv_node *dst, const char *key, struct mp_tags *tags)
+{
+    struct mpv_node *map = node_map_add(dst, key, MPV_FORMAT_NODE_MAP);
+    for (int n = 0; tags && n < tags->num_keys; n++)
+        node_map_add_string(map, tags->keys[n], tags->values[n]);
+}
+
+// Field names are the same as in the track-list property.
+static void add_track(struct mpv_node *dst, struct sh_stream *sh, int id)
+{
+    struct mp_codec_params *p = sh->codec;
+    struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+
+    node_map_add_int64(e, "id", id);
+    node_map_add_string(e, "type", stream_type_name(sh->type));
+    if (sh->demuxer_id != -1)
+        node_map_add_int64(e, "src-id", sh->demuxer_id);
+    if (sh->title)
+        node_map_add_string(e, "title", sh->title);
+    if (sh->lang)
+        node_map_add_string(e, "lang", sh->lang);
+    node_map_add_flag(e, "image", sh->image);
+    node_map_add_flag(e, "albumart", !!sh->attached_picture);
+    node_map_add_flag(e, "default", sh->default_track);
+    node_map_add_flag(e, "forced", sh->forced_track);
+    node_map_add_flag(e, "dependent", sh->dependent_track);
+    node_map_add_flag(e, "visual-impaired", sh->visual_impaired_track);
+    node_map_add_flag(e, "hearing-impaired", sh->hearing_impaired_track);
+    node_map_add_int64(e, "ff-index", sh->ff_index);
+    if (p->codec)
+        node_map_add_string(e, "codec", p->codec);
+    if (p->disp_w)
+        node_map_add_int64(e, "demux-w", p->disp_w);
+    if (p->disp_h)
+        node_map_add_int64(e, "demux-h", p->disp_h);
+    if (p->channels.num) {
+        node_map_add_int64(e, "demux-channel-count", p->channels.num);
+        node_map_add_string(e, "demux-channels", mp_chmap_to_str(&p->channels));
+    }
+    if (p->samplerate)
+        node_map_add_int64(e, "demux-samplerate", p->samplerate);
+    if (p->fps > 0)
+        node_map_add_double(e, "demux-fps", p->fps);
+    if (p->bitrate > 0)
+        node_map_add_int64(e, "demux-bitrate", p->bitrate);
+    if (p->rotate > 0)
+        node_map_add_int64(e, "demux-rotation", p->rotate);
+    if (p->par_w > 0 && p->par_h > 0)
+        node_map_add_double(e, "demux-par", p->par_w / (double)p->par_h);
+}
+
+static void fill_node(struct probe_job *job, struct demuxer *demuxer)
+{
+    struct mpv_node *res = &job->node;
+
+    node_map_add_string(res, "file-format", demuxer->filetype ?
+                        demuxer->filetype : demuxer->desc->name);
+    if (demuxer->filesize >= 0)
+        node_map_add_int64(res, "file-size", demuxer->filesize);
+    if (demuxer->duration >= 0)
+        node_map_add_double(res, "duration", demuxer->duration);
+    node_map_add_double(res, "start-time", demuxer->start_time);
+    node_map_add_flag(res, "seekable", demuxer->seekable);
+    add_tags(res, "metadata", demuxer->metadata);
+
+    double offset = job->rebase ? demuxer->start_time : 0;
+    struct mpv_node *chapters =
+        node_map_add(res, "chapters", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < demuxer->num_chapters; n++) {
+        struct demux_chapter *c = &demuxer->chapters[n];
+        struct mpv_node *e = node_array_add(chapters, MPV_FORMAT_NODE_MAP);
+        char *title = mp_tags_get_str(c->metadata, "title");
+        if (title)
+            node_map_add_string(e, "title", title);
+        node_map_add_double(e, "time", c->pts - offset);
+    }
+
+    // Track IDs are assigned per type, as the player does for a single file.
+    int ids[STREAM_TYPE_COUNT] = {0};
+    struct mpv_node *tracks =
+        node_map_add(res, "track-list", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        add_track(tracks, sh, ++ids[sh->type]);
+    }
+}
+
+static void probe_worker(void *p)
+{
+    struct probe_job *job = p;
+
+    node_init(&job->node, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_string(&job->node, "url", job->url);
+
+    if (mp_cancel_test(job->cancel))
+        return;
+
+    struct demuxer_params params = {
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+        .max_probe_bytes = job->max_bytes,
+    };
+    struct demuxer *demuxer =
+        demux_open_url(job->url, &params, job->cancel, job->global);
+    if (!demuxer) {
+        if (!mp_cancel_test(job->cancel))
+            MP_WARN(job, "Failed to open '%s'.\n", job->url);
+        node_map_add_string(&job->node, "error", "loading failed");
+        return;
+    }
+
+    fill_node(job, demuxer);
+    demux_free(demuxer);
+}
+
+bool demux_probe_urls(struct mpv_global *global, struct mp_log *log,
+                      struct mp_cancel *cancel, char **urls, int num_urls,
+                      bool rebase, struct mpv_node *dst)
+{
+    void *tmp = talloc_new(NULL);
+    struct demux_probe_opts *opts =
+        mp_get_config_group(tmp, global, &demux_probe_conf);
+
+    struct probe_job *jobs = talloc_zero_array(tmp, struct probe_job, num_urls);
+    for (int n = 0; n < num_urls; n++) {
+        jobs[n] = (struct probe_job){
+            .global = global,
+            .log = log,
+            .cancel = cancel,
+            .url = urls[n],
+            .max_bytes = opts->max_bytes,
+            .rebase = rebase,
+        };
+    }
+
+    int threads = MPMIN(opts->threads, num_urls);
+    struct mp_thread_pool *pool =
+        threads > 1 ? mp_thread_pool_create(tmp, 1, 1, threads) : NULL;
+    for (int n = 0; n < num_urls; n++) {
+        if (!pool || !mp_thread_pool_queue(pool, probe_worker, &jobs[n]))
+            probe_worker(&jobs[n]);
+    }
+    // Blocks until all queued jobs are done.
+    talloc_free(pool);
+
+    bool ok = !mp_cancel_test(cancel);
+    if (ok) {
+        node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+        for (int n = 0; n < num_urls; n++) {
+            struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NONE);
+            *e = jobs[n].node;
+            talloc_steal(dst->u.list, e->u.list);
+        }
+    } else {
+        for (int n = 0; n < num_urls; n++)
+            talloc_free(jobs[n].node.u.list);
+    }
+
+    talloc_free(tmp);
+    return ok;
+}
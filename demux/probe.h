@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+struct mpv_global;
+struct mp_log;
+struct mp_cancel;
+struct mpv_node;
+
+// Open each of the given URLs with its own demuxer, and return their metadata
+// (format, duration, chapters, tags and tracks) as an array of maps in dst,
+// in the same order as urls[]. No decoders are created, and no packets are
+// read beyond what opening the demuxer requires (which is additionally
+// bounded by --demuxer-probe-max-bytes for libavformat).
+// The URLs are opened concurrently on a temporary thread pool
+// (--demuxer-probe-threads). Files which fail to open get an entry with the
+// "error" field set instead. If rebase is set, chapter times are relative to
+// the start time of the file (like with --rebase-start-time).
+// Returns false (and leaves dst untouched) if cancel was triggered.
+// Blocks until all files are done; can be called from any thread.
+bool demux_probe_urls(struct mpv_global *global, struct mp_log *log,
+                      struct mp_cancel *cancel, char **urls, int num_urls,
+                      bool rebase, struct mpv_node *dst);
@@ -45,6 +45,7 @@
 #include "audio/aframe.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/image_cache.h"
 
 #include "demux/stheader.h"
 
@@ -210,6 +211,7 @@ struct priv {
 
     struct mp_frame decoded_coverart;
     int coverart_returned; // 0: no, 1: coverart frame itself, 2: EOF returned
+    char *coverart_key; // image cache key of the cover art packet, or NULL
 
     int play_dir;
 
@@ -230,6 +232,7 @@ struct priv {
     char *decoder_desc;
     bool try_spdif;
     bool attached_picture;
+    struct mp_image_cache *image_cache;
     bool pts_reset;
     int attempt_framedrops; // try dropping this many frames
     int dropped_frames; // total frames _probably_ dropped
@@ -534,6 +537,15 @@ void mp_decoder_wrapper_set_coverart_flag(struct mp_decoder_wrapper *d, bool c)
     pthread_mutex_unlock(&p->cache_lock);
 }
 
+void mp_decoder_wrapper_set_image_cache(struct mp_decoder_wrapper *d,
+                                        struct mp_image_cache *cache)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    p->image_cache = cache;
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
 bool mp_decoder_wrapper_get_pts_reset(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -842,6 +854,32 @@ static bool is_new_segment(struct priv *p, struct mp_frame frame)
            (p->play_dir < 0 && pkt->back_restart && p->packet_fed);
 }
 
+// Try to get the decoded cover art from the image cache, instead of decoding
+// the packet. Returns true if the packet was consumed.
+static bool load_cached_coverart(struct priv *p, struct mp_image_cache *cache)
+{
+    struct demux_packet *packet = p->packet.data;
+
+    TA_FREEP(&p->coverart_key);
+    if (!cache)
+        return false;
+    p->coverart_key =
+        mp_image_cache_key(p->decf, cache, packet->buffer, packet->len);
+    if (!p->coverart_key)
+        return false;
+
+    struct mp_image *img = mp_image_cache_load(cache, p->coverart_key);
+    if (!img)
+        return false;
+
+    img->pts = packet->pts;
+    img->dts = packet->dts;
+    p->decoded_coverart = MAKE_FRAME(MP_FRAME_VIDEO, img);
+    mp_frame_unref(&p->packet);
+    mp_filter_internal_mark_progress(p->decf);
+    return true;
+}
+
 static void feed_packet(struct priv *p)
 {
     if (!p->decoder || !mp_pin_in_needs_data(p->decoder->f->pins[0]))
@@ -860,6 +898,14 @@ static void feed_packet(struct priv *p)
             mp_filter_internal_mark_failed(p->decf);
             return;
         }
+        if (p->packet.type == MP_FRAME_PACKET) {
+            pthread_mutex_lock(&p->cache_lock);
+            bool coverart = p->attached_picture;
+            struct mp_image_cache *cache = p->image_cache;
+            pthread_mutex_unlock(&p->cache_lock);
+            if (coverart && load_cached_coverart(p, cache))
+                return;
+        }
     }
 
     if (!p->packet.type)
@@ -989,6 +1035,7 @@ static void read_frame(struct priv *p)
     pthread_mutex_lock(&p->cache_lock);
     if (p->attached_picture && frame.type == MP_FRAME_VIDEO)
         p->decoded_coverart = frame;
+    struct mp_image_cache *cache = p->image_cache;
     if (p->attempt_framedrops) {
         int dropped = MPMAX(0, p->packets_without_output - 1);
         p->attempt_framedrops = MPMAX(0, p->attempt_framedrops - dropped);
@@ -997,6 +1044,11 @@ static void read_frame(struct priv *p)
     pthread_mutex_unlock(&p->cache_lock);
 
     if (p->decoded_coverart.type) {
+        // Only takes a reference; the entry is written on a worker thread.
+        if (cache && p->coverart_key) {
+            mp_image_cache_store(cache, p->coverart_key,
+                                 p->decoded_coverart.data);
+        }
         mp_filter_internal_mark_progress(p->decf);
         return;
     }
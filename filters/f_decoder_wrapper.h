@@ -58,6 +58,12 @@ void mp_decoder_wrapper_set_spdif_flag(struct mp_decoder_wrapper *d, bool spdif)
 // Whether to decode only 1 frame and then stop, and cache the frame across resets.
 void mp_decoder_wrapper_set_coverart_flag(struct mp_decoder_wrapper *d, bool c);
 
+// Look up and store the decoded cover art in this cache. The cache must stay
+// alive until the decoder wrapper is destroyed.
+struct mp_image_cache;
+void mp_decoder_wrapper_set_image_cache(struct mp_decoder_wrapper *d,
+                                        struct mp_image_cache *cache);
+
 // True if a pts reset was observed (audio only, heuristic).
 bool mp_decoder_wrapper_get_pts_reset(struct mp_decoder_wrapper *d);
 
@@ -54,6 +54,37 @@
 #include "filter_internal.h"
 #include "user_filters.h"
 
+// Maximum number of remembered input format sets (and prebuilt graphs).
+#define MAX_SPARE_GRAPHS 4
+
+// Filters which do something outside of the graph on init (opening files,
+// binding sockets). Creating extra instances of them is not harmless.
+static const char *const spare_unsafe_filters[] = {
+    "movie", "amovie", "zmq", "azmq", NULL
+};
+
+// Errors while building a spare graph only mean there won't be one.
+#define GRAPH_ERR(c, ...) \
+    MP_MSG(c, (c)->building_spare ? MSGL_V : MSGL_FATAL, __VA_ARGS__)
+
+// Per-pad graph state (see struct lavfi_pad).
+struct spare_pad {
+    AVFilterContext *filter;
+    int filter_pad;
+    AVFilterContext *buffer;
+    AVRational timebase;
+};
+
+// A set of input formats the graph was used with. If graph is set, it's a
+// fully configured graph for these formats, which never received any input.
+// It can be used instead of creating and configuring a new graph when the
+// same formats are seen again (format changes, seeking).
+struct spare_graph {
+    struct mp_frame *in_fmts;   // [num_in_pads]
+    AVFilterGraph *graph;       // NULL if not built yet
+    struct spare_pad *pads;     // [num_all_pads]
+};
+
 struct lavfi {
     struct mp_log *log;
     struct mp_filter *f;
@@ -92,6 +123,13 @@ struct lavfi {
 
     AVFrame *tmp_frame;
 
+    // Recently used input formats, most recently used first. Only used if
+    // use_spares is set.
+    bool use_spares;
+    bool building_spare;
+    struct spare_graph **spares;
+    int num_spares;
+
     // Audio timestamp emulation.
     bool emulate_audio_pts;
     double in_pts;      // last input timestamps
@@ -270,8 +308,8 @@ static void precreate_graph(struct lavfi *c, bool first_init)
         AVFilterContext *filter = avfilter_graph_alloc_filter(c->graph,
                             avfilter_get_by_name(c->graph_string), "filter");
         if (!filter) {
-            MP_FATAL(c, "filter '%s' not found or failed to allocate\n",
-                     c->graph_string);
+            GRAPH_ERR(c, "filter '%s' not found or failed to allocate\n",
+                      c->graph_string);
             goto error;
         }
 
@@ -280,7 +318,7 @@ static void precreate_graph(struct lavfi *c, bool first_init)
             goto error;
 
         if (avfilter_init_str(filter, NULL) < 0) {
-            MP_FATAL(c, "filter failed to initialize\n");
+            GRAPH_ERR(c, "filter failed to initialize\n");
             goto error;
         }
 
@@ -291,7 +329,7 @@ static void precreate_graph(struct lavfi *c, bool first_init)
     } else {
         AVFilterInOut *in = NULL, *out = NULL;
         if (avfilter_graph_parse2(c->graph, c->graph_string, &in, &out) < 0) {
-            MP_FATAL(c, "parsing the filter graph failed\n");
+            GRAPH_ERR(c, "parsing the filter graph failed\n");
             goto error;
         }
         add_pads(c, MP_PIN_IN, in, first_init);
@@ -343,7 +381,7 @@ static bool is_aformat_ok(struct mp_aframe *a, struct mp_aframe *b)
 static bool is_vformat_ok(struct mp_image *a, struct mp_image *b)
 {
     return a->imgfmt == b->imgfmt &&
-           a->w == b->w && a->h && b->h &&
+           a->w == b->w && a->h == b->h &&
            a->params.p_w == b->params.p_w && a->params.p_h == b->params.p_h &&
            a->nominal_fps == b->nominal_fps;
 }
@@ -383,48 +421,15 @@ static void read_pad_input(struct lavfi *c, struct lavfi_pad *pad)
     }
 }
 
-// Attempt to initialize all pads. Return true if all are initialized, or
-// false if more data is needed (or on error).
-static bool init_pads(struct lavfi *c)
+// Determine the input formats of all input pads. Return true if all are
+// known, or false if more data is needed (or on error).
+static bool read_in_formats(struct lavfi *c)
 {
-    if (!c->graph)
-        goto error;
-
-    for (int n = 0; n < c->num_out_pads; n++) {
-        struct lavfi_pad *pad = c->out_pads[n];
-        if (pad->buffer)
-            continue;
-
-        const AVFilter *dst_filter = NULL;
-        if (pad->type == MP_FRAME_AUDIO) {
-            dst_filter = avfilter_get_by_name("abuffersink");
-        } else if (pad->type == MP_FRAME_VIDEO) {
-            dst_filter = avfilter_get_by_name("buffersink");
-        } else {
-            MP_ASSERT_UNREACHABLE();
-        }
-
-        if (!dst_filter)
-            goto error;
-
-        char name[256];
-        snprintf(name, sizeof(name), "mpv_sink_%s", pad->name);
-
-        if (avfilter_graph_create_filter(&pad->buffer, dst_filter,
-                                         name, NULL, NULL, c->graph) < 0)
-            goto error;
-
-        if (avfilter_link(pad->filter, pad->filter_pad, pad->buffer, 0) < 0)
-            goto error;
-    }
-
     for (int n = 0; n < c->num_in_pads; n++) {
         struct lavfi_pad *pad = c->in_pads[n];
-        if (pad->buffer)
+        if (pad->in_fmt.type)
             continue;
 
-        mp_frame_unref(&pad->in_fmt);
-
         read_pad_input(c, pad);
         // no input data, format unknown, can't init, wait longer.
         if (!pad->pending.type)
@@ -463,6 +468,54 @@ static bool init_pads(struct lavfi *c)
 
         if (pad->in_fmt.type != pad->type)
             goto error;
+    }
+
+    return true;
+error:
+    MP_FATAL(c, "could not initialize filter pads\n");
+    c->failed = true;
+    return false;
+}
+
+// Create and link the buffer filters for all pads, using pad->in_fmt for the
+// input pads.
+static bool create_buffers(struct lavfi *c)
+{
+    if (!c->graph)
+        goto error;
+
+    for (int n = 0; n < c->num_out_pads; n++) {
+        struct lavfi_pad *pad = c->out_pads[n];
+        if (pad->buffer)
+            continue;
+
+        const AVFilter *dst_filter = NULL;
+        if (pad->type == MP_FRAME_AUDIO) {
+            dst_filter = avfilter_get_by_name("abuffersink");
+        } else if (pad->type == MP_FRAME_VIDEO) {
+            dst_filter = avfilter_get_by_name("buffersink");
+        } else {
+            MP_ASSERT_UNREACHABLE();
+        }
+
+        if (!dst_filter)
+            goto error;
+
+        char name[256];
+        snprintf(name, sizeof(name), "mpv_sink_%s", pad->name);
+
+        if (avfilter_graph_create_filter(&pad->buffer, dst_filter,
+                                         name, NULL, NULL, c->graph) < 0)
+            goto error;
+
+        if (avfilter_link(pad->filter, pad->filter_pad, pad->buffer, 0) < 0)
+            goto error;
+    }
+
+    for (int n = 0; n < c->num_in_pads; n++) {
+        struct lavfi_pad *pad = c->in_pads[n];
+        if (pad->buffer)
+            continue;
 
         AVBufferSrcParameters *params = av_buffersrc_parameters_alloc();
         if (!params)
@@ -526,7 +579,7 @@ static bool init_pads(struct lavfi *c)
 
     return true;
 error:
-    MP_FATAL(c, "could not initialize filter pads\n");
+    GRAPH_ERR(c, "could not initialize filter pads\n");
     c->failed = true;
     return false;
 }
@@ -540,57 +593,268 @@ static void dump_graph(struct lavfi *c)
     av_free(s);
 }
 
+// Configure the graph created by precreate_graph() for the input formats in
+// pad->in_fmt. On failure, the graph is left in an undefined state.
+static bool configure_graph(struct lavfi *c)
+{
+    if (!create_buffers(c))
+        return false;
+
+    struct mp_stream_info *info = mp_filter_find_stream_info(c->f);
+    if (info && info->hwdec_devs) {
+        struct mp_hwdec_ctx *hwdec_ctx = NULL;
+        if (c->hwdec_interop) {
+            int imgfmt =
+                ra_hwdec_driver_get_imgfmt_for_name(c->hwdec_interop);
+            hwdec_ctx = mp_filter_load_hwdec_device(c->f, imgfmt);
+        } else {
+            hwdec_ctx = hwdec_devices_get_first(info->hwdec_devs);
+        }
+        if (hwdec_ctx && hwdec_ctx->av_device_ref) {
+            MP_VERBOSE(c, "Configuring hwdec_interop=%s for filter graph: %s\n",
+                       hwdec_ctx->driver_name, c->graph_string);
+            for (int n = 0; n < c->graph->nb_filters; n++) {
+                AVFilterContext *filter = c->graph->filters[n];
+                filter->hw_device_ctx =
+                    av_buffer_ref(hwdec_ctx->av_device_ref);
+            }
+        }
+    }
+
+    // And here the actual libavfilter initialization happens.
+    if (avfilter_graph_config(c->graph, NULL) < 0) {
+        GRAPH_ERR(c, "failed to configure the filter graph\n");
+        c->failed = true;
+        return false;
+    }
+
+    // The timebase is available after configuring.
+    for (int n = 0; n < c->num_out_pads; n++) {
+        struct lavfi_pad *pad = c->out_pads[n];
+
+        pad->timebase = pad->buffer->inputs[0]->time_base;
+    }
+
+    return true;
+}
+
+static void save_pads(struct lavfi *c, struct spare_pad *pads)
+{
+    for (int n = 0; n < c->num_all_pads; n++) {
+        struct lavfi_pad *pad = c->all_pads[n];
+        pads[n] = (struct spare_pad){
+            .filter = pad->filter,
+            .filter_pad = pad->filter_pad,
+            .buffer = pad->buffer,
+            .timebase = pad->timebase,
+        };
+    }
+}
+
+static void restore_pads(struct lavfi *c, struct spare_pad *pads)
+{
+    for (int n = 0; n < c->num_all_pads; n++) {
+        struct lavfi_pad *pad = c->all_pads[n];
+        pad->filter = pads[n].filter;
+        pad->filter_pad = pads[n].filter_pad;
+        pad->buffer = pads[n].buffer;
+        pad->timebase = pads[n].timebase;
+    }
+}
+
+// Return a copy of the format of the given frame (without data).
+static struct mp_frame copy_format(struct mp_frame fmt)
+{
+    if (fmt.type == MP_FRAME_VIDEO) {
+        struct mp_image *src = fmt.data;
+        struct mp_image *img = talloc_zero(NULL, struct mp_image);
+        mp_image_setfmt(img, src->imgfmt);
+        mp_image_set_size(img, src->w, src->h);
+        img->params = src->params;
+        img->nominal_fps = src->nominal_fps;
+        return (struct mp_frame){MP_FRAME_VIDEO, img};
+    }
+    if (fmt.type == MP_FRAME_AUDIO) {
+        struct mp_aframe *af = mp_aframe_create();
+        mp_aframe_config_copy(af, fmt.data);
+        return (struct mp_frame){MP_FRAME_AUDIO, af};
+    }
+    return MP_NO_FRAME;
+}
+
+static void free_spare(struct lavfi *c, struct spare_graph *sp)
+{
+    if (!sp)
+        return;
+    avfilter_graph_free(&sp->graph);
+    for (int n = 0; n < c->num_in_pads; n++)
+        mp_frame_unref(&sp->in_fmts[n]);
+    talloc_free(sp);
+}
+
+static void free_spares(struct lavfi *c)
+{
+    for (int n = 0; n < c->num_spares; n++)
+        free_spare(c, c->spares[n]);
+    c->num_spares = 0;
+}
+
+// Return the index of the entry matching the current input formats, -1 if
+// there is none, or -2 if the formats must not be cached.
+static int find_spare(struct lavfi *c)
+{
+    for (int n = 0; n < c->num_in_pads; n++) {
+        struct lavfi_pad *pad = c->in_pads[n];
+        // Hardware frames contexts are tied to the decoder instance.
+        if (pad->in_fmt.type == MP_FRAME_VIDEO &&
+            ((struct mp_image *)pad->in_fmt.data)->hwctx)
+            return -2;
+    }
+
+    for (int i = 0; i < c->num_spares; i++) {
+        struct spare_graph *sp = c->spares[i];
+        bool ok = true;
+        for (int n = 0; n < c->num_in_pads; n++)
+            ok &= is_format_ok(sp->in_fmts[n], c->in_pads[n]->in_fmt);
+        if (ok)
+            return i;
+    }
+
+    return -1;
+}
+
+// Make the entry with the given index the most recently used one. If index
+// is -1, add an entry for the current input formats.
+static void remember_formats(struct lavfi *c, int index)
+{
+    struct spare_graph *sp = NULL;
+    if (index >= 0) {
+        sp = c->spares[index];
+        MP_TARRAY_REMOVE_AT(c->spares, c->num_spares, index);
+    } else {
+        if (c->num_spares >= MAX_SPARE_GRAPHS) {
+            free_spare(c, c->spares[c->num_spares - 1]);
+            c->num_spares--;
+        }
+        sp = talloc_zero(NULL, struct spare_graph);
+        sp->in_fmts = talloc_zero_array(sp, struct mp_frame, c->num_in_pads);
+        for (int n = 0; n < c->num_in_pads; n++)
+            sp->in_fmts[n] = copy_format(c->in_pads[n]->in_fmt);
+        sp->pads = talloc_zero_array(sp, struct spare_pad, c->num_all_pads);
+    }
+    MP_TARRAY_INSERT_AT(c, c->spares, c->num_spares, 0, sp);
+}
+
+// Build a graph for the given entry, while the current graph is running. This
+// temporarily swaps out the state of the current graph.
+static void build_spare(struct lavfi *c, struct spare_graph *sp)
+{
+    assert(!sp->graph);
+
+    AVFilterGraph *graph = c->graph;
+    bool initialized = c->initialized;
+    bool failed = c->failed;
+    double in_pts = c->in_pts;
+    int64_t in_samples = c->in_samples;
+    double delay = c->delay;
+    struct lavfi_pad *pads = talloc_array(NULL, struct lavfi_pad, c->num_all_pads);
+    for (int n = 0; n < c->num_all_pads; n++) {
+        struct lavfi_pad *pad = c->all_pads[n];
+        pads[n] = *pad;
+        pad->filter = NULL;
+        pad->filter_pad = -1;
+        pad->buffer = NULL;
+        pad->in_fmt = MP_NO_FRAME;
+    }
+    for (int n = 0; n < c->num_in_pads; n++)
+        c->in_pads[n]->in_fmt = copy_format(sp->in_fmts[n]);
+
+    c->graph = NULL;
+    c->building_spare = true;
+    precreate_graph(c, false);
+    if (c->graph && configure_graph(c)) {
+        MP_VERBOSE(c, "prebuilt filter graph for a previously used format\n");
+        sp->graph = c->graph;
+        save_pads(c, sp->pads);
+        c->graph = NULL;
+    } else {
+        MP_VERBOSE(c, "could not prebuild filter graph\n");
+    }
+    free_graph(c);
+    c->building_spare = false;
+
+    c->graph = graph;
+    c->initialized = initialized;
+    c->failed = failed;
+    c->in_pts = in_pts;
+    c->in_samples = in_samples;
+    c->delay = delay;
+    for (int n = 0; n < c->num_all_pads; n++)
+        *c->all_pads[n] = pads[n];
+    talloc_free(pads);
+}
+
+// Build at most one missing spare graph. Meant to be called when idle.
+static void build_spares(struct lavfi *c)
+{
+    if (!c->use_spares || !c->initialized || c->draining_recover || c->failed)
+        return;
+
+    for (int n = 0; n < c->num_out_pads; n++) {
+        if (mp_pin_in_needs_data(c->out_pads[n]->pin))
+            return;
+    }
+
+    // The first entry is for the formats of the running graph. Nothing
+    // prebuilt is needed for them unless they become inactive.
+    for (int n = 1; n < c->num_spares; n++) {
+        if (!c->spares[n]->graph) {
+            build_spare(c, c->spares[n]);
+            // Don't try again if it fails.
+            if (!c->spares[n]->graph) {
+                free_spare(c, c->spares[n]);
+                MP_TARRAY_REMOVE_AT(c->spares, c->num_spares, n);
+            }
+            return;
+        }
+    }
+}
+
 // Initialize the graph if all inputs have formats set. If it's already
 // initialized, or can't be initialized yet, do nothing.
 static void init_graph(struct lavfi *c)
 {
     assert(!c->initialized);
 
-    if (!c->graph)
-        precreate_graph(c, false);
-
-    if (init_pads(c)) {
-        struct mp_stream_info *info = mp_filter_find_stream_info(c->f);
-        if (info && info->hwdec_devs) {
-            struct mp_hwdec_ctx *hwdec_ctx = NULL;
-            if (c->hwdec_interop) {
-                int imgfmt =
-                    ra_hwdec_driver_get_imgfmt_for_name(c->hwdec_interop);
-                hwdec_ctx = mp_filter_load_hwdec_device(c->f, imgfmt);
-            } else {
-                hwdec_ctx = hwdec_devices_get_first(info->hwdec_devs);
-            }
-            if (hwdec_ctx && hwdec_ctx->av_device_ref) {
-                MP_VERBOSE(c, "Configuring hwdec_interop=%s for filter graph: %s\n",
-                           hwdec_ctx->driver_name, c->graph_string);
-                for (int n = 0; n < c->graph->nb_filters; n++) {
-                    AVFilterContext *filter = c->graph->filters[n];
-                    filter->hw_device_ctx =
-                        av_buffer_ref(hwdec_ctx->av_device_ref);
-                }
-            }
-        }
+    if (!read_in_formats(c))
+        return;
+
+    int index = find_spare(c);
+    struct spare_graph *sp = index >= 0 ? c->spares[index] : NULL;
+    if (sp && sp->graph) {
+        MP_VERBOSE(c, "reusing prebuilt filter graph\n");
+        avfilter_graph_free(&c->graph);
+        c->graph = sp->graph;
+        sp->graph = NULL;
+        restore_pads(c, sp->pads);
+    } else {
+        if (!c->graph)
+            precreate_graph(c, false);
 
-        // And here the actual libavfilter initialization happens.
-        if (avfilter_graph_config(c->graph, NULL) < 0) {
-            MP_FATAL(c, "failed to configure the filter graph\n");
+        if (!c->graph || !configure_graph(c)) {
             free_graph(c);
             c->failed = true;
             return;
         }
 
-        // The timebase is available after configuring.
-        for (int n = 0; n < c->num_out_pads; n++) {
-            struct lavfi_pad *pad = c->out_pads[n];
-
-            pad->timebase = pad->buffer->inputs[0]->time_base;
-        }
-
-        c->initialized = true;
-
         if (!c->direct_filter) // (output uninteresting for direct filters)
             dump_graph(c);
     }
+
+    if (c->use_spares && index != -2)
+        remember_formats(c, index);
+
+    c->initialized = true;
 }
 
 static bool feed_input_pads(struct lavfi *c)
@@ -631,18 +895,21 @@ static bool feed_input_pads(struct lavfi *c)
             }
         }
 
-        AVFrame *frame = mp_frame_to_av(pad->pending, &pad->timebase);
         bool eof = pad->pending.type == MP_FRAME_EOF;
+        bool emulate_pts =
+            c->emulate_audio_pts && pad->pending.type == MP_FRAME_AUDIO;
 
-        if (c->emulate_audio_pts && pad->pending.type == MP_FRAME_AUDIO) {
-            struct mp_aframe *aframe = pad->pending.data;
-            c->in_pts = mp_aframe_end_pts(aframe);
+        if (emulate_pts)
+            c->in_pts = mp_aframe_end_pts(pad->pending.data);
+
+        // (Moves the buffer references, no data is copied.)
+        AVFrame *frame = mp_frame_to_av_and_unref(&pad->pending, &pad->timebase);
+
+        if (emulate_pts && frame) {
             frame->pts = c->in_samples; // timebase is 1/sample_rate
             c->in_samples += frame->nb_samples;
         }
 
-        mp_frame_unref(&pad->pending);
-
         if (!frame && !eof) {
             MP_FATAL(c, "out of memory or unsupported format\n");
             continue;
@@ -784,6 +1051,9 @@ static void lavfi_process(struct mp_filter *f)
         }
     }
 
+    // Prepare graphs for recently used formats while there's nothing to do.
+    build_spares(c);
+
     if (c->failed)
         mp_filter_internal_mark_failed(c->f);
 }
@@ -803,6 +1073,7 @@ static void lavfi_destroy(struct mp_filter *f)
     struct lavfi *c = f->priv;
 
     lavfi_reset(f);
+    free_spares(c);
     av_frame_free(&c->tmp_frame);
 }
 
@@ -858,6 +1129,22 @@ static struct lavfi *lavfi_alloc(struct mp_filter *parent)
     return c;
 }
 
+// Whether it's OK to create additional instances of the graph.
+static bool graph_allows_spares(struct lavfi *c)
+{
+    for (int n = 0; n < c->graph->nb_filters; n++) {
+        const char *name = c->graph->filters[n]->filter->name;
+        for (int i = 0; spare_unsafe_filters[i]; i++) {
+            if (strcmp(name, spare_unsafe_filters[i]) == 0) {
+                MP_VERBOSE(c, "not prebuilding graphs because of filter '%s'\n",
+                           name);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 static struct mp_lavfi *do_init(struct lavfi *c)
 {
     precreate_graph(c, true);
@@ -949,6 +1236,7 @@ struct lavfi_user_opts {
     char **filter_opts;
 
     int fix_pts;
+    int spare_graphs;
 
     char *hwdec_interop;
 };
@@ -968,6 +1256,7 @@ static struct mp_filter *lavfi_create(struct mp_filter *parent, void *options)
     if (l) {
         struct lavfi *c = l->f->priv;
         c->emulate_audio_pts = opts->fix_pts;
+        c->use_spares = opts->spare_graphs && graph_allows_spares(c);
     }
     talloc_free(opts);
     return l ? l->f : NULL;
@@ -1123,6 +1412,7 @@ const struct mp_user_filter_entry af_lavfi = {
             {"graph", OPT_STRING(graph)},
             {"fix-pts", OPT_FLAG(fix_pts)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"spare-graphs", OPT_FLAG(spare_graphs)},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
@@ -1145,6 +1435,7 @@ const struct mp_user_filter_entry af_lavfi_bridge = {
             {"name", OPT_STRING(filter_name)},
             {"opts", OPT_KEYVALUELIST(filter_opts)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"spare-graphs", OPT_FLAG(spare_graphs)},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
@@ -1167,6 +1458,7 @@ const struct mp_user_filter_entry vf_lavfi = {
         .options = (const m_option_t[]){
             {"graph", OPT_STRING(graph)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"spare-graphs", OPT_FLAG(spare_graphs)},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
@@ -1189,6 +1481,7 @@ const struct mp_user_filter_entry vf_lavfi_bridge = {
             {"name", OPT_STRING(filter_name)},
             {"opts", OPT_KEYVALUELIST(filter_opts)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"spare-graphs", OPT_FLAG(spare_graphs)},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
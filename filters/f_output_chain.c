@@ -3,6 +3,7 @@
 #include "common/global.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "video/out/vo.h"
 
 #include "filter_internal.h"
@@ -11,6 +12,7 @@
 #include "f_auto_filters.h"
 #include "f_lavfi.h"
 #include "f_output_chain.h"
+#include "f_threaded.h"
 #include "f_utils.h"
 #include "user_filters.h"
 
@@ -25,6 +27,8 @@ struct chain {
 
     struct mp_stream_info stream_info;
 
+    struct m_config_cache *opt_cache;
+
     struct mp_user_filter **pre_filters;
     int num_pre_filters;
     struct mp_user_filter **post_filters;
@@ -507,11 +511,25 @@ double mp_output_get_measured_total_delay(struct mp_output_chain *c)
     return delay;
 }
 
+static struct mp_filter *create_user_filter(struct mp_filter *parent, void *ctx)
+{
+    struct mp_user_filter *u = ctx;
+    struct m_obj_settings *entry = &u->args[0];
+
+    return mp_create_user_filter(parent, u->p->type, entry->name,
+                                 entry->attribs);
+}
+
 bool mp_output_chain_update_filters(struct mp_output_chain *c,
                                     struct m_obj_settings *list)
 {
     struct chain *p = c->f->priv;
 
+    m_config_cache_update(p->opt_cache);
+    struct filter_opts *opts = p->opt_cache->opts;
+    int pipeline = p->type == MP_OUTPUT_CHAIN_VIDEO ? opts->vf_pipeline
+                                                    : opts->af_pipeline;
+
     struct mp_user_filter **add = NULL;      // new filters
     int num_add = 0;
     struct mp_user_filter **res = NULL;      // new final list
@@ -539,18 +557,23 @@ bool mp_output_chain_update_filters(struct mp_output_chain *c,
             u = create_wrapper_filter(p);
             u->name = talloc_strdup(u, entry->name);
             u->label = talloc_strdup(u, entry->label);
-            u->f = mp_create_user_filter(u->wrapper, p->type, entry->name,
-                                         entry->attribs);
-            if (!u->f) {
-                talloc_free(u->wrapper);
-                goto error;
-            }
 
             struct m_obj_settings *args = (struct m_obj_settings[2]){*entry, {0}};
 
             struct m_option dummy = {.type = &m_option_type_obj_settings_list};
             m_option_copy(&dummy, &u->args, &args);
 
+            if (pipeline) {
+                u->f = mp_threaded_filter_create(u->wrapper, create_user_filter,
+                                                 u, pipeline);
+            } else {
+                u->f = create_user_filter(u->wrapper, u);
+            }
+            if (!u->f) {
+                talloc_free(u->wrapper);
+                goto error;
+            }
+
             MP_TARRAY_APPEND(NULL, add, num_add, u);
         }
 
@@ -669,6 +692,7 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     p->f = f;
     p->log = f->log;
     p->type = type;
+    p->opt_cache = m_config_cache_alloc(p, f->global, &filter_conf);
 
     struct mp_output_chain *c = &p->public;
     c->f = f;
@@ -0,0 +1,227 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "misc/dispatch.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+
+#include "f_async_queue.h"
+#include "f_threaded.h"
+#include "filter_internal.h"
+
+struct priv {
+    struct mp_filter *public;
+
+    // --- Owned by the filter thread (use thread_lock() to access them from
+    //     the user thread).
+    struct mp_filter *root;
+    struct mp_filter *inner;
+    bool request_terminate;
+
+    struct mp_stream_info stream_info;
+    struct mp_async_queue *q_in, *q_out;
+    struct mp_dispatch_queue *dispatch;
+    pthread_t thread;
+    bool thread_valid;
+
+    // --- Written by the filter thread, read by the user thread.
+    atomic_bool inner_failed;
+    atomic_int inner_active; // -1: unknown, 0/1: IS_ACTIVE command result
+};
+
+static void thread_lock(struct priv *p)
+{
+    mp_dispatch_lock(p->dispatch);
+}
+
+static void thread_unlock(struct priv *p)
+{
+    mp_dispatch_unlock(p->dispatch);
+}
+
+// Update state which the user thread needs to see. Runs on the filter thread.
+static void update_cached_values(struct priv *p)
+{
+    if (mp_filter_has_failed(p->inner)) {
+        atomic_store(&p->inner_failed, true);
+        mp_filter_wakeup(p->public);
+    }
+
+    struct mp_filter_command cmd = {.type = MP_FILTER_COMMAND_IS_ACTIVE};
+    int active = mp_filter_command(p->inner, &cmd) ? cmd.is_active : -1;
+    atomic_store(&p->inner_active, active);
+}
+
+static void *filter_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mpthread_set_name("filter");
+
+    while (!p->request_terminate) {
+        mp_filter_graph_run(p->root);
+        update_cached_values(p);
+        mp_dispatch_queue_process(p->dispatch, INFINITY);
+    }
+
+    return NULL;
+}
+
+static void wakeup_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mp_dispatch_interrupt(p->dispatch);
+}
+
+static void onlock_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mp_filter_graph_interrupt(p->root);
+}
+
+static void public_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    // Actual data flow is done by the async queue filters.
+    if (atomic_exchange(&p->inner_failed, false))
+        mp_filter_internal_mark_failed(f);
+}
+
+static void public_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    mp_async_queue_reset(p->q_in);
+    mp_async_queue_reset(p->q_out);
+    thread_lock(p);
+    mp_filter_reset(p->root);
+    atomic_store(&p->inner_failed, false);
+    mp_dispatch_interrupt(p->dispatch);
+    thread_unlock(p);
+    mp_async_queue_resume(p->q_in);
+    mp_async_queue_resume(p->q_out);
+}
+
+static bool public_command(struct mp_filter *f, struct mp_filter_command *cmd)
+{
+    struct priv *p = f->priv;
+
+    // Queried on every output frame, so avoid stalling the filter thread.
+    if (cmd->type == MP_FILTER_COMMAND_IS_ACTIVE) {
+        int active = atomic_load(&p->inner_active);
+        cmd->is_active = active > 0;
+        return active >= 0;
+    }
+
+    thread_lock(p);
+    bool ok = mp_filter_command(p->inner, cmd);
+    mp_dispatch_interrupt(p->dispatch);
+    thread_unlock(p);
+    return ok;
+}
+
+static void public_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->thread_valid) {
+        thread_lock(p);
+        p->request_terminate = true;
+        mp_dispatch_interrupt(p->dispatch);
+        thread_unlock(p);
+        pthread_join(p->thread, NULL);
+        p->thread_valid = false;
+    }
+
+    mp_filter_free_children(f);
+
+    talloc_free(p->root);
+    talloc_free(p->q_in);
+    talloc_free(p->q_out);
+}
+
+static const struct mp_filter_info threaded_filter = {
+    .name = "threaded",
+    .priv_size = sizeof(struct priv),
+    .process = public_process,
+    .reset = public_reset,
+    .command = public_command,
+    .destroy = public_destroy,
+};
+
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+        struct mp_filter *(*create)(struct mp_filter *root, void *ctx),
+        void *ctx, int queue_frames)
+{
+    struct mp_filter *f = mp_filter_create(parent, &threaded_filter);
+    if (!f)
+        return NULL;
+
+    struct priv *p = f->priv;
+    p->public = f;
+    atomic_store(&p->inner_active, -1);
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    p->q_in = mp_async_queue_create();
+    p->q_out = mp_async_queue_create();
+    struct mp_async_queue_config cfg = {
+        .max_bytes = INT64_MAX,
+        .max_samples = MPMAX(queue_frames, 1),
+    };
+    mp_async_queue_set_config(p->q_in, cfg);
+    mp_async_queue_set_config(p->q_out, cfg);
+
+    p->dispatch = mp_dispatch_create(p);
+    p->root = mp_filter_create_root(f->global);
+    mp_filter_graph_set_wakeup_cb(p->root, wakeup_thread, p);
+    mp_dispatch_set_onlock_fn(p->dispatch, onlock_thread, p);
+
+    struct mp_stream_info *sinfo = mp_filter_find_stream_info(parent);
+    if (sinfo) {
+        p->root->stream_info = &p->stream_info;
+        p->stream_info = (struct mp_stream_info){
+            .hwdec_devs = sinfo->hwdec_devs,
+            .osd = sinfo->osd,
+            .rotate90 = sinfo->rotate90,
+            .dr_vo = sinfo->dr_vo,
+        };
+    }
+
+    p->inner = create(p->root, ctx);
+    if (!p->inner)
+        goto error;
+
+    struct mp_filter *w_in = mp_async_queue_create_filter(f, MP_PIN_IN, p->q_in);
+    struct mp_filter *r_in =
+        mp_async_queue_create_filter(p->root, MP_PIN_OUT, p->q_in);
+    struct mp_filter *w_out =
+        mp_async_queue_create_filter(p->root, MP_PIN_IN, p->q_out);
+    struct mp_filter *r_out =
+        mp_async_queue_create_filter(f, MP_PIN_OUT, p->q_out);
+
+    mp_pin_connect(w_in->pins[0], f->ppins[0]);
+    mp_pin_connect(p->inner->pins[0], r_in->pins[0]);
+    mp_pin_connect(w_out->pins[0], p->inner->pins[1]);
+    mp_pin_connect(f->ppins[1], r_out->pins[0]);
+
+    p->thread_valid = true;
+    if (pthread_create(&p->thread, NULL, filter_thread, p)) {
+        p->thread_valid = false;
+        goto error;
+    }
+
+    public_reset(f);
+
+    return f;
+error:
+    talloc_free(f);
+    return NULL;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "filter.h"
+
+// Create a filter and run it on its own thread, in a separate filter graph.
+// The returned filter is a bidirectional filter (input on pin 0, output on
+// pin 1), which passes frames to the wrapped filter through async queues
+// (see f_async_queue.h). Each queue holds up to queue_frames frames, so
+// consecutive filters created with this function work in a pipelined way:
+// while a filter processes frame N, the next one can process frame N-1. The
+// queues are demand driven, so the wrapped filter doesn't run ahead by more
+// than the queue size.
+//
+// The wrapped filter is created by calling create(root, ctx) on the calling
+// thread, before the filter thread is started. root is the root filter of the
+// separate filter graph. create() must return a bidirectional filter that is
+// a child of root, or NULL on failure (then this function returns NULL too).
+// The stream info of parent (mp_filter_find_stream_info()) is copied to the
+// separate graph, except get_display_fps, which is not thread safe.
+//
+// mp_filter_command() and mp_filter_reset() on the returned filter are
+// forwarded to the wrapped filter; this synchronously waits until the filter
+// thread is idle. MP_FILTER_COMMAND_IS_ACTIVE is answered from a cached value
+// without blocking. If the wrapped filter fails, the returned filter is
+// marked as failed as well.
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+        struct mp_filter *(*create)(struct mp_filter *root, void *ctx),
+        void *ctx, int queue_frames);
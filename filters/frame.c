@@ -16,6 +16,7 @@ struct frame_handler {
     void (*set_pts)(void *data, double pts);
     int (*approx_size)(void *data);
     AVFrame *(*new_av_ref)(void *data);
+    AVFrame *(*av_ref_and_unref)(void *data); // optional
     void *(*from_av_ref)(AVFrame *data);
     void (*free)(void *data);
 };
@@ -45,6 +46,11 @@ static AVFrame *video_new_av_ref(void *data)
     return mp_image_to_av_frame(data);
 }
 
+static AVFrame *video_av_ref_and_unref(void *data)
+{
+    return mp_image_to_av_frame_and_unref(data);
+}
+
 static void *video_from_av_ref(AVFrame *data)
 {
     return mp_image_from_av_frame(data);
@@ -101,6 +107,7 @@ static const struct frame_handler frame_handlers[] = {
         .set_pts = video_set_pts,
         .approx_size = video_approx_size,
         .new_av_ref = video_new_av_ref,
+        .av_ref_and_unref = video_av_ref_and_unref,
         .from_av_ref = video_from_av_ref,
         .free = talloc_free,
     },
@@ -193,6 +200,27 @@ AVFrame *mp_frame_to_av(struct mp_frame frame, struct AVRational *tb)
     return res;
 }
 
+// Like mp_frame_to_av(), but also unref *frame (even on failure). This avoids
+// creating and dropping new references where possible.
+AVFrame *mp_frame_to_av_and_unref(struct mp_frame *frame, struct AVRational *tb)
+{
+    const struct frame_handler *h = &frame_handlers[frame->type];
+    if (!h->av_ref_and_unref) {
+        AVFrame *res = mp_frame_to_av(*frame, tb);
+        mp_frame_unref(frame);
+        return res;
+    }
+
+    int64_t pts = mp_pts_to_av(mp_frame_get_pts(*frame), tb);
+    AVFrame *res = h->av_ref_and_unref(frame->data);
+    *frame = MP_NO_FRAME;
+    if (!res)
+        return NULL;
+
+    res->pts = pts;
+    return res;
+}
+
 struct mp_frame mp_frame_from_av(enum mp_frame_type type, struct AVFrame *frame,
                                  struct AVRational *tb)
 {
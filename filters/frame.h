@@ -51,6 +51,8 @@ int mp_frame_approx_size(struct mp_frame frame);
 struct AVFrame;
 struct AVRational;
 struct AVFrame *mp_frame_to_av(struct mp_frame frame, struct AVRational *tb);
+struct AVFrame *mp_frame_to_av_and_unref(struct mp_frame *frame,
+                                         struct AVRational *tb);
 struct mp_frame mp_frame_from_av(enum mp_frame_type type, struct AVFrame *frame,
                                  struct AVRational *tb);
 
@@ -79,6 +79,7 @@ const struct mp_user_filter_entry *vf_list[] = {
     &vf_lavfi,
     &vf_lavfi_bridge,
     &vf_sub,
+    &vf_swdeint,
 #if HAVE_ZIMG
     &vf_fingerprint,
 #endif
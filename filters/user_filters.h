@@ -30,6 +30,7 @@ extern const struct mp_user_filter_entry af_drop;
 extern const struct mp_user_filter_entry vf_lavfi;
 extern const struct mp_user_filter_entry vf_lavfi_bridge;
 extern const struct mp_user_filter_entry vf_sub;
+extern const struct mp_user_filter_entry vf_swdeint;
 extern const struct mp_user_filter_entry vf_vapoursynth;
 extern const struct mp_user_filter_entry vf_format;
 extern const struct mp_user_filter_entry vf_vdpaupp;
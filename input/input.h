@@ -227,13 +227,16 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
                               int out_fd[2]);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
-// Serialize the given mpv_event structure to JSON. Returns an allocated string.
+// Serialize the given mpv_event structure to JSON, and append it (terminated
+// by a newline) to *dst. dst->start must be a talloc allocation or NULL.
+// Returns <0 on failure.
 struct mpv_event;
-char *mp_json_encode_event(struct mpv_event *event);
+int mp_json_append_event(bstr *dst, struct mpv_event *event);
 
-// Given the raw IPC input buffer "buf", remove the first newline-separated
-// command, execute it and return the result (if any) as an allocated string.
+// Given the raw IPC input buffer "buf", execute all complete newline-separated
+// commands, and remove them from the buffer. The replies are appended to
+// *reply. Both buffers must be talloc allocations (or NULL), and are reused.
 struct mpv_handle;
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
+void mp_ipc_consume_commands(struct mpv_handle *client, bstr *buf, bstr *reply);
 
 #endif /* MPLAYER_INPUT_H */
@@ -45,6 +45,9 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// Queued events are written out as soon as this much data is buffered.
+#define MAX_EVENT_BUFFER (64 * 1024)
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
@@ -66,11 +69,13 @@ struct client_arg {
     bool writable;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static int ipc_write(struct client_arg *client, bstr *buf)
 {
-    size_t count = strlen(buf);
+    const char *data = buf->start;
+    size_t count = buf->len;
+    buf->len = 0; // keep the allocation for reuse
     while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
+        ssize_t rc = send(client->client_fd, data, count, MSG_NOSIGNAL);
         if (rc <= 0) {
             if (rc == 0)
                 return -1;
@@ -87,7 +92,7 @@ static int ipc_write_str(struct client_arg *client, const char *buf)
         }
 
         count -= rc;
-        buf   += rc;
+        data  += rc;
     }
 
     return 0;
@@ -106,6 +111,7 @@ static void *client_thread(void *p)
 
     struct client_arg *arg = p;
     bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    bstr out = {0};
 
     mpthread_set_name(arg->client_name);
 
@@ -139,33 +145,36 @@ static void *client_thread(void *p)
             while (1) {
                 mpv_event *event = mpv_wait_event(arg->client, 0);
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
-
                 if (event->event_id == MPV_EVENT_SHUTDOWN)
                     goto done;
 
-                if (!arg->writable)
-                    continue;
-
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
+                if (event->event_id != MPV_EVENT_NONE && arg->writable) {
+                    if (mp_json_append_event(&out, event) < 0) {
+                        MP_ERR(arg, "Encoding error\n");
+                        goto done;
+                    }
                 }
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
+                // Write all queued events with a single call, unless there
+                // are too many of them.
+                if (out.len && (event->event_id == MPV_EVENT_NONE ||
+                                out.len >= MAX_EVENT_BUFFER))
+                {
+                    rc = ipc_write(arg, &out);
+                    if (rc < 0) {
+                        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+                        goto done;
+                    }
                 }
+
+                if (event->event_id == MPV_EVENT_NONE)
+                    break;
             }
         }
 
         if (fds[1].revents & (POLLIN | POLLHUP | POLLNVAL)) {
             while (1) {
-                char buf[128];
+                char buf[4096];
                 bstr append = { buf, 0 };
 
                 ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
@@ -186,20 +195,16 @@ static void *client_thread(void *p)
 
                 bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
+                mp_ipc_consume_commands(arg->client, &client_msg, &out);
 
-                    talloc_free(reply_msg);
+                if (!arg->writable)
+                    out.len = 0;
+                if (out.len) {
+                    rc = ipc_write(arg, &out);
+                    if (rc < 0) {
+                        MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+                        goto done;
+                    }
                 }
             }
         }
@@ -209,6 +214,7 @@ done:
     if (client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
     talloc_free(client_msg.start);
+    talloc_free(out.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
     struct mpv_handle *h = arg->client;
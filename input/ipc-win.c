@@ -167,11 +167,13 @@ static bool pipe_error_is_fatal(DWORD error)
     return true;
 }
 
-static DWORD ipc_write_str(struct client_arg *arg, const char *buf)
+static DWORD ipc_write(struct client_arg *arg, bstr *buf)
 {
     DWORD error = 0;
+    size_t size = buf->len;
+    buf->len = 0; // keep the allocation for reuse
 
-    if ((error = async_write(arg->client_h, buf, strlen(buf), &arg->write_ol)))
+    if ((error = async_write(arg->client_h, buf->start, size, &arg->write_ol)))
         goto done;
     if (!GetOverlappedResult(arg->client_h, &arg->write_ol, &(DWORD){0}, TRUE)) {
         error = GetLastError();
@@ -209,6 +211,7 @@ static void *client_thread(void *p)
     HANDLE wakeup_event = CreateEventW(NULL, TRUE, FALSE, NULL);
     OVERLAPPED ol = { .hEvent = CreateEventW(NULL, TRUE, TRUE, NULL) };
     bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    bstr out = {0};
     DWORD ioerr = 0;
     DWORD r;
 
@@ -243,23 +246,23 @@ static void *client_thread(void *p)
             while (1) {
                 mpv_event *event = mpv_wait_event(arg->client, 0);
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
-
                 if (event->event_id == MPV_EVENT_SHUTDOWN)
                     goto done;
 
-                if (!arg->writable)
-                    continue;
-
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
+                if (event->event_id != MPV_EVENT_NONE && arg->writable) {
+                    if (mp_json_append_event(&out, event) < 0) {
+                        MP_ERR(arg, "Encoding error\n");
+                        goto done;
+                    }
                 }
 
-                ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                // Write all queued events at once (see ipc-unix.c).
+                if (out.len && (event->event_id == MPV_EVENT_NONE ||
+                                out.len >= 64 * 1024))
+                    ipc_write(arg, &out);
+
+                if (event->event_id == MPV_EVENT_NONE)
+                    break;
             }
 
             break;
@@ -271,13 +274,11 @@ static void *client_thread(void *p)
             }
 
             bstr_xappend(NULL, &client_msg, (bstr){buf, r});
-            while (bstrchr(client_msg, '\n') != -1) {
-                char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                    NULL, &client_msg);
-                if (reply_msg && arg->writable)
-                    ipc_write_str(arg, reply_msg);
-                talloc_free(reply_msg);
-            }
+            mp_ipc_consume_commands(arg->client, &client_msg, &out);
+            if (!arg->writable)
+                out.len = 0;
+            if (out.len)
+                ipc_write(arg, &out);
 
             // Begin the next read operation on the pipe
             if ((ioerr = async_read(arg->client_h, buf, 4096, &ol))) {
@@ -294,6 +295,8 @@ static void *client_thread(void *p)
 done:
     if (client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
+    talloc_free(client_msg.start);
+    talloc_free(out.start);
 
     if (CancelIoEx(arg->client_h, &ol) || GetLastError() != ERROR_NOT_FOUND)
         GetOverlappedResult(arg->client_h, &ol, &(DWORD){0}, TRUE);
@@ -89,7 +89,7 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+int mp_json_append_event(bstr *dst, mpv_event *event)
 {
     void *ta_parent = talloc_new(NULL);
 
@@ -103,18 +103,18 @@ char *mp_json_encode_event(mpv_event *event)
         talloc_steal(ta_parent, node_get_alloc(&event_node));
     }
 
-    char *output = talloc_strdup(NULL, "");
-    json_write(&output, &event_node);
-    output = ta_talloc_strdup_append(output, "\n");
+    int r = json_write_bstr(dst, &event_node);
+    if (r >= 0)
+        bstr_xappend(NULL, dst, bstr0("\n"));
 
     talloc_free(ta_parent);
 
-    return output;
+    return r;
 }
 
 // Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+static void json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                 char *src, bstr *reply)
 {
     int rc;
     const char *cmd = NULL;
@@ -372,45 +372,48 @@ error:
 
     mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
 
-    char *output = talloc_strdup(ta_parent, "");
-
     if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
+        json_write_bstr(reply, &reply_node);
+        bstr_xappend(NULL, reply, bstr0("\n"));
     }
-
-    return output;
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static void text_execute_command(struct mpv_handle *client, char *src)
 {
     mpv_command_string(client, src);
-
-    return NULL;
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+void mp_ipc_consume_commands(struct mpv_handle *client, bstr *buf, bstr *reply)
 {
     void *tmp = talloc_new(NULL);
 
-    bstr rest;
-    bstr line = bstr_getline(*buf, &rest);
-    char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
-    *buf = bstrdup(NULL, rest);
-
-    json_skip_whitespace(&line0);
+    // Commands are terminated in place, so nothing is copied, and the rest of
+    // the buffer is moved only once at the end.
+    bstr rest = *buf;
+    while (1) {
+        int end = bstrchr(rest, '\n');
+        if (end < 0)
+            break;
+        char *line0 = rest.start;
+        line0[end] = '\0';
+        rest = bstr_cut(rest, end + 1);
+
+        json_skip_whitespace(&line0);
+
+        if (line0[0] == '\0' || line0[0] == '#') {
+            // skip
+        } else if (line0[0] == '{') {
+            json_execute_command(client, tmp, line0, reply);
+        } else {
+            text_execute_command(client, line0);
+        }
 
-    char *reply_msg = NULL;
-    if (line0[0] == '\0' || line0[0] == '#') {
-        // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
-    } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+        talloc_free_children(tmp);
     }
 
-    talloc_steal(ctx, reply_msg);
+    if (rest.start != buf->start)
+        memmove(buf->start, rest.start, rest.len);
+    buf->len = rest.len;
+
     talloc_free(tmp);
-    return reply_msg;
 }
@@ -240,7 +240,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 0)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 1)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1336,6 +1336,7 @@ typedef enum mpv_event_id {
      *
      * Event delivery will continue normally once this event was returned
      * (this forces the client to empty the queue completely).
+     * See also mpv_event and mpv_event_queue_overflow (since API version 2.1).
      */
     MPV_EVENT_QUEUE_OVERFLOW    = 24,
     /**
@@ -1544,6 +1545,20 @@ typedef struct mpv_event_hook {
     uint64_t id;
 } mpv_event_hook;
 
+// Since API version 2.1.
+typedef struct mpv_event_queue_overflow {
+    /**
+     * Number of events that were dropped since the queue overflowed (i.e.
+     * since the previous MPV_EVENT_QUEUE_OVERFLOW event).
+     */
+    uint64_t dropped_events;
+    /**
+     * Number of events that were dropped over the lifetime of this
+     * mpv_handle, including dropped_events.
+     */
+    uint64_t total_dropped_events;
+} mpv_event_queue_overflow;
+
 // Since API version 1.102.
 typedef struct mpv_event_command {
     /**
@@ -1594,6 +1609,8 @@ typedef struct mpv_event {
      *  MPV_EVENT_END_FILE:               mpv_event_end_file*
      *  MPV_EVENT_HOOK:                   mpv_event_hook*
      *  MPV_EVENT_COMMAND_REPLY*          mpv_event_command*
+     *  MPV_EVENT_QUEUE_OVERFLOW:         mpv_event_queue_overflow*
+     *                                    (since v2.1)
      *  other: NULL
      *
      * Note: future enhancements might add new event structs for existing or new
@@ -1692,6 +1709,34 @@ MPV_EXPORT int mpv_request_log_messages(mpv_handle *ctx, const char *min_level);
  */
 MPV_EXPORT mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout);
 
+/**
+ * Like mpv_wait_event(), but return multiple events at once. This waits until
+ * at least one event is available (or the timeout expires, or mpv_wakeup() is
+ * called), and then returns all pending events, up to max_events. This is
+ * cheaper than calling mpv_wait_event() in a loop if many events arrive at
+ * once.
+ *
+ * MPV_EVENT_NONE is never part of the returned events; on timeout, the
+ * function returns with *num_events set to 0. If MPV_EVENT_SHUTDOWN is
+ * returned, it's always the last event in the array.
+ *
+ * The same restrictions as with mpv_wait_event() apply. Calling either
+ * function invalidates the events returned by the previous call of either
+ * function.
+ *
+ * @param timeout See mpv_wait_event().
+ * @param max_events Maximum number of events to return. Values below 1 are
+ *                   treated as 1, and values above the size of the event
+ *                   queue (currently 1000) are clamped to it.
+ * @param[out] num_events Set to the number of events in the returned array.
+ * @return Array of num_events events. The array and all memory referenced by
+ *         it stay valid until the next mpv_wait_event() or mpv_wait_events()
+ *         call, or until the mpv_handle is destroyed. You must not write to
+ *         it. The return value is never NULL.
+ */
+MPV_EXPORT mpv_event *mpv_wait_events(mpv_handle *ctx, double timeout,
+                                      int max_events, int *num_events);
+
 /**
  * Interrupt the current mpv_wait_event() call. This will wake up the thread
  * currently waiting in mpv_wait_event(). If no thread is waiting, the next
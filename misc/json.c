@@ -349,6 +349,14 @@ int json_write(char **dst, struct mpv_node *src)
     return json_append_str(dst, src, -1);
 }
 
+// Same as json_write(), but append to the given buffer. The buffer is reused:
+// dst->start must be a talloc allocation (or NULL), and is only reallocated if
+// it's too small, so callers can keep it around and set dst->len to 0.
+int json_write_bstr(bstr *dst, struct mpv_node *src)
+{
+    return json_append(dst, src, -1);
+}
+
 // Same as json_write(), but add whitespace to make it readable.
 int json_write_pretty(char **dst, struct mpv_node *src)
 {
@@ -45,7 +45,12 @@ struct m_config_shadow {
     // Invariant: a parent is always at a lower index than any of its children.
     struct m_config_group *groups;
     int num_groups;
+    // Per group: timestamp of the last change to any option in the group.
+    // Written with lock held, but can be read without.
+    mp_atomic_uint64 *group_ts;
     // -- protected by lock
+    // Per group and option: timestamp of the last change to the option.
+    uint64_t **opt_ts;
     struct m_config_data *data; // protected shadow copy of the option data
     struct config_cache **listeners;
     int num_listeners;
@@ -430,6 +435,14 @@ struct m_config_shadow *m_config_shadow_new(const struct m_sub_options *root)
 
     add_sub_group(shadow, NULL, -1, -1, root);
 
+    shadow->group_ts = talloc_zero_array(shadow, mp_atomic_uint64,
+                                         shadow->num_groups);
+    shadow->opt_ts = talloc_zero_array(shadow, uint64_t *, shadow->num_groups);
+    for (int n = 0; n < shadow->num_groups; n++) {
+        shadow->opt_ts[n] = talloc_zero_array(shadow, uint64_t,
+                                              shadow->groups[n].opt_count);
+    }
+
     if (!root->size)
         return shadow;
 
@@ -608,11 +621,15 @@ static void update_next_option(struct m_config_cache *cache, void **p_opt)
         if (gdst->ts < gsrc->ts) {
             struct m_config_group *g = &dst->shadow->groups[in->upd_group];
             const struct m_option *opts = g->group->opts;
+            uint64_t *opt_ts = dst->shadow->opt_ts[in->upd_group];
 
             while (opts && opts[in->upd_opt].name) {
                 const struct m_option *opt = &opts[in->upd_opt];
 
-                if (opt->offset >= 0 && opt->type->size) {
+                // Skip options that weren't written since the last update.
+                if (opt->offset >= 0 && opt->type->size &&
+                    opt_ts[in->upd_opt] > gdst->ts)
+                {
                     void *dsrc = gsrc->udata + opt->offset;
                     void *ddst = gdst->udata + opt->offset;
 
@@ -664,6 +681,18 @@ static bool cache_check_update(struct m_config_cache *cache)
         return false;
 
     in->ts = new_ts;
+
+    // Don't take the lock if only options outside of this cache changed.
+    bool changed = false;
+    for (int n = in->group_start; n < in->group_end; n++) {
+        if (atomic_load(&shadow->group_ts[n]) > m_config_gdata(in->data, n)->ts) {
+            changed = true;
+            break;
+        }
+    }
+    if (!changed)
+        return false;
+
     in->upd_group = in->data->group_index;
     in->upd_opt = 0;
     return true;
@@ -756,7 +785,12 @@ bool m_config_cache_write_opt(struct m_config_cache *cache, void *ptr)
     if (changed) {
         m_option_copy(opt, gsrc->udata + opt->offset, ptr);
 
-        gsrc->ts = atomic_fetch_add(&shadow->ts, 1) + 1;
+        // Publish shadow->ts last; readers check it before group_ts.
+        uint64_t new_ts = atomic_load(&shadow->ts) + 1;
+        gsrc->ts = new_ts;
+        shadow->opt_ts[group_idx][opt_idx] = new_ts;
+        atomic_store(&shadow->group_ts[group_idx], new_ts);
+        atomic_store(&shadow->ts, new_ts);
 
         for (int n = 0; n < shadow->num_listeners; n++) {
             struct config_cache *listener = shadow->listeners[n];
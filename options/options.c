@@ -41,6 +41,8 @@
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "video/hwdec.h"
+#include "video/image_buffer.h"
+#include "video/image_cache.h"
 #include "video/image_writer.h"
 #include "sub/osd.h"
 #include "player/core.h"
@@ -79,6 +81,8 @@ extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
 extern const struct m_sub_options demux_cache_conf;
+extern const struct m_sub_options demux_probe_conf;
+extern const struct m_sub_options lua_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -367,6 +371,8 @@ const struct m_sub_options dvd_conf = {
 const struct m_sub_options filter_conf = {
     .opts = (const struct m_option[]){
         {"deinterlace", OPT_FLAG(deinterlace)},
+        {"vf-pipeline", OPT_INT(vf_pipeline), M_RANGE(0, 64)},
+        {"af-pipeline", OPT_INT(af_pipeline), M_RANGE(0, 64)},
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
@@ -462,6 +468,7 @@ static const m_option_t mp_opts[] = {
     {"load-auto-profiles",
         OPT_CHOICE(lua_load_auto_profiles, {"no", 0}, {"yes", 1}, {"auto", -1}),
         .flags = UPDATE_BUILTIN_SCRIPTS},
+    {"", OPT_SUBSTRUCT(lua_opts, lua_conf)},
 #endif
 
 // ------------------------- stream options --------------------
@@ -550,6 +557,8 @@ static const m_option_t mp_opts[] = {
 
     {"mf-fps", OPT_DOUBLE(mf_fps)},
     {"mf-type", OPT_STRING(mf_type)},
+    {"mf-prefetch", OPT_INT(mf_prefetch), M_RANGE(0, 64)},
+    {"mf-mmap", OPT_FLAG(mf_mmap)},
 #if HAVE_DVBIN
     {"dvbin", OPT_SUBSTRUCT(stream_dvb_opts, stream_dvb_conf)},
 #endif
@@ -688,6 +697,14 @@ static const m_option_t mp_opts[] = {
         {"decoder", 2},
         {"decoder+vo", 3})},
     {"video-latency-hacks", OPT_FLAG(video_latency_hacks)},
+    {"video-frame-cache-size", OPT_BYTE_SIZE(video_frame_cache_size),
+        M_RANGE(0, M_MAX_MEM_BYTES)},
+    {"image-buffer-cache-size", OPT_BYTE_SIZE(image_buffer_cache_size),
+        M_RANGE(0, M_MAX_MEM_BYTES)},
+    {"image-buffer-huge-pages", OPT_CHOICE(image_buffer_huge_pages,
+        {"no", MP_IMAGE_BUFFER_HUGE_NO},
+        {"transparent", MP_IMAGE_BUFFER_HUGE_TRANSPARENT},
+        {"explicit", MP_IMAGE_BUFFER_HUGE_EXPLICIT})},
 
     {"untimed", OPT_FLAG(untimed)},
 
@@ -788,6 +805,8 @@ static const m_option_t mp_opts[] = {
     {"", OPT_SUBSTRUCT(vo, vo_sub_opts)},
     {"", OPT_SUBSTRUCT(demux_opts, demux_conf)},
     {"", OPT_SUBSTRUCT(demux_cache_opts, demux_cache_conf)},
+    {"", OPT_SUBSTRUCT(demux_probe_opts, demux_probe_conf)},
+    {"", OPT_SUBSTRUCT(image_cache_opts, image_cache_conf)},
     {"", OPT_SUBSTRUCT(stream_opts, stream_conf)},
 
     {"", OPT_SUBSTRUCT(ra_ctx_opts, ra_ctx_conf)},
@@ -1013,6 +1032,7 @@ static const struct MPOpts mp_default_opts = {
     .default_max_pts_correction = -1,
     .initial_audio_sync = 1,
     .frame_dropping = 1,
+    .image_buffer_cache_size = 64 * 1024 * 1024,
     .term_osd = 2,
     .term_osd_bar_chars = "[-+-]",
     .consolecontrols = 1,
@@ -1050,6 +1070,7 @@ static const struct MPOpts mp_default_opts = {
     .index_mode = 1,
 
     .mf_fps = 1.0,
+    .mf_prefetch = 4,
 
     .display_tags = (char **)(const char*[]){
         "Artist", "Album", "Album_Artist", "Comment", "Composer",
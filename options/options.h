@@ -158,6 +158,7 @@ typedef struct MPOpts {
     int lua_load_stats;
     int lua_load_console;
     int lua_load_auto_profiles;
+    struct lua_opts *lua_opts;
 
     int auto_load_scripts;
 
@@ -228,6 +229,9 @@ typedef struct MPOpts {
     int autosync;
     int frame_dropping;
     int video_latency_hacks;
+    int64_t video_frame_cache_size;
+    int64_t image_buffer_cache_size;
+    int image_buffer_huge_pages;
     int term_osd;
     int term_osd_bar;
     char *term_osd_bar_chars;
@@ -321,6 +325,8 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch;
+    int mf_mmap;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
@@ -330,6 +336,8 @@ typedef struct MPOpts {
 
     struct demux_opts *demux_opts;
     struct demux_cache_opts *demux_cache_opts;
+    struct demux_probe_opts *demux_probe_opts;
+    struct image_cache_opts *image_cache_opts;
     struct stream_opts *stream_opts;
 
     struct vd_lavc_params *vd_lavc_params;
@@ -375,6 +383,8 @@ struct dvd_opts {
 
 struct filter_opts {
     int deinterlace;
+    int vf_pipeline;
+    int af_pipeline;
 };
 
 extern const struct m_sub_options vo_sub_opts;
@@ -83,6 +83,27 @@ struct mp_client_api {
     int num_custom_protocols;
 
     struct mpv_render_context *render_context;
+
+    // -- only accessed by the core thread
+    // Property values read during the current mp_client_send_property_changes()
+    // call. Used to share a single read between all observers.
+    struct prop_snapshot *prop_snapshots;
+    int num_prop_snapshots;
+};
+
+// Immutable property value. It's shared between all observers that read the
+// same property with the same format in the same update round, and returned
+// to the API user without copying it. Freed when the last reference is gone.
+struct prop_value {
+    atomic_int refcount;
+    const struct m_option *type;
+    union m_option_value value;
+};
+
+struct prop_snapshot {
+    char *name;
+    mpv_format format;
+    struct prop_value *value; // NULL if the property was unavailable
 };
 
 struct observe_property {
@@ -98,10 +119,8 @@ struct observe_property {
     size_t refcount;
     uint64_t change_ts;     // logical timestamp incremented on each change
     uint64_t value_ts;      // logical timestamp for value contents
-    bool value_valid;
-    union m_option_value value;
+    struct prop_value *value; // NULL if unavailable
     uint64_t value_ret_ts;  // logical timestamp of value returned to user
-    union m_option_value value_ret;
     bool waiting_for_hook;  // flag for draining old property changes on a hook
 };
 
@@ -115,8 +134,6 @@ struct mpv_handle {
 
     // -- not thread-safe
     struct mpv_event *cur_event;
-    struct mpv_event_property cur_property_event;
-    struct observe_property *cur_property;
 
     pthread_mutex_t lock;
 
@@ -141,6 +158,8 @@ struct mpv_handle {
     int reserved_events;    // number of entries reserved for replies
     size_t async_counter;   // pending other async events
     bool choked;            // recovering from queue overflow
+    uint64_t dropped_events; // events lost since the queue overflowed
+    uint64_t total_dropped_events; // events lost over the handle's lifetime
     bool destroying;        // pending destruction; no API accesses allowed
     bool hook_pending;      // hook events are returned after draining properties
 
@@ -162,8 +181,10 @@ struct mpv_handle {
     int messages_level;
 };
 
-static bool gen_log_message_event(struct mpv_handle *ctx);
-static bool gen_property_change_event(struct mpv_handle *ctx);
+static bool gen_log_message_event(struct mpv_handle *ctx,
+                                  struct mpv_event *event, void *ta_parent);
+static bool gen_property_change_event(struct mpv_handle *ctx,
+                                      struct mpv_event *event, void *ta_parent);
 static void notify_property_events(struct mpv_handle *ctx, int event);
 
 // Must be called with prop->owner->lock held.
@@ -178,6 +199,31 @@ static void prop_unref(struct observe_property *prop)
         talloc_free(prop);
 }
 
+static struct prop_value *prop_value_new(const struct m_option *type)
+{
+    struct prop_value *v = talloc_ptrtype(NULL, v);
+    *v = (struct prop_value){
+        .refcount = ATOMIC_VAR_INIT(1),
+        .type = type,
+    };
+    return v;
+}
+
+static struct prop_value *prop_value_ref(struct prop_value *v)
+{
+    if (v)
+        atomic_fetch_add(&v->refcount, 1);
+    return v;
+}
+
+static void prop_value_unref(struct prop_value *v)
+{
+    if (v && atomic_fetch_add(&v->refcount, -1) == 1) {
+        m_option_free(v->type, &v->value);
+        talloc_free(v);
+    }
+}
+
 void mp_clients_init(struct MPContext *mpctx)
 {
     mpctx->clients = talloc_ptrtype(NULL, mpctx->clients);
@@ -452,9 +498,6 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     ctx->num_properties = 0;
     ctx->properties_change_ts += 1;
 
-    prop_unref(ctx->cur_property);
-    ctx->cur_property = NULL;
-
     pthread_mutex_unlock(&ctx->lock);
 
     abort_async(mpctx, ctx, 0, 0);
@@ -730,22 +773,47 @@ static int append_event(struct mpv_handle *ctx, struct mpv_event event, bool cop
     return 0;
 }
 
+// Whether the event is a plain notification that some state changed. Queuing
+// it directly behind the same event tells the client nothing new.
+static bool is_coalescable_event(struct mpv_event *event)
+{
+    switch (event->event_id) {
+    case MPV_EVENT_VIDEO_RECONFIG:
+    case MPV_EVENT_AUDIO_RECONFIG:
+    case MPV_EVENT_IDLE:
+    case MPV_EVENT_TICK:
+        return !event->data;
+    }
+    return false;
+}
+
 static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy)
 {
     pthread_mutex_lock(&ctx->lock);
     uint64_t mask = 1ULL << event->event_id;
     if (ctx->property_event_masks & mask)
         notify_property_events(ctx, event->event_id);
+    struct mpv_event *last = NULL;
+    if (ctx->num_events) {
+        int last_idx = (ctx->first_event + ctx->num_events - 1) % ctx->max_events;
+        last = &ctx->events[last_idx];
+    }
     int r;
     if (!(ctx->event_mask & mask)) {
         r = 0;
+    } else if (last && last->event_id == event->event_id &&
+               is_coalescable_event(event))
+    {
+        r = 0; // merged with the previous event
     } else if (ctx->choked) {
+        ctx->dropped_events++;
         r = -1;
     } else {
         r = append_event(ctx, *event, copy);
         if (r < 0) {
             MP_ERR(ctx, "Too many events queued.\n");
             ctx->choked = true;
+            ctx->dropped_events++;
         }
     }
     pthread_mutex_unlock(&ctx->lock);
@@ -892,10 +960,68 @@ static bool check_for_for_hook_flags(mpv_handle *ctx)
     return false;
 }
 
-mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
-{
-    mpv_event *event = ctx->cur_event;
+// Return the next event in *event, without waiting. Event data is allocated on
+// (or moved to) ta_parent. Returns false if no event is available.
+// Call with ctx->lock held.
+static bool read_event(struct mpv_handle *ctx, struct mpv_event *event,
+                       void *ta_parent)
+{
+    // Recover from overflow.
+    if (ctx->choked && !ctx->num_events) {
+        ctx->choked = false;
+        MP_WARN(ctx, "%"PRIu64" events were dropped due to queue overflow.\n",
+                ctx->dropped_events);
+        ctx->total_dropped_events += ctx->dropped_events;
+        struct mpv_event_queue_overflow *info =
+            talloc_ptrtype(ta_parent, info);
+        *info = (struct mpv_event_queue_overflow){
+            .dropped_events = ctx->dropped_events,
+            .total_dropped_events = ctx->total_dropped_events,
+        };
+        ctx->dropped_events = 0;
+        *event = (mpv_event){
+            .event_id = MPV_EVENT_QUEUE_OVERFLOW,
+            .data = info,
+        };
+        return true;
+    }
+    struct mpv_event *ev =
+        ctx->num_events ? &ctx->events[ctx->first_event] : NULL;
+    if (ev && ev->event_id == MPV_EVENT_HOOK) {
+        // Give old property notifications priority over hooks. This is a
+        // guarantee given to clients to simplify their logic. New property
+        // changes after this are treated normally, so
+        if (!ctx->hook_pending) {
+            ctx->hook_pending = true;
+            set_wait_for_hook_flags(ctx);
+        }
+        if (check_for_for_hook_flags(ctx)) {
+            ev = NULL; // delay
+        } else {
+            ctx->hook_pending = false;
+        }
+    }
+    if (ev) {
+        *event = *ev;
+        ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
+        ctx->num_events--;
+        talloc_steal(ta_parent, event->data);
+        return true;
+    }
+    // If there's a changed property, generate change event (never queued).
+    if (gen_property_change_event(ctx, event, ta_parent))
+        return true;
+    // Pop item from message queue, and return as event.
+    return gen_log_message_event(ctx, event, ta_parent);
+}
 
+// Wait until at least one event is available (or the timeout expires), and
+// then read up to max_events events without waiting. Returns the number of
+// events written to events[].
+static int wait_events(struct mpv_handle *ctx, double timeout,
+                       struct mpv_event *events, int max_events,
+                       void *ta_parent)
+{
     pthread_mutex_lock(&ctx->lock);
 
     if (!ctx->fuzzy_initialized)
@@ -907,46 +1033,16 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 
     int64_t deadline = mp_add_timeout(mp_time_us(), timeout);
 
-    *event = (mpv_event){0};
-    talloc_free_children(event);
-
+    int num = 0;
     while (1) {
         if (ctx->queued_wakeup)
             deadline = 0;
-        // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
-            event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
-            break;
-        }
-        struct mpv_event *ev =
-            ctx->num_events ? &ctx->events[ctx->first_event] : NULL;
-        if (ev && ev->event_id == MPV_EVENT_HOOK) {
-            // Give old property notifications priority over hooks. This is a
-            // guarantee given to clients to simplify their logic. New property
-            // changes after this are treated normally, so
-            if (!ctx->hook_pending) {
-                ctx->hook_pending = true;
-                set_wait_for_hook_flags(ctx);
-            }
-            if (check_for_for_hook_flags(ctx)) {
-                ev = NULL; // delay
-            } else {
-                ctx->hook_pending = false;
-            }
-        }
-        if (ev) {
-            *event = *ev;
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
-            talloc_steal(event, event->data);
-            break;
+        while (num < max_events && read_event(ctx, &events[num], ta_parent)) {
+            // Let the client see the shutdown before anything else.
+            if (events[num++].event_id == MPV_EVENT_SHUTDOWN)
+                break;
         }
-        // If there's a changed property, generate change event (never queued).
-        if (gen_property_change_event(ctx))
-            break;
-        // Pop item from message queue, and return as event.
-        if (gen_log_message_event(ctx))
+        if (num)
             break;
         int r = wait_wakeup(ctx, deadline);
         if (r == ETIMEDOUT)
@@ -956,9 +1052,38 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 
     pthread_mutex_unlock(&ctx->lock);
 
+    return num;
+}
+
+mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
+{
+    mpv_event *event = ctx->cur_event;
+
+    *event = (mpv_event){0};
+    talloc_free_children(event);
+
+    wait_events(ctx, timeout, event, 1, event);
+
     return event;
 }
 
+mpv_event *mpv_wait_events(mpv_handle *ctx, double timeout, int max_events,
+                           int *num_events)
+{
+    mpv_event *event = ctx->cur_event;
+
+    *event = (mpv_event){0};
+    talloc_free_children(event);
+
+    // More events than fit into the queue can't be pending at once (except
+    // for property changes and log messages, which are returned next time).
+    max_events = MPCLAMP(max_events, 1, ctx->max_events);
+    mpv_event *events = talloc_zero_array(event, mpv_event, max_events);
+    *num_events = wait_events(ctx, timeout, events, max_events, event);
+
+    return events;
+}
+
 void mpv_wakeup(mpv_handle *ctx)
 {
     pthread_mutex_lock(&ctx->lock);
@@ -1524,10 +1649,7 @@ static void property_free(void *p)
 
     assert(prop->refcount == 0);
 
-    if (prop->type) {
-        m_option_free(prop->type, &prop->value);
-        m_option_free(prop->type, &prop->value_ret);
-    }
+    prop_value_unref(prop->value);
 }
 
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
@@ -1635,6 +1757,39 @@ static void notify_property_events(struct mpv_handle *ctx, int event)
         mp_dispatch_adjust_timeout(ctx->mpctx->dispatch, 0);
 }
 
+static struct prop_snapshot *find_prop_snapshot(struct mp_client_api *clients,
+                                                struct observe_property *prop)
+{
+    for (int n = 0; n < clients->num_prop_snapshots; n++) {
+        struct prop_snapshot *snap = &clients->prop_snapshots[n];
+        if (snap->format == prop->format && strcmp(snap->name, prop->name) == 0)
+            return snap;
+    }
+    return NULL;
+}
+
+static void add_prop_snapshot(struct mp_client_api *clients,
+                              struct observe_property *prop,
+                              struct prop_value *val)
+{
+    MP_TARRAY_APPEND(clients, clients->prop_snapshots,
+                     clients->num_prop_snapshots, (struct prop_snapshot){
+                        .name = talloc_strdup(clients, prop->name),
+                        .format = prop->format,
+                        .value = prop_value_ref(val),
+                     });
+}
+
+static void clear_prop_snapshots(struct mp_client_api *clients)
+{
+    for (int n = 0; n < clients->num_prop_snapshots; n++) {
+        struct prop_snapshot *snap = &clients->prop_snapshots[n];
+        talloc_free(snap->name);
+        prop_value_unref(snap->value);
+    }
+    clients->num_prop_snapshots = 0;
+}
+
 // Call with ctx->lock held (only). May temporarily drop the lock.
 static void send_client_property_changes(struct mpv_handle *ctx)
 {
@@ -1650,53 +1805,63 @@ static void send_client_property_changes(struct mpv_handle *ctx)
 
         bool changed = false;
         if (prop->format) {
-            const struct m_option *type = prop->type;
-            union m_option_value val = {0};
-            struct getproperty_request req = {
-                .mpctx = ctx->mpctx,
-                .name = prop->name,
-                .format = prop->format,
-                .data = &val,
-            };
-
-            // Temporarily unlock and read the property. The very important
-            // thing is that property getters can do whatever they want, _and_
-            // that they may wait on the client API user thread (if vo_libmpv
-            // or similar things are involved).
-            prop->refcount += 1; // keep prop alive (esp. prop->name)
-            ctx->async_counter += 1; // keep ctx alive
-            pthread_mutex_unlock(&ctx->lock);
-            getproperty_fn(&req);
-            pthread_mutex_lock(&ctx->lock);
-            ctx->async_counter -= 1;
-            prop_unref(prop);
-
-            // Set if observed properties was changed or something similar
-            // => start over, retry next time.
-            if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
-                m_option_free(type, &val);
-                mp_wakeup_core(ctx->mpctx);
-                ctx->has_pending_properties = true;
-                break;
+            struct prop_value *val = NULL;
+            struct prop_snapshot *snap = find_prop_snapshot(ctx->clients, prop);
+            if (snap) {
+                // Another client read it already; the value can't have changed
+                // since then, because only the core thread changes properties.
+                val = prop_value_ref(snap->value);
+            } else {
+                val = prop_value_new(prop->type);
+                struct getproperty_request req = {
+                    .mpctx = ctx->mpctx,
+                    .name = prop->name,
+                    .format = prop->format,
+                    .data = &val->value,
+                };
+
+                // Temporarily unlock and read the property. The very important
+                // thing is that property getters can do whatever they want,
+                // _and_ that they may wait on the client API user thread (if
+                // vo_libmpv or similar things are involved).
+                prop->refcount += 1; // keep prop alive (esp. prop->name)
+                ctx->async_counter += 1; // keep ctx alive
+                pthread_mutex_unlock(&ctx->lock);
+                getproperty_fn(&req);
+                pthread_mutex_lock(&ctx->lock);
+                ctx->async_counter -= 1;
+                prop_unref(prop);
+
+                if (req.status < 0) {
+                    prop_value_unref(val);
+                    val = NULL;
+                }
+                add_prop_snapshot(ctx->clients, prop, val);
+
+                // Set if observed properties was changed or something similar
+                // => start over, retry next time.
+                if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
+                    prop_value_unref(val);
+                    mp_wakeup_core(ctx->mpctx);
+                    ctx->has_pending_properties = true;
+                    break;
+                }
+                assert(prop->refcount > 0);
             }
-            assert(prop->refcount > 0);
 
-            bool val_valid = req.status >= 0;
-            changed = prop->value_valid != val_valid;
-            if (prop->value_valid && val_valid)
-                changed = !equal_mpv_value(&prop->value, &val, prop->format);
+            changed = !prop->value != !val;
+            if (prop->value && val && prop->value != val)
+                changed = !equal_mpv_value(&prop->value->value, &val->value,
+                                           prop->format);
             if (prop->value_ts == 0)
                 changed = true; // initial event
 
-            prop->value_valid = val_valid;
-            if (changed && val_valid) {
-                // move val to prop->value
-                m_option_free(type, &prop->value);
-                memcpy(&prop->value, &val, type->type->size);
-                memset(&val, 0, type->type->size);
+            if (changed || !val) {
+                prop_value_unref(prop->value);
+                prop->value = val;
+            } else {
+                prop_value_unref(val);
             }
-
-            m_option_free(prop->type, &val);
         } else {
             changed = true;
         }
@@ -1748,11 +1913,27 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
     }
 
     pthread_mutex_unlock(&clients->lock);
+
+    clear_prop_snapshots(clients);
+}
+
+// Property change event data. Keeps a reference to the returned value.
+struct prop_event {
+    struct mpv_event_property ev;
+    struct prop_value *value;
+};
+
+static void prop_event_free(void *p)
+{
+    struct prop_event *pev = p;
+
+    prop_value_unref(pev->value);
 }
 
-// Set ctx->cur_event to a generated property change event, if there is any
+// Set *event to a generated property change event, if there is any
 // outstanding property.
-static bool gen_property_change_event(struct mpv_handle *ctx)
+static bool gen_property_change_event(struct mpv_handle *ctx,
+                                      struct mpv_event *event, void *ta_parent)
 {
     if (!ctx->mpctx->initialized)
         return false;
@@ -1773,22 +1954,22 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
         {
             prop->value_ret_ts = prop->value_ts;
             prop->waiting_for_hook = false;
-            prop_unref(ctx->cur_property);
-            ctx->cur_property = prop;
-            prop->refcount += 1;
-
-            if (prop->value_valid)
-                m_option_copy(prop->type, &prop->value_ret, &prop->value);
 
-            ctx->cur_property_event = (struct mpv_event_property){
-                .name = prop->name,
-                .format = prop->value_valid ? prop->format : 0,
-                .data = prop->value_valid ? &prop->value_ret : NULL,
+            // The value is immutable, so the user can get it without a copy.
+            struct prop_event *pev = talloc_ptrtype(ta_parent, pev);
+            *pev = (struct prop_event){
+                .value = prop_value_ref(prop->value),
             };
-            *ctx->cur_event = (struct mpv_event){
+            talloc_set_destructor(pev, prop_event_free);
+            pev->ev = (struct mpv_event_property){
+                .name = talloc_strdup(pev, prop->name),
+                .format = pev->value ? prop->format : 0,
+                .data = pev->value ? &pev->value->value : NULL,
+            };
+            *event = (struct mpv_event){
                 .event_id = MPV_EVENT_PROPERTY_CHANGE,
                 .reply_userdata = prop->reply_id,
-                .data = &ctx->cur_property_event,
+                .data = &pev->ev,
             };
             return true;
         }
@@ -1873,15 +2054,16 @@ int mpv_request_log_messages(mpv_handle *ctx, const char *min_level)
     return 0;
 }
 
-// Set ctx->cur_event to a generated log message event, if any available.
-static bool gen_log_message_event(struct mpv_handle *ctx)
+// Set *event to a generated log message event, if any available.
+static bool gen_log_message_event(struct mpv_handle *ctx,
+                                  struct mpv_event *event, void *ta_parent)
 {
     if (ctx->messages) {
         struct mp_log_buffer_entry *msg =
             mp_msg_log_buffer_read(ctx->messages);
         if (msg) {
             struct mpv_event_log_message *cmsg =
-                talloc_ptrtype(ctx->cur_event, cmsg);
+                talloc_ptrtype(ta_parent, cmsg);
             talloc_steal(cmsg, msg);
             *cmsg = (struct mpv_event_log_message){
                 .prefix = msg->prefix,
@@ -1889,7 +2071,7 @@ static bool gen_log_message_event(struct mpv_handle *ctx)
                 .log_level = mp_mpv_log_levels[msg->level],
                 .text = msg->text,
             };
-            *ctx->cur_event = (struct mpv_event){
+            *event = (struct mpv_event){
                 .event_id = MPV_EVENT_LOG_MESSAGE,
                 .data = cmsg,
             };
@@ -2025,6 +2207,15 @@ int mpv_event_to_node(mpv_node *dst, mpv_event *event)
         break;
     }
 
+    case MPV_EVENT_QUEUE_OVERFLOW: {
+        mpv_event_queue_overflow *info = event->data;
+
+        node_map_add_int64(dst, "dropped_events", info->dropped_events);
+        node_map_add_int64(dst, "total_dropped_events",
+                           info->total_dropped_events);
+        break;
+    }
+
     }
     return 0;
 }
@@ -47,6 +47,7 @@
 #include "input/keycodes.h"
 #include "stream/stream.h"
 #include "demux/demux.h"
+#include "demux/probe.h"
 #include "demux/stheader.h"
 #include "common/playlist.h"
 #include "sub/osd.h"
@@ -62,6 +63,9 @@
 #include "audio/format.h"
 #include "audio/out/ao.h"
 #include "video/out/bitmap_packer.h"
+#include "video/image_buffer.h"
+#include "video/image_cache.h"
+#include "video/thumbnailer.h"
 #include "options/path.h"
 #include "screenshot.h"
 #include "misc/dispatch.h"
@@ -1477,6 +1481,22 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
         node_map_add_double(r, "debug-seeking", s.seeking);
     node_map_add_int64(r, "debug-low-level-seeks", s.low_level_seeks);
     node_map_add_int64(r, "debug-byte-level-seeks", s.byte_level_seeks);
+
+    static const char *const eviction_names[DEMUX_EVICT_COUNT] = {
+        [DEMUX_EVICT_LRU] = "lru",
+        [DEMUX_EVICT_DISTANCE] = "distance",
+        [DEMUX_EVICT_PINNED] = "pinned",
+    };
+    node_map_add_string(r, "eviction-policy", eviction_names[s.eviction_policy]);
+    struct mpv_node *evstats =
+        node_map_add(r, "eviction-stats", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < DEMUX_EVICT_COUNT; n++) {
+        struct demux_eviction_stats *st = &s.eviction_stats[n];
+        struct mpv_node *sub =
+            node_map_add(evstats, eviction_names[n], MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(sub, "hits", st->hits);
+        node_map_add_int64(sub, "misses", st->misses);
+    }
     if (s.ts_last != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-ts-last", s.ts_last);
 
@@ -2250,6 +2270,25 @@ static int property_imgparams(struct mp_image_params p, int action, void *arg)
     return m_property_read_sub(props, action, arg);
 }
 
+static int mp_property_image_cache_stats(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_image_cache_stats st;
+    mp_image_cache_get_stats(mpctx->image_cache, &st);
+
+    struct m_sub_property props[] = {
+        {"hits",            SUB_PROP_INT64(st.hits)},
+        {"misses",          SUB_PROP_INT64(st.misses)},
+        {"writes",          SUB_PROP_INT64(st.writes)},
+        {"dir-bytes",       SUB_PROP_INT64(st.dir_bytes),
+                            .unavailable = st.dir_bytes < 0},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 static struct mp_image_params get_video_out_params(struct MPContext *mpctx)
 {
     if (!mpctx->vo_chain)
@@ -3650,6 +3689,7 @@ static const struct m_property mp_properties_base[] = {
     {"video-params", mp_property_vd_imgparams},
     {"video-format", mp_property_video_format},
     {"video-frame-info", mp_property_video_frame_info},
+    {"image-cache-stats", mp_property_image_cache_stats},
     {"video-codec", mp_property_video_codec},
     M_PROPERTY_ALIAS("dwidth", "video-out-params/dw"),
     M_PROPERTY_ALIAS("dheight", "video-out-params/dh"),
@@ -5144,8 +5184,10 @@ static void cmd_loadfile(void *p)
     char *filename = cmd->args[0].v.s;
     int append = cmd->args[1].v.i;
 
-    if (!append)
+    if (!append) {
+        stop_playlist_demuxer(mpctx);
         playlist_clear(mpctx->playlist);
+    }
 
     struct playlist_entry *entry = playlist_entry_new(filename);
     if (cmd->args[2].v.str_list) {
@@ -5180,8 +5222,10 @@ static void cmd_loadlist(void *p)
     if (pl) {
         prepare_playlist(mpctx, pl);
         struct playlist_entry *new = pl->current;
-        if (!append)
+        if (!append) {
+            stop_playlist_demuxer(mpctx);
             playlist_clear(mpctx->playlist);
+        }
         struct playlist_entry *first = playlist_entry_from_index(pl, 0);
         int num_entries = pl->num_entries;
         playlist_append_entries(mpctx->playlist, pl);
@@ -5216,6 +5260,7 @@ static void cmd_playlist_clear(void *p)
     // Supposed to clear the playlist, except the currently played item.
     if (mpctx->playlist->current_was_replaced)
         mpctx->playlist->current = NULL;
+    stop_playlist_demuxer(mpctx);
     playlist_clear_except_current(mpctx->playlist);
     mp_notify(mpctx, MP_EVENT_CHANGE_PLAYLIST, NULL);
     mp_wakeup_core(mpctx);
@@ -5285,8 +5330,10 @@ static void cmd_stop(void *p)
     struct MPContext *mpctx = cmd->mpctx;
     int flags = cmd->args[0].v.i;
 
-    if (!(flags & 1))
+    if (!(flags & 1)) {
+        stop_playlist_demuxer(mpctx);
         playlist_clear(mpctx->playlist);
+    }
 
     if (mpctx->opts->player_idle_mode < 2 &&
         mpctx->opts->position_save_on_quit)
@@ -5670,6 +5717,177 @@ static void cmd_align_cache_ab(void *p)
     show_property_osd(mpctx, "ab-loop-b", cmd->on_osd);
 }
 
+static void cmd_cache_pin(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    double start = cmd->args[0].v.d;
+    double end = cmd->args[1].v.d;
+
+    if (!mpctx->demuxer || start >= end) {
+        cmd->success = false;
+        return;
+    }
+
+    struct demux_seek_range pin = {start, end};
+    MP_TARRAY_APPEND(NULL, mpctx->cache_pins, mpctx->num_cache_pins, pin);
+    update_demuxer_cache_pins(mpctx);
+}
+
+static void cmd_cache_pin_chapter(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    int chapter = cmd->args[0].v.i;
+
+    if (chapter < 0)
+        chapter = get_current_chapter(mpctx);
+
+    double start = chapter_start_time(mpctx, chapter);
+    double end = chapter + 1 < get_chapter_count(mpctx)
+               ? chapter_start_time(mpctx, chapter + 1)
+               : get_time_length(mpctx);
+
+    if (!mpctx->demuxer || chapter < 0 || chapter >= get_chapter_count(mpctx) ||
+        start == MP_NOPTS_VALUE || end == MP_NOPTS_VALUE || start >= end)
+    {
+        cmd->success = false;
+        return;
+    }
+
+    struct demux_seek_range pin = {start, end};
+    MP_TARRAY_APPEND(NULL, mpctx->cache_pins, mpctx->num_cache_pins, pin);
+    update_demuxer_cache_pins(mpctx);
+}
+
+static void cmd_cache_unpin_all(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    mpctx->num_cache_pins = 0;
+    update_demuxer_cache_pins(mpctx);
+}
+
+static void cmd_image_cache_clear(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+
+    mp_image_cache_clear(mpctx->image_cache);
+}
+
+static void cmd_thumbnails(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    int count = cmd->args[0].v.i;
+    int columns = cmd->args[2].v.i;
+    char *url = cmd->args[3].v.s;
+    void *tmp = talloc_new(NULL);
+
+    int *widths = NULL;
+    int num_widths = 0;
+    bstr rest = bstr0(cmd->args[1].v.s);
+    while (rest.len) {
+        bstr item;
+        bstr_split_tok(rest, ",", &item, &rest);
+        item = bstr_strip(item);
+        bstr end;
+        long long w = bstrtoll(item, &end, 10);
+        if (end.len || w < 1 || w > 4096) {
+            MP_ERR(mpctx, "thumbnails: invalid width '%.*s'.\n", BSTR_P(item));
+            cmd->success = false;
+            goto done;
+        }
+        MP_TARRAY_APPEND(tmp, widths, num_widths, w);
+    }
+    if (!num_widths) {
+        cmd->success = false;
+        goto done;
+    }
+
+    if (!url || !url[0])
+        url = mpctx->stream_open_filename ? mpctx->stream_open_filename
+                                          : mpctx->filename;
+    if (!url) {
+        cmd->success = false;
+        goto done;
+    }
+    url = talloc_strdup(tmp, url);
+    bool rebase = mpctx->opts->rebase_start_time;
+    struct mp_log *log = mp_log_new(tmp, mpctx->log, "thumbnailer");
+
+    // Decoding the thumbnails can take a long time; let playback continue.
+    mp_core_unlock(mpctx);
+    struct mp_thumbnails *th =
+        mp_thumbnails_generate(tmp, mpctx->global, log, cmd->abort->cancel,
+                               url, count, widths, num_widths, columns, rebase);
+    mp_core_lock(mpctx);
+
+    if (!th) {
+        cmd->success = false;
+        goto done;
+    }
+
+    struct mpv_node *res = &cmd->result;
+    node_init(res, MPV_FORMAT_NODE_MAP, NULL);
+    struct mpv_node *ts = node_map_add(res, "timestamps", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < th->num_thumbnails; n++) {
+        double pts = th->timestamps[n];
+        if (pts == MP_NOPTS_VALUE) {
+            node_array_add(ts, MPV_FORMAT_NONE);
+        } else {
+            node_array_add(ts, MPV_FORMAT_DOUBLE)->u.double_ = pts;
+        }
+    }
+    struct mpv_node *sheets = node_map_add(res, "sheets", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < th->num_sheets; n++) {
+        struct mp_thumbnail_sheet *s = &th->sheets[n];
+        struct mp_image *img = s->image;
+        struct mpv_node *e = node_array_add(sheets, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "w", img->w);
+        node_map_add_int64(e, "h", img->h);
+        node_map_add_int64(e, "stride", img->stride[0]);
+        node_map_add_string(e, "format", "bgr0");
+        node_map_add_int64(e, "tile-w", s->tile_w);
+        node_map_add_int64(e, "tile-h", s->tile_h);
+        node_map_add_int64(e, "columns", s->columns);
+        node_map_add_int64(e, "rows", s->rows);
+        struct mpv_byte_array *ba =
+            node_map_add(e, "data", MPV_FORMAT_BYTE_ARRAY)->u.ba;
+        *ba = (struct mpv_byte_array){
+            .data = img->planes[0],
+            .size = img->stride[0] * img->h,
+        };
+        talloc_steal(ba, img);
+    }
+
+done:
+    talloc_free(tmp);
+}
+
+static void cmd_probe(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    void *tmp = talloc_new(NULL);
+
+    char **urls = talloc_zero_array(tmp, char *, cmd->num_args);
+    for (int n = 0; n < cmd->num_args; n++)
+        urls[n] = talloc_strdup(tmp, cmd->args[n].v.s);
+    bool rebase = mpctx->opts->rebase_start_time;
+
+    // Opening remote files can take a long time; let playback continue.
+    mp_core_unlock(mpctx);
+    bool ok = demux_probe_urls(mpctx->global, mpctx->log, cmd->abort->cancel,
+                               urls, cmd->num_args, rebase, &cmd->result);
+    mp_core_lock(mpctx);
+
+    cmd->success = ok;
+    talloc_free(tmp);
+}
+
 static void cmd_drop_buffers(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -5718,6 +5936,10 @@ static void cmd_filter_command(void *p)
         .arg = cmd->args[2].v.s,
     };
     cmd->success = mp_output_chain_command(chain, cmd->args[0].v.s, &filter_cmd);
+
+    // The filter may produce different output from now on.
+    if (cmd->success && type == STREAM_VIDEO)
+        clear_video_frame_cache(mpctx);
 }
 
 static void cmd_script_binding(void *p)
@@ -5939,18 +6161,26 @@ static void cache_dump_poll(struct MPContext *mpctx)
         // Synchronous abort. In particular, the dump command shall not report
         // completion to the user before the dump target file was closed.
         demux_cache_dump_set(mpctx->demuxer, 0, 0, NULL);
-        assert(demux_cache_dump_get_status(mpctx->demuxer) <= 0);
+        assert(demux_cache_dump_get_status(mpctx->demuxer, NULL) <= 0);
     }
 
-    int status = demux_cache_dump_get_status(mpctx->demuxer);
+    struct demux_cache_dump_progress progress;
+    int status = demux_cache_dump_get_status(mpctx->demuxer, &progress);
     if (status <= 0) {
         if (status < 0) {
             mp_cmd_msg(cmd, MSGL_ERR, "Cache dumping stopped due to error.");
             cmd->success = false;
         } else {
-            mp_cmd_msg(cmd, MSGL_INFO, "Cache dumping successfully ended.");
+            mp_cmd_msg(cmd, MSGL_INFO, "Cache dumping successfully ended "
+                       "(%"PRId64" bytes, %.0f bytes/s).",
+                       progress.bytes_written, progress.bytes_per_second);
             cmd->success = true;
         }
+        node_init(&cmd->result, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(&cmd->result, "packets", progress.packets_written);
+        node_map_add_int64(&cmd->result, "bytes", progress.bytes_written);
+        node_map_add_double(&cmd->result, "bytes-per-second",
+                            progress.bytes_per_second);
         ctx->cache_dump_cmd = NULL;
         mp_cmd_ctx_complete(cmd);
     }
@@ -6445,6 +6675,31 @@ const struct mp_cmd_def mp_cmds[] = {
 
     { "ab-loop-align-cache", cmd_align_cache_ab },
 
+    { "demuxer-cache-pin", cmd_cache_pin, { {"start", OPT_TIME(v.d)},
+                                            {"end", OPT_TIME(v.d)} } },
+    { "demuxer-cache-pin-chapter", cmd_cache_pin_chapter,
+        { {"chapter", OPT_INT(v.i), OPTDEF_INT(-1)} } },
+    { "demuxer-cache-unpin-all", cmd_cache_unpin_all },
+
+    { "image-cache-clear", cmd_image_cache_clear, .spawn_thread = true },
+
+    { "thumbnails", cmd_thumbnails,
+        {
+            {"count", OPT_INT(v.i), M_RANGE(1, 10000)},
+            {"widths", OPT_STRING(v.s)},
+            {"columns", OPT_INT(v.i), M_RANGE(0, 10000), OPTDEF_INT(0)},
+            {"url", OPT_STRING(v.s), .flags = MP_CMD_OPT_ARG},
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+    },
+
+    { "probe", cmd_probe, { {"url", OPT_STRING(v.s)} },
+        .vararg = true,
+        .spawn_thread = true,
+        .can_abort = true,
+    },
+
     {0}
 };
 
@@ -6633,6 +6888,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
         mp_load_builtin_scripts(mpctx);
 
     if (flags & UPDATE_IMGPAR) {
+        // Cached frames were filtered with the old settings (for example
+        // --deinterlace swaps the deinterlacer without recreating the chain).
+        clear_video_frame_cache(mpctx);
         struct track *track = mpctx->current_track[0][STREAM_VIDEO];
         if (track && track->dec) {
             mp_decoder_wrapper_reset_params(track->dec);
@@ -6643,6 +6901,14 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (flags & UPDATE_INPUT)
         mp_input_update_opts(mpctx->input);
 
+    if (init || opt_ptr == &opts->image_buffer_cache_size)
+        mp_image_buffer_set_limit(mpctx->image_buffer_user,
+                                  opts->image_buffer_cache_size);
+
+    if (init || opt_ptr == &opts->image_buffer_huge_pages)
+        mp_image_buffer_set_huge_pages(mpctx->image_buffer_user,
+                                       opts->image_buffer_huge_pages);
+
     if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client) {
         mp_uninit_ipc(mpctx->ipc_ctx);
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
@@ -6741,6 +7007,10 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
         mp_wakeup_core(mpctx);
     }
 
+    if (opt_ptr == &opts->ab_loop[0] || opt_ptr == &opts->ab_loop[1] ||
+        opt_ptr == &opts->ab_loop_count)
+        update_demuxer_cache_pins(mpctx);
+
     if (opt_ptr == &opts->record_file)
         open_recorder(mpctx, false);
 
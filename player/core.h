@@ -231,6 +231,8 @@ typedef struct MPContext {
     struct MPOpts *opts;
     struct mp_log *log;
     struct stats_ctx *stats;
+    struct mp_image_buffer_user *image_buffer_user;
+    struct mp_image_cache *image_cache;
     struct m_config *mconfig;
     struct input_ctx *input;
     struct mp_client_api *clients;
@@ -321,6 +323,19 @@ typedef struct MPContext {
     int num_next_frames;
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
 
+    // Decoded frame cache (--video-frame-cache-size), sorted by pts.
+    struct cached_frame *cached_frames;
+    int num_cached_frames;
+    int64_t cached_frames_bytes;
+    double cache_last_pts;          // last frame read from the filters in order
+    // Frames read from the filters while paused, to be displayed next.
+    struct mp_image **ahead_frames;
+    int num_ahead_frames;
+    // Cached frame to display for the current seek, and the pts up to which
+    // newly decoded frames are dropped because they were already displayed.
+    struct mp_image *cached_seek_frame;
+    double cached_seek_pts;
+
     enum playback_status video_status, audio_status;
     bool restart_complete;
     int play_dir;
@@ -342,6 +357,10 @@ typedef struct MPContext {
     double hrseek_pts;
     struct seek_params current_seek;
     bool ab_loop_clip;      // clip to the "b" part of an A-B loop if available
+    // Spans added with the demuxer-cache-pin commands (the A-B loop is pinned
+    // implicitly). Cleared when the demuxer is closed.
+    struct demux_seek_range *cache_pins;
+    int num_cache_pins;
     // AV sync: the next frame should be shown when the audio out has this
     // much (in seconds) buffered data left. Increased when more data is
     // written to the ao, decreased when moving to the next video frame.
@@ -377,6 +396,7 @@ typedef struct MPContext {
 
     double last_idle_tick;
     double next_cache_update;
+    double next_image_buffer_stats;
 
     double sleeptime;      // number of seconds to sleep before next iteration
 
@@ -454,6 +474,12 @@ typedef struct MPContext {
     //     to true.
     struct demuxer *open_res_demuxer;
     int open_res_error;
+
+    // Playlist demuxer that is still reading entries in the background, and
+    // the playlist entry after which further entries are inserted (reserved).
+    struct demuxer *playlist_demuxer;
+    struct playlist_entry *playlist_demuxer_pos;
+    struct playlist *playlist_demuxer_new; // reused to receive new entries
 } MPContext;
 
 // Contains information about an asynchronous work item, how it can be aborted,
@@ -528,6 +554,8 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
                                     bool force, bool mutate);
 void mp_set_playlist_entry(struct MPContext *mpctx, struct playlist_entry *e);
 void mp_play_files(struct MPContext *mpctx);
+void handle_playlist_demuxer(struct MPContext *mpctx);
+void stop_playlist_demuxer(struct MPContext *mpctx);
 void update_demuxer_properties(struct MPContext *mpctx);
 void print_track_list(struct MPContext *mpctx, const char *msg);
 void reselect_demux_stream(struct MPContext *mpctx, struct track *track,
@@ -555,6 +583,7 @@ double rel_time_to_abs(struct MPContext *mpctx, struct m_rel_time t);
 double get_play_end_pts(struct MPContext *mpctx);
 double get_play_start_pts(struct MPContext *mpctx);
 bool get_ab_loop_times(struct MPContext *mpctx, double t[2]);
+void update_demuxer_cache_pins(struct MPContext *mpctx);
 void merge_playlist_files(struct playlist *pl);
 void update_vo_playback_state(struct MPContext *mpctx);
 void update_window_title(struct MPContext *mpctx, bool force);
@@ -645,6 +674,9 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track);
 void reinit_video_chain(struct MPContext *mpctx);
 void reinit_video_chain_src(struct MPContext *mpctx, struct track *track);
 int reinit_video_filters(struct MPContext *mpctx);
+void clear_video_frame_cache(struct MPContext *mpctx);
+struct mp_image *get_cached_seek_frame(struct MPContext *mpctx, double pts,
+                                       bool backstep);
 void write_video(struct MPContext *mpctx);
 void mp_force_video_refresh(struct MPContext *mpctx);
 void uninit_video_out(struct MPContext *mpctx);
@@ -202,6 +202,10 @@ static void uninit_demuxer(struct MPContext *mpctx)
     mpctx->chapters = NULL;
     mpctx->num_chapters = 0;
 
+    talloc_free(mpctx->cache_pins);
+    mpctx->cache_pins = NULL;
+    mpctx->num_cache_pins = 0;
+
     mp_abort_cache_dumping(mpctx);
 
     struct demuxer **demuxers = NULL;
@@ -970,6 +974,89 @@ static void transfer_playlist(struct MPContext *mpctx, struct playlist *pl,
     }
 }
 
+static void set_playlist_demuxer_pos(struct MPContext *mpctx,
+                                     struct playlist_entry *e)
+{
+    if (e)
+        e->reserved += 1;
+    if (mpctx->playlist_demuxer_pos)
+        playlist_entry_unref(mpctx->playlist_demuxer_pos);
+    mpctx->playlist_demuxer_pos = e;
+}
+
+// Stop reading the playlist in the background. Must be called if the entries
+// around the insertion position are replaced (e.g. the playlist is cleared).
+void stop_playlist_demuxer(struct MPContext *mpctx)
+{
+    if (!mpctx->playlist_demuxer)
+        return;
+    demux_cancel_and_free(mpctx->playlist_demuxer);
+    mpctx->playlist_demuxer = NULL;
+    set_playlist_demuxer_pos(mpctx, NULL);
+    TA_FREEP(&mpctx->playlist_demuxer_new);
+}
+
+// Keep the current (playlist) demuxer around, if it still reads entries.
+static void start_playlist_demuxer(struct MPContext *mpctx,
+                                   struct playlist_entry *last)
+{
+    stop_playlist_demuxer(mpctx);
+
+    struct demuxer *demuxer = mpctx->demuxer;
+    if (!demuxer->playlist_partial)
+        return;
+
+    mpctx->demuxer = NULL;
+    mpctx->playlist_demuxer = demuxer;
+    // Outlives playback of the playlist "file" itself.
+    mp_cancel_set_parent(demuxer->cancel, NULL);
+    demux_set_wakeup_cb(demuxer, wakeup_demux, mpctx);
+    set_playlist_demuxer_pos(mpctx, last);
+    mpctx->playlist_demuxer_new = talloc_zero(NULL, struct playlist);
+}
+
+// Add playlist entries that were read in the background.
+void handle_playlist_demuxer(struct MPContext *mpctx)
+{
+    struct demuxer *demuxer = mpctx->playlist_demuxer;
+    if (!demuxer)
+        return;
+
+    struct playlist_entry *pos = mpctx->playlist_demuxer_pos;
+    if (pos && pos->pl != mpctx->playlist) {
+        // The entry was removed by the user, so the entries that follow it
+        // have no sensible place anymore.
+        stop_playlist_demuxer(mpctx);
+        return;
+    }
+
+    struct playlist *pl = mpctx->playlist_demuxer_new;
+    bool more = demux_playlist_read_more(demuxer, pl);
+
+    if (pl->num_entries) {
+        struct playlist_entry *last = playlist_get_last(pl);
+        playlist_add_redirect(pl, demuxer->filename);
+        playlist_transfer_entries_after(mpctx->playlist, pos, pl);
+        set_playlist_demuxer_pos(mpctx, last);
+        mp_notify_property(mpctx, "playlist");
+    }
+
+    if (!more) {
+        MP_VERBOSE(mpctx, "Playlist was read completely.\n");
+        stop_playlist_demuxer(mpctx);
+    }
+}
+
+// If the end of the playlist was reached, but a playlist is still read in the
+// background, wait until there is a next entry.
+static void wait_playlist_demuxer(struct MPContext *mpctx)
+{
+    enum stop_play_reason reason = mpctx->stop_play;
+    while (mpctx->playlist_demuxer && mpctx->stop_play == reason &&
+           !playlist_get_next(mpctx->playlist, +1))
+        mp_idle(mpctx);
+}
+
 static void process_hooks(struct MPContext *mpctx, char *name)
 {
     mp_hook_start(mpctx, name);
@@ -1527,8 +1614,10 @@ static void play_current_file(struct MPContext *mpctx)
 
     if (mpctx->demuxer->playlist) {
         struct playlist *pl = mpctx->demuxer->playlist;
+        struct playlist_entry *last = playlist_get_last(pl);
         transfer_playlist(mpctx, pl, &end_event.playlist_insert_id,
                           &end_event.playlist_insert_num_entries);
+        start_playlist_demuxer(mpctx, last);
         mp_notify_property(mpctx, "playlist");
         mpctx->error_playing = 2;
         goto terminate_playback;
@@ -1537,6 +1626,7 @@ static void play_current_file(struct MPContext *mpctx)
     if (mpctx->opts->rebase_start_time)
         demux_set_ts_offset(mpctx->demuxer, -mpctx->demuxer->start_time);
     enable_demux_thread(mpctx, mpctx->demuxer);
+    update_demuxer_cache_pins(mpctx);
 
     add_demuxer_tracks(mpctx, mpctx->demuxer);
 
@@ -1867,6 +1957,10 @@ void mp_play_files(struct MPContext *mpctx)
         if (mpctx->stop_play == PT_QUIT)
             break;
 
+        if (mpctx->stop_play == PT_NEXT_ENTRY || mpctx->stop_play == PT_ERROR ||
+            mpctx->stop_play == AT_END_OF_FILE)
+            wait_playlist_demuxer(mpctx);
+
         struct playlist_entry *new_entry = NULL;
         if (mpctx->stop_play == PT_NEXT_ENTRY || mpctx->stop_play == PT_ERROR ||
             mpctx->stop_play == AT_END_OF_FILE)
@@ -1885,6 +1979,7 @@ void mp_play_files(struct MPContext *mpctx)
     }
 
     cancel_open(mpctx);
+    stop_playlist_demuxer(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         // Make sure all streams get finished.
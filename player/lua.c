@@ -28,6 +28,9 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include <libavutil/md5.h>
+#include <libavutil/mem.h>
+
 #include "osdep/io.h"
 
 #include "mpv_talloc.h"
@@ -37,6 +40,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "common/stats.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "input/input.h"
 #include "options/path.h"
@@ -51,6 +55,7 @@
 #include "command.h"
 #include "client.h"
 #include "libmpv/client.h"
+#include "lua_bytecode.h"
 
 // List of builtin modules and their contents as strings.
 // All these are generated from player/lua/*.lua
@@ -82,6 +87,20 @@ static const char * const builtin_lua_scripts[][2] = {
     {0}
 };
 
+struct lua_opts {
+    char *bytecode_cache_dir;
+};
+
+#define OPT_BASE_STRUCT struct lua_opts
+const struct m_sub_options lua_conf = {
+    .opts = (const struct m_option[]) {
+        {"lua-bytecode-cache-dir", OPT_STRING(bytecode_cache_dir),
+            .flags = M_OPT_FILE},
+        {0}
+    },
+    .size = sizeof(struct lua_opts),
+};
+
 // Represents a loaded script. Each has its own Lua state.
 struct script_ctx {
     const char *name;
@@ -95,6 +114,7 @@ struct script_ctx {
     lua_Alloc lua_allocf;
     void *lua_alloc_ud;
     struct stats_ctx *stats;
+    char *bytecode_cache_dir; // NULL if disabled
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -244,6 +264,121 @@ static int check_error(lua_State *L, int err)
 
 static void add_functions(struct script_ctx *ctx);
 
+struct bytecode_buf {
+    void *ta_parent;    // owns data.start
+    bstr data;
+};
+
+static int bytecode_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    struct bytecode_buf *buf = ud;
+    bstr_xappend(buf->ta_parent, &buf->data, (bstr){(unsigned char *)p, sz});
+    return 0;
+}
+
+static bstr read_bytecode(void *talloc_ctx, const char *fname)
+{
+    bstr res = {0};
+    FILE *f = fopen(fname, "rb");
+    if (!f)
+        return res;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        if (size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+            res.start = talloc_size(talloc_ctx, size);
+            res.len = fread(res.start, 1, size, f);
+            if (res.len != size)
+                res = (bstr){0};
+        }
+    }
+    fclose(f);
+    return res;
+}
+
+static void write_bytecode(struct mp_log *log, const char *fname, bstr data)
+{
+    char *tmpname = talloc_asprintf(NULL, "%s-XXXXXX", fname);
+    int fd = mp_mkostemps(tmpname, 0, O_CLOEXEC);
+    if (fd < 0) {
+        mp_verbose(log, "Could not create %s\n", tmpname);
+        talloc_free(tmpname);
+        return;
+    }
+    bool ok = write(fd, data.start, data.len) == data.len;
+    ok &= close(fd) == 0;
+    // Rename atomically, as other scripts may load the same module right now.
+    if (!ok || rename(tmpname, fname)) {
+        mp_verbose(log, "Could not write %s\n", fname);
+        unlink(tmpname);
+    }
+    talloc_free(tmpname);
+}
+
+// Like luaL_loadbuffer(), but use the precompiled bytecode if it was cached
+// in cache_dir before, and add it to the cache otherwise. The cache is keyed
+// by the hash of the chunk name and source, so changed scripts simply produce
+// a new entry.
+int mp_lua_load_cached(lua_State *L, struct mp_log *log, const char *cache_dir,
+                       const char *buf, size_t len, const char *chunkname)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct AVMD5 *md5 = av_md5_alloc();
+    if (!md5) {
+        talloc_free(tmp);
+        return luaL_loadbuffer(L, buf, len, chunkname);
+    }
+    uint8_t hash[16];
+    av_md5_init(md5);
+    // Bytecode is not portable between Lua implementations and versions.
+    av_md5_update(md5, LUA_RELEASE, sizeof(LUA_RELEASE));
+#ifdef LUAJIT_VERSION
+    av_md5_update(md5, LUAJIT_VERSION, sizeof(LUAJIT_VERSION));
+#endif
+    av_md5_update(md5, chunkname, strlen(chunkname) + 1);
+    av_md5_update(md5, buf, len);
+    av_md5_final(md5, hash);
+    av_free(md5);
+
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02x", hash[i]);
+    name = talloc_strdup_append(name, ".luac");
+    char *fname = mp_path_join(tmp, cache_dir, name);
+
+    bstr bc = read_bytecode(tmp, fname);
+    if (bc.len && luaL_loadbuffer(L, bc.start, bc.len, chunkname) == 0) {
+        mp_dbg(log, "using cached bytecode %s for %s\n", fname, chunkname);
+        talloc_free(tmp);
+        return 0;
+    }
+    if (bc.len) {
+        mp_verbose(log, "ignoring invalid cached bytecode %s\n", fname);
+        lua_pop(L, 1); // error message
+    }
+
+    int r = luaL_loadbuffer(L, buf, len, chunkname);
+    if (r == 0) {
+        // Allocated on tmp, so it's freed even if lua_dump() fails midway.
+        struct bytecode_buf bc_out = {.ta_parent = tmp};
+        if (lua_dump(L, bytecode_writer, &bc_out) == 0 && bc_out.data.len)
+            write_bytecode(log, fname, bc_out.data);
+    }
+
+    talloc_free(tmp);
+    return r;
+}
+
+static int load_buffer(lua_State *L, const char *buf, size_t len,
+                       const char *chunkname)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    if (!ctx->bytecode_cache_dir)
+        return luaL_loadbuffer(L, buf, len, chunkname);
+    return mp_lua_load_cached(L, ctx->log, ctx->bytecode_cache_dir, buf, len,
+                              chunkname);
+}
+
 static void load_file(lua_State *L, const char *fname)
 {
     struct script_ctx *ctx = get_ctx(L);
@@ -254,7 +389,7 @@ static void load_file(lua_State *L, const char *fname)
     struct bstr s = stream_read_file(fname, tmp, ctx->mpctx->global, 100000000);
     if (!s.start)
         luaL_error(L, "Could not read file.\n");
-    if (luaL_loadbuffer(L, s.start, s.len, dispname))
+    if (load_buffer(L, s.start, s.len, dispname))
         lua_error(L);
     lua_call(L, 0, 1);
     talloc_free(tmp);
@@ -268,7 +403,7 @@ static int load_builtin(lua_State *L)
     for (int n = 0; builtin_lua_scripts[n][0]; n++) {
         if (strcmp(name, builtin_lua_scripts[n][0]) == 0) {
             const char *script = builtin_lua_scripts[n][1];
-            if (luaL_loadbuffer(L, script, strlen(script), dispname))
+            if (load_buffer(L, script, strlen(script), dispname))
                 lua_error(L);
             lua_call(L, 0, 1);
             return 1;
@@ -452,6 +587,15 @@ static int load_lua(struct mp_script_args *args)
 
     stats_register_thread_cputime(ctx->stats, "cpu");
 
+    struct lua_opts *opts = mp_get_config_group(ctx, ctx->mpctx->global,
+                                                &lua_conf);
+    if (opts->bytecode_cache_dir && opts->bytecode_cache_dir[0]) {
+        ctx->bytecode_cache_dir =
+            mp_get_user_path(ctx, ctx->mpctx->global, opts->bytecode_cache_dir);
+        mp_mkdirp(ctx->bytecode_cache_dir);
+    }
+    talloc_free(opts);
+
     if (LUA_VERSION_NUM != 501 && LUA_VERSION_NUM != 502) {
         MP_FATAL(ctx, "Only Lua 5.1 and 5.2 are supported.\n");
         goto error_out;
@@ -876,7 +1020,7 @@ static void pushnode(lua_State *L, mpv_node *node)
         lua_pushboolean(L, node->u.flag);
         break;
     case MPV_FORMAT_NODE_ARRAY:
-        lua_newtable(L); // table
+        lua_createtable(L, node->u.list->num, 0); // table
         lua_getfield(L, LUA_REGISTRYINDEX, "ARRAY"); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
@@ -885,7 +1029,7 @@ static void pushnode(lua_State *L, mpv_node *node)
         }
         break;
     case MPV_FORMAT_NODE_MAP:
-        lua_newtable(L); // table
+        lua_createtable(L, 0, node->u.list->num); // table
         lua_getfield(L, LUA_REGISTRYINDEX, "MAP"); // table mt
         lua_setmetatable(L, -2); // table
         for (int n = 0; n < node->u.list->num; n++) {
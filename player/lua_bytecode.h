@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+struct lua_State;
+struct mp_log;
+
+// Load a chunk like luaL_loadbuffer(), but cache its bytecode in cache_dir.
+// Implemented in lua.c (exported for tests).
+int mp_lua_load_cached(struct lua_State *L, struct mp_log *log,
+                       const char *cache_dir, const char *buf, size_t len,
+                       const char *chunkname);
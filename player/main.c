@@ -57,6 +57,8 @@
 #include "misc/thread_tools.h"
 #include "sub/osd.h"
 #include "test/tests.h"
+#include "video/image_buffer.h"
+#include "video/image_cache.h"
 #include "video/out/vo.h"
 
 #include "core.h"
@@ -174,6 +176,12 @@ void mp_destroy(struct MPContext *mpctx)
 
     mp_clients_destroy(mpctx);
 
+    // Frees all cached image buffers if this was the last player instance.
+    TA_FREEP(&mpctx->image_buffer_user);
+
+    // Waits until pending image cache entries are written.
+    TA_FREEP(&mpctx->image_cache);
+
     osd_free(mpctx->osd);
 
 #if HAVE_COCOA
@@ -277,6 +285,8 @@ struct MPContext *mp_create(void)
 
     mpctx->stats = stats_ctx_create(mpctx, mpctx->global, "main");
 
+    mpctx->image_buffer_user = mp_image_buffer_user_create(NULL);
+
     // Create the config context and register the options
     mpctx->mconfig = m_config_new(mpctx, mpctx->log, &mp_opt_root);
     mpctx->opts = mpctx->mconfig->optstruct;
@@ -288,6 +298,8 @@ struct MPContext *mp_create(void)
     mpctx->mconfig->global = mpctx->global;
     m_config_parse(mpctx->mconfig, "", bstr0(def_config), NULL, 0);
 
+    mpctx->image_cache = mp_image_cache_create(NULL, mpctx->global, mpctx->log);
+
     mpctx->input = mp_input_init(mpctx->global, mp_wakeup_core_cb, mpctx);
     screenshot_init(mpctx);
     command_init(mpctx);
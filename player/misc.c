@@ -141,6 +141,28 @@ bool get_ab_loop_times(struct MPContext *mpctx, double t[2])
     return true;
 }
 
+// Pass the spans that --demuxer-cache-eviction=pinned should keep to the
+// demuxer: the user-pinned spans, and the A-B loop.
+void update_demuxer_cache_pins(struct MPContext *mpctx)
+{
+    if (!mpctx->demuxer)
+        return;
+
+    struct demux_seek_range *pins =
+        talloc_memdup(NULL, mpctx->cache_pins,
+                      sizeof(pins[0]) * mpctx->num_cache_pins);
+    int num_pins = mpctx->num_cache_pins;
+
+    double ab[2];
+    if (get_ab_loop_times(mpctx, ab)) {
+        struct demux_seek_range pin = {MPMIN(ab[0], ab[1]), MPMAX(ab[0], ab[1])};
+        MP_TARRAY_APPEND(NULL, pins, num_pins, pin);
+    }
+
+    demux_set_cache_pins(mpctx->demuxer, pins, num_pins);
+    talloc_free(pins);
+}
+
 double get_track_seek_offset(struct MPContext *mpctx, struct track *track)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -48,6 +48,7 @@
 #include "stream/stream.h"
 #include "sub/dec_sub.h"
 #include "sub/osd.h"
+#include "video/image_buffer.h"
 #include "video/out/vo.h"
 
 // Wait until mp_wakeup_core() is called, since the last time
@@ -344,11 +345,20 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
 
     demux_flags |= SEEK_BLOCK;
 
+    // The decoder still needs to be restarted at the new position, but the
+    // target frame can be displayed immediately if it's cached.
+    struct mp_image *cached_frame = NULL;
+    if (hr_seek && play_dir > 0) {
+        cached_frame = get_cached_seek_frame(mpctx, seek_pts,
+                                             seek.type == MPSEEK_BACKSTEP);
+    }
+
     if (!demux_seek(mpctx->demuxer, demux_pts, demux_flags)) {
         if (!mpctx->demuxer->seekable) {
             MP_ERR(mpctx, "Cannot seek in this stream.\n");
             MP_ERR(mpctx, "You can force it with '--force-seekable=yes'.\n");
         }
+        talloc_free(cached_frame);
         return;
     }
 
@@ -391,6 +401,13 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         mpctx->hrseek_backstep = seek.type == MPSEEK_BACKSTEP;
         mpctx->hrseek_pts = seek_pts * mpctx->play_dir;
 
+        if (cached_frame) {
+            MP_VERBOSE(mpctx, "using cached frame at %f\n", cached_frame->pts);
+            mpctx->hrseek_pts = cached_frame->pts;
+            mpctx->hrseek_backstep = false;
+            mpctx->cached_seek_frame = cached_frame;
+        }
+
         // allow decoder to drop frames before hrseek_pts
         bool hrseek_framedrop = !hr_seek_very_exact && opts->hr_seek_framedrop;
 
@@ -1193,6 +1210,24 @@ static void handle_eof(struct MPContext *mpctx)
     }
 }
 
+// The image buffer cache is shared between threads (and player instances), so
+// don't poll it on every iteration. This doesn't wake up the player by itself.
+static void update_image_buffer_stats(struct MPContext *mpctx)
+{
+    double now = mp_time_sec();
+    if (now < mpctx->next_image_buffer_stats)
+        return;
+    mpctx->next_image_buffer_stats = now + 1;
+
+    struct mp_image_buffer_stats bst;
+    mp_image_buffer_get_stats(&bst);
+    stats_value(mpctx->stats, "image-buffer-hits", bst.hits);
+    stats_value(mpctx->stats, "image-buffer-misses", bst.misses);
+    stats_size_value(mpctx->stats, "image-buffer-cached", bst.cached_bytes);
+    stats_size_value(mpctx->stats, "image-buffer-used", bst.used_bytes);
+    stats_size_value(mpctx->stats, "image-buffer-huge", bst.huge_bytes);
+}
+
 void run_playloop(struct MPContext *mpctx)
 {
     if (encode_lavc_didfail(mpctx->encode_lavc_ctx)) {
@@ -1248,6 +1283,10 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_update_cache(mpctx);
 
+    update_image_buffer_stats(mpctx);
+
+    handle_playlist_demuxer(mpctx);
+
     mp_process_input(mpctx);
 
     handle_chapter_change(mpctx);
@@ -1262,6 +1301,8 @@ void mp_idle(struct MPContext *mpctx)
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
     handle_update_cache(mpctx);
+    update_image_buffer_stats(mpctx);
+    handle_playlist_demuxer(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     update_osd_msg(mpctx);
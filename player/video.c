@@ -62,6 +62,124 @@ static const char av_desync_help_text[] =
 "position will not match to the video (see A-V status field).\n"
 "\n";
 
+// Entry in mpctx->cached_frames.
+struct cached_frame {
+    struct mp_image *img;
+    // pts of the frame that preceded this frame in the filter output, or
+    // MP_NOPTS_VALUE if unknown (first frame after a seek).
+    double prev_pts;
+};
+
+static bool frame_cache_enabled(struct MPContext *mpctx)
+{
+    return mpctx->opts->video_frame_cache_size > 0 && mpctx->play_dir > 0 &&
+           mpctx->vo_chain && !mpctx->vo_chain->is_sparse &&
+           !mpctx->vo_chain->is_coverart;
+}
+
+void clear_video_frame_cache(struct MPContext *mpctx)
+{
+    for (int n = 0; n < mpctx->num_cached_frames; n++)
+        talloc_free(mpctx->cached_frames[n].img);
+    mpctx->num_cached_frames = 0;
+    mpctx->cached_frames_bytes = 0;
+    mpctx->cache_last_pts = MP_NOPTS_VALUE;
+}
+
+static void remove_cached_frame(struct MPContext *mpctx, int index)
+{
+    struct cached_frame *e = &mpctx->cached_frames[index];
+    mpctx->cached_frames_bytes -= mp_image_approx_byte_size(e->img);
+    talloc_free(e->img);
+    MP_TARRAY_REMOVE_AT(mpctx->cached_frames, mpctx->num_cached_frames, index);
+}
+
+// Add a new reference to img to the frame cache. Must be called for every
+// frame read from the filters, in order.
+static void cache_video_frame(struct MPContext *mpctx, struct mp_image *img)
+{
+    double prev_pts = mpctx->cache_last_pts;
+    if (prev_pts == img->pts)
+        return; // same frame read again (mp_pin_out_unread())
+    mpctx->cache_last_pts = img->pts;
+
+    // Holding on to hw surfaces could starve the decoder.
+    if (!frame_cache_enabled(mpctx) || img->hwctx || img->pts == MP_NOPTS_VALUE)
+        return;
+
+    int index = 0;
+    while (index < mpctx->num_cached_frames &&
+           mpctx->cached_frames[index].img->pts < img->pts)
+        index++;
+    if (index < mpctx->num_cached_frames &&
+        mpctx->cached_frames[index].img->pts == img->pts)
+    {
+        if (prev_pts == MP_NOPTS_VALUE)
+            prev_pts = mpctx->cached_frames[index].prev_pts;
+        remove_cached_frame(mpctx, index);
+    }
+
+    struct mp_image *ref = mp_image_new_ref(img);
+    if (!ref)
+        return;
+    struct cached_frame e = {.img = ref, .prev_pts = prev_pts};
+    MP_TARRAY_INSERT_AT(mpctx, mpctx->cached_frames, mpctx->num_cached_frames,
+                        index, e);
+    mpctx->cached_frames_bytes += mp_image_approx_byte_size(ref);
+
+    // Evict the frames farthest away from the new frame.
+    while (mpctx->cached_frames_bytes > mpctx->opts->video_frame_cache_size &&
+           mpctx->num_cached_frames > 1)
+    {
+        int last = mpctx->num_cached_frames - 1;
+        double pts = img->pts;
+        bool first = pts - mpctx->cached_frames[0].img->pts >
+                     mpctx->cached_frames[last].img->pts - pts;
+        remove_cached_frame(mpctx, first ? 0 : last);
+    }
+}
+
+static struct cached_frame *find_cached_frame(struct MPContext *mpctx,
+                                              double pts)
+{
+    for (int n = 0; n < mpctx->num_cached_frames; n++) {
+        if (mpctx->cached_frames[n].img->pts == pts)
+            return &mpctx->cached_frames[n];
+    }
+    return NULL;
+}
+
+// Return a new reference to the frame a hr-seek to pts would display, if it's
+// in the frame cache. With backstep, return the frame before the currently
+// displayed frame instead. Returns NULL if no cached frame can be used.
+struct mp_image *get_cached_seek_frame(struct MPContext *mpctx, double pts,
+                                       bool backstep)
+{
+    if (!frame_cache_enabled(mpctx))
+        return NULL;
+
+    if (backstep) {
+        struct cached_frame *cur = find_cached_frame(mpctx, mpctx->video_pts);
+        if (!cur || cur->prev_pts == MP_NOPTS_VALUE)
+            return NULL;
+        struct cached_frame *prev = find_cached_frame(mpctx, cur->prev_pts);
+        return prev ? mp_image_new_ref(prev->img) : NULL;
+    }
+
+    // Must be the same frame video_output_image() would pick.
+    double min_pts = pts - .005;
+    for (int n = 0; n < mpctx->num_cached_frames; n++) {
+        struct cached_frame *e = &mpctx->cached_frames[n];
+        if (e->img->pts >= min_pts) {
+            // Make sure there's no uncached frame between target and e.
+            if (e->prev_pts == MP_NOPTS_VALUE || e->prev_pts >= min_pts)
+                return NULL;
+            return mp_image_new_ref(e->img);
+        }
+    }
+    return NULL;
+}
+
 static bool recreate_video_filters(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -81,6 +199,8 @@ int reinit_video_filters(struct MPContext *mpctx)
     if (!recreate_video_filters(mpctx))
         return -1;
 
+    clear_video_frame_cache(mpctx);
+
     mp_force_video_refresh(mpctx);
 
     mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
@@ -108,6 +228,12 @@ void reset_video_state(struct MPContext *mpctx)
         mp_image_unrefp(&mpctx->next_frames[n]);
     mpctx->num_next_frames = 0;
     mp_image_unrefp(&mpctx->saved_frame);
+    for (int n = 0; n < mpctx->num_ahead_frames; n++)
+        talloc_free(mpctx->ahead_frames[n]);
+    mpctx->num_ahead_frames = 0;
+    mp_image_unrefp(&mpctx->cached_seek_frame);
+    mpctx->cached_seek_pts = MP_NOPTS_VALUE;
+    mpctx->cache_last_pts = MP_NOPTS_VALUE;
 
     mpctx->delay = 0;
     mpctx->time_frame = 0;
@@ -157,6 +283,7 @@ void uninit_video_chain(struct MPContext *mpctx)
 {
     if (mpctx->vo_chain) {
         reset_video_state(mpctx);
+        clear_video_frame_cache(mpctx);
         vo_chain_uninit(mpctx->vo_chain);
         mpctx->vo_chain = NULL;
 
@@ -264,8 +391,10 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
         vo_c->is_coverart = !!track->attached_picture;
         vo_c->is_sparse = track->stream->still_image || vo_c->is_coverart;
 
-        if (vo_c->is_coverart)
+        if (vo_c->is_coverart) {
             mp_decoder_wrapper_set_coverart_flag(track->dec, true);
+            mp_decoder_wrapper_set_image_cache(track->dec, mpctx->image_cache);
+        }
 
         track->vo_c = vo_c;
         vo_c->track = track;
@@ -463,6 +592,79 @@ static bool have_new_frame(struct MPContext *mpctx, bool eof)
     return mpctx->num_next_frames >= get_req_frames(mpctx, eof);
 }
 
+// Read the next frame from the filters (or from the frames read ahead).
+static struct mp_frame read_video_frame(struct MPContext *mpctx, bool *ahead)
+{
+    *ahead = mpctx->num_ahead_frames > 0;
+    if (*ahead) {
+        struct mp_image *img = mpctx->ahead_frames[0];
+        MP_TARRAY_REMOVE_AT(mpctx->ahead_frames, mpctx->num_ahead_frames, 0);
+        return MAKE_FRAME(MP_FRAME_VIDEO, img);
+    }
+
+    struct mp_frame frame = mp_pin_out_read(mpctx->vo_chain->filter->f->pins[1]);
+    if (frame.type == MP_FRAME_VIDEO)
+        cache_video_frame(mpctx, frame.data);
+    return frame;
+}
+
+static void unread_video_frame(struct MPContext *mpctx, struct mp_frame frame,
+                               bool ahead)
+{
+    if (ahead) {
+        MP_TARRAY_INSERT_AT(mpctx, mpctx->ahead_frames, mpctx->num_ahead_frames,
+                            0, frame.data);
+    } else {
+        mp_pin_out_unread(mpctx->vo_chain->filter->f->pins[1], frame);
+    }
+}
+
+// Whether img was already displayed from the frame cache.
+static bool drop_cached_seek_frame(struct MPContext *mpctx,
+                                   struct mp_image *img)
+{
+    if (mpctx->cached_seek_pts == MP_NOPTS_VALUE)
+        return false;
+    if (img->pts != MP_NOPTS_VALUE && img->pts <= mpctx->cached_seek_pts)
+        return true;
+    mpctx->cached_seek_pts = MP_NOPTS_VALUE;
+    return false;
+}
+
+// While paused, decode frames following the current frame into the frame
+// cache, so stepping forward or unpausing can use them immediately.
+static void prefetch_video_frames(struct MPContext *mpctx)
+{
+    if (!frame_cache_enabled(mpctx) || mpctx->cached_seek_frame)
+        return;
+
+    // Use at most half of the cache for this.
+    int64_t max_bytes = mpctx->opts->video_frame_cache_size / 2;
+    int64_t bytes = 0;
+    for (int n = 0; n < mpctx->num_ahead_frames; n++)
+        bytes += mp_image_approx_byte_size(mpctx->ahead_frames[n]);
+
+    while (bytes < max_bytes) {
+        struct mp_frame frame = mp_pin_out_read(mpctx->vo_chain->filter->f->pins[1]);
+        if (frame.type != MP_FRAME_VIDEO) {
+            if (frame.type)
+                mp_pin_out_unread(mpctx->vo_chain->filter->f->pins[1], frame);
+            break;
+        }
+        struct mp_image *img = frame.data;
+        cache_video_frame(mpctx, img);
+        if (drop_cached_seek_frame(mpctx, img)) {
+            talloc_free(img);
+            continue;
+        }
+        bytes += mp_image_approx_byte_size(img);
+        MP_TARRAY_APPEND(mpctx, mpctx->ahead_frames, mpctx->num_ahead_frames,
+                         img);
+        if (img->hwctx)
+            break;
+    }
+}
+
 // Fill mpctx->next_frames[] with a newly filtered or decoded image.
 // logical_eof: is set to true if there is EOF after currently queued frames
 // returns VD_* code
@@ -490,6 +692,17 @@ static int video_output_image(struct MPContext *mpctx, bool *logical_eof)
         hrseek = false;
     }
 
+    // Display the frame for a seek satisfied by the frame cache right away,
+    // without waiting for the decoder to catch up.
+    if (mpctx->cached_seek_frame && !mpctx->num_next_frames) {
+        struct mp_image *img = mpctx->cached_seek_frame;
+        mpctx->cached_seek_frame = NULL;
+        mpctx->cached_seek_pts = img->pts;
+        mp_image_unrefp(&mpctx->saved_frame);
+        add_new_frame(mpctx, img);
+        return VD_NEW_FRAME;
+    }
+
     if (have_new_frame(mpctx, false))
         return VD_NEW_FRAME;
 
@@ -498,7 +711,8 @@ static int video_output_image(struct MPContext *mpctx, bool *logical_eof)
     if (needs_new_frame(mpctx)) {
         // Filter a new frame.
         struct mp_image *img = NULL;
-        struct mp_frame frame = mp_pin_out_read(vo_c->filter->f->pins[1]);
+        bool ahead = false;
+        struct mp_frame frame = read_video_frame(mpctx, &ahead);
         if (frame.type == MP_FRAME_NONE) {
             r = vo_c->filter->got_output_eof ? VD_EOF : VD_WAIT;
         } else if (frame.type == MP_FRAME_EOF) {
@@ -518,9 +732,11 @@ static int video_output_image(struct MPContext *mpctx, bool *logical_eof)
             if ((endpts != MP_NOPTS_VALUE && img->pts >= endpts) ||
                 mpctx->max_frames == 0)
             {
-                mp_pin_out_unread(vo_c->filter->f->pins[1], frame);
+                unread_video_frame(mpctx, frame, ahead);
                 img = NULL;
                 r = VD_EOF;
+            } else if (drop_cached_seek_frame(mpctx, img)) {
+                // already displayed - skip
             } else if (hrseek && (img->pts < hrseek_pts - tolerance ||
                                   mpctx->hrseek_lastframe))
             {
@@ -1015,8 +1231,10 @@ void write_video(struct MPContext *mpctx)
     if (mpctx->video_status == STATUS_READY)
         return;
 
-    if (mpctx->paused && mpctx->video_status >= STATUS_READY)
+    if (mpctx->paused && mpctx->video_status >= STATUS_READY) {
+        prefetch_video_frames(mpctx);
         return;
+    }
 
     bool logical_eof = false;
     int r = video_output_image(mpctx, &logical_eof);
@@ -0,0 +1,101 @@
+#include <limits.h>
+
+#include "common/common.h"
+#include "libmpv/client.h"
+#include "tests.h"
+
+// Size of the per-client event ring buffer (see mp_new_client()).
+#define QUEUE_SIZE 1000
+
+// Read and discard all events that are currently pending.
+static void drain(mpv_handle *h)
+{
+    while (1) {
+        int num = 0;
+        mpv_wait_events(h, 0, INT_MAX, &num);
+        if (!num)
+            break;
+    }
+}
+
+static void run(struct test_ctx *ctx)
+{
+    mpv_handle *h = mpv_create();
+    assert_true(h);
+    assert_int_equal(mpv_set_option_string(h, "load-scripts", "no"), 0);
+    assert_int_equal(mpv_initialize(h), 0);
+    drain(h);
+
+    // Overflow the queue with client messages (sent to all clients,
+    // including the sender).
+    int num_sent = QUEUE_SIZE + 234;
+    const char *cmd[] = {"script-message", "test", NULL};
+    for (int n = 0; n < num_sent; n++)
+        assert_int_equal(mpv_command(h, cmd), 0);
+
+    // A huge max_events must be clamped, and must not return more events
+    // than could be queued.
+    int num = 0;
+    mpv_event *ev = mpv_wait_events(h, 0, INT_MAX, &num);
+    assert_true(ev);
+    assert_true(num > 0 && num <= QUEUE_SIZE);
+
+    int num_messages = 0;
+    mpv_event_queue_overflow overflow = {0};
+    bool got_overflow = false;
+    while (num) {
+        for (int n = 0; n < num; n++) {
+            if (ev[n].event_id == MPV_EVENT_CLIENT_MESSAGE)
+                num_messages++;
+            if (ev[n].event_id == MPV_EVENT_QUEUE_OVERFLOW) {
+                assert_false(got_overflow);
+                assert_true(ev[n].data);
+                overflow = *(mpv_event_queue_overflow *)ev[n].data;
+                got_overflow = true;
+
+                mpv_node node;
+                assert_int_equal(mpv_event_to_node(&node, &ev[n]), 0);
+                assert_int_equal(node.format, MPV_FORMAT_NODE_MAP);
+                mpv_free_node_contents(&node);
+            }
+        }
+        ev = mpv_wait_events(h, 0, QUEUE_SIZE * 10, &num);
+    }
+
+    assert_true(got_overflow);
+    assert_true(num_messages <= QUEUE_SIZE);
+    // Every message was either delivered or counted as dropped. (Unrelated
+    // events may have been dropped as well.)
+    assert_true(num_messages + overflow.dropped_events >= num_sent);
+    assert_int_equal(overflow.total_dropped_events, overflow.dropped_events);
+
+    // The total accumulates over multiple overflows.
+    for (int n = 0; n < num_sent; n++)
+        assert_int_equal(mpv_command(h, cmd), 0);
+    got_overflow = false;
+    mpv_event_queue_overflow overflow2 = {0};
+    do {
+        ev = mpv_wait_events(h, 0, QUEUE_SIZE, &num);
+        for (int n = 0; n < num; n++) {
+            if (ev[n].event_id == MPV_EVENT_QUEUE_OVERFLOW) {
+                overflow2 = *(mpv_event_queue_overflow *)ev[n].data;
+                got_overflow = true;
+            }
+        }
+    } while (num);
+    assert_true(got_overflow);
+    assert_int_equal(overflow2.total_dropped_events,
+                     overflow.total_dropped_events + overflow2.dropped_events);
+
+    // Values below 1 are treated as 1.
+    assert_int_equal(mpv_command(h, cmd), 0);
+    mpv_wait_events(h, 0, -5, &num);
+    assert_int_equal(num, 1);
+
+    mpv_terminate_destroy(h);
+}
+
+const struct unittest test_client_events = {
+    .name = "client-events",
+    .run = run,
+};
@@ -0,0 +1,109 @@
+#include <stdio.h>
+
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "misc/thread_tools.h"
+#include "options/m_config_frontend.h"
+#include "stream/stream.h"
+#include "tests.h"
+
+#define FRAME_W 64
+#define FRAME_H 64
+#define NUM_FRAMES 200
+
+static void set_opt(struct test_ctx *ctx, const char *name, const char *value)
+{
+    m_config_backup_opt(ctx->config, name);
+    int r = m_config_set_option_cli(ctx->config, bstr0(name), bstr0(value), 0);
+    assert_true(r >= 0);
+}
+
+static double cache_start(struct demuxer *d)
+{
+    struct demux_reader_state st;
+    demux_get_reader_state(d, &st);
+    assert_int_equal(st.num_seek_ranges, 1);
+    return st.seek_ranges[0].start;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    char *path = talloc_asprintf(NULL, "%s/demux-spill.raw", ctx->out_path);
+    FILE *f = fopen(path, "wb");
+    assert_true(f);
+    static uint8_t frame[FRAME_W * FRAME_H];
+    for (int n = 0; n < NUM_FRAMES; n++) {
+        memset(frame, n, sizeof(frame));
+        assert_int_equal(fwrite(frame, sizeof(frame), 1, f), 1);
+    }
+    fclose(f);
+
+    set_opt(ctx, "demuxer-rawvideo-w", "64");
+    set_opt(ctx, "demuxer-rawvideo-h", "64");
+    set_opt(ctx, "demuxer-rawvideo-mp-format", "gray");
+    set_opt(ctx, "demuxer-rawvideo-fps", "25");
+    set_opt(ctx, "cache", "yes");
+    set_opt(ctx, "cache-dir", ctx->out_path);
+    set_opt(ctx, "cache-spill-to-disk", "yes");
+    set_opt(ctx, "demuxer-seekable-cache", "yes");
+    set_opt(ctx, "demuxer-donate-buffer", "no");
+    set_opt(ctx, "demuxer-max-bytes", "16MiB");
+    // Room for about 16 frames; most of the file must be spilled.
+    set_opt(ctx, "demuxer-max-back-bytes", "64KiB");
+
+    struct mp_cancel *cancel = mp_cancel_new(NULL);
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .force_format = "rawvideo",
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+    };
+    struct demuxer *d = demux_open_url(path, &params, cancel, ctx->global);
+    assert_true(d);
+    struct sh_stream *sh = demux_get_stream(d, 0);
+    demuxer_select_track(d, sh, MP_NOPTS_VALUE, true);
+
+    int num = 0;
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_any_packet(d))) {
+        // The raw demuxer can return an empty packet at EOF.
+        if (pkt->len) {
+            assert_float_equal(pkt->pts, num / 25.0, 1e-6);
+            num++;
+        }
+        talloc_free(pkt);
+    }
+    assert_int_equal(num, NUM_FRAMES);
+
+    // Nothing was pruned, because old packets were spilled instead.
+    assert_float_equal(cache_start(d), 0, 1e-6);
+
+    // Seek back into spilled data. Reading prunes the cache if it's over the
+    // limit, which must not consider the spilled packets after the reader as
+    // memory in use.
+    double target = NUM_FRAMES / 2 / 25.0;
+    assert_true(demux_seek(d, target, SEEK_CACHED | SEEK_HR));
+    pkt = demux_read_any_packet(d);
+    assert_true(pkt);
+    assert_float_equal(pkt->pts, target, 1e-6);
+    assert_int_equal(pkt->len, FRAME_W * FRAME_H);
+    assert_int_equal(pkt->buffer[0], NUM_FRAMES / 2);
+    talloc_free(pkt);
+    assert_float_equal(cache_start(d), 0, 1e-6);
+
+    // The spilled packets before the target are still readable.
+    assert_true(demux_seek(d, 0, SEEK_CACHED | SEEK_HR));
+    pkt = demux_read_any_packet(d);
+    assert_true(pkt);
+    assert_int_equal(pkt->buffer[0], 0);
+    talloc_free(pkt);
+
+    demux_free(d);
+    talloc_free(cancel);
+    m_config_restore_backups(ctx->config);
+    talloc_free(path);
+}
+
+const struct unittest test_demux_spill = {
+    .name = "demux-spill",
+    .run = run,
+};
@@ -0,0 +1,90 @@
+#include "demux/dump_queue.h"
+#include "demux/packet.h"
+#include "tests.h"
+
+static struct dump_item new_item(int size, int64_t pts)
+{
+    struct demux_packet *pkt = new_demux_packet(size);
+    assert_true(pkt);
+    pkt->pts = pts;
+    return (struct dump_item){.pkt = pkt, .cache_pos = -1};
+}
+
+static void run(struct test_ctx *ctx)
+{
+    struct demux_packet *ref = new_demux_packet(1000);
+    int64_t item_bytes = demux_packet_estimate_total_size(ref);
+    talloc_free(ref);
+
+    struct dump_queue *q = dump_queue_create(NULL, 3 * item_bytes);
+    struct dump_item item;
+
+    assert_false(dump_queue_pop(q, &item));
+    assert_false(dump_queue_is_full(q));
+
+    // Discontinuity markers use no memory.
+    dump_queue_push(q, (struct dump_item){.cache_pos = -1});
+    assert_int_equal(q->bytes, 0);
+
+    dump_queue_push(q, new_item(1000, 1));
+    dump_queue_push(q, new_item(1000, 2));
+    assert_int_equal(q->bytes, 2 * item_bytes);
+    assert_false(dump_queue_is_full(q));
+
+    // Pushing always succeeds; the caller decides what to do when full.
+    dump_queue_push(q, new_item(1000, 3));
+    assert_true(dump_queue_is_full(q));
+    dump_queue_push(q, new_item(1000, 4));
+    assert_int_equal(dump_queue_count(q), 5);
+    assert_int_equal(q->bytes, 4 * item_bytes);
+
+    // FIFO order, and popping releases the accounted memory.
+    assert_true(dump_queue_pop(q, &item));
+    assert_false(item.pkt);
+    for (int n = 1; n <= 2; n++) {
+        assert_true(dump_queue_pop(q, &item));
+        assert_int_equal(item.pkt->pts, n);
+        talloc_free(item.pkt);
+    }
+    assert_int_equal(q->bytes, 2 * item_bytes);
+    assert_false(dump_queue_is_full(q));
+
+    // Packets without data (read from the disk cache later) only count with
+    // their overhead.
+    struct dump_item cached = new_item(0, 5);
+    cached.cache_pos = 1234;
+    int64_t cached_bytes = demux_packet_estimate_total_size(cached.pkt);
+    assert_true(cached_bytes < item_bytes);
+    dump_queue_push(q, cached);
+    assert_int_equal(q->bytes, 2 * item_bytes + cached_bytes);
+
+    // Keep the queue non-empty for a while, which must not grow it forever.
+    for (int n = 0; n < 1000; n++) {
+        dump_queue_push(q, new_item(1000, 6 + n));
+        assert_true(dump_queue_pop(q, &item));
+        talloc_free(item.pkt);
+    }
+    assert_int_equal(dump_queue_count(q), 3);
+    assert_int_equal(q->bytes, 3 * item_bytes);
+
+    dump_queue_clear(q);
+    assert_int_equal(dump_queue_count(q), 0);
+    assert_int_equal(q->bytes, 0);
+    assert_false(dump_queue_pop(q, &item));
+
+    // Freeing the queue frees the remaining packets (checked by ASan/leak
+    // reports).
+    dump_queue_push(q, new_item(1000, 0));
+    talloc_free(q);
+
+    // 0 means unlimited.
+    q = dump_queue_create(NULL, 0);
+    dump_queue_push(q, new_item(1000, 0));
+    assert_false(dump_queue_is_full(q));
+    talloc_free(q);
+}
+
+const struct unittest test_dump_queue = {
+    .name = "dump-queue",
+    .run = run,
+};
@@ -0,0 +1,107 @@
+#include <libavutil/buffer.h>
+
+#include "video/image_buffer.h"
+#include "tests.h"
+
+#define KiB 1024
+#define MiB (1024 * 1024)
+
+static void check_class(size_t size, size_t class_size)
+{
+    AVBufferRef *ref = mp_image_buffer_alloc(size);
+    assert_true(ref);
+    assert_int_equal(ref->size, class_size);
+    av_buffer_unref(&ref);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    // Small allocations are not rounded up.
+    check_class(1, 1);
+    check_class(64 * KiB - 1, 64 * KiB - 1);
+    // 4 classes per power of 2.
+    check_class(64 * KiB, 64 * KiB);
+    check_class(64 * KiB + 1, 80 * KiB);
+    check_class(80 * KiB + 1, 96 * KiB);
+    check_class(96 * KiB + 1, 112 * KiB);
+    check_class(112 * KiB + 1, 128 * KiB);
+    check_class(128 * KiB + 1, 160 * KiB);
+    check_class(2 * MiB + 1, 2 * MiB + 512 * KiB);
+
+    // The player instance running the test may have its own user.
+    struct mp_image_buffer_stats st0;
+    mp_image_buffer_get_stats(&st0);
+
+    struct mp_image_buffer_user *user = mp_image_buffer_user_create(NULL);
+    int64_t limit = st0.limit + 4 * MiB;
+    mp_image_buffer_set_limit(user, limit);
+
+    struct mp_image_buffer_stats st;
+    mp_image_buffer_get_stats(&st);
+    assert_int_equal(st.limit, limit);
+
+    // A freed buffer is reused for a different size in the same class.
+    AVBufferRef *ref = mp_image_buffer_alloc(3 * MiB);
+    assert_true(ref);
+    uint8_t *data = ref->data;
+    av_buffer_unref(&ref);
+    mp_image_buffer_get_stats(&st0);
+    ref = mp_image_buffer_alloc(3 * MiB - 1000);
+    assert_true(ref);
+    assert_true(ref->data == data);
+    mp_image_buffer_get_stats(&st);
+    assert_int_equal(st.hits, st0.hits + 1);
+    assert_int_equal(st.misses, st0.misses);
+    assert_int_equal(st.cached_bytes, st0.cached_bytes - ref->size);
+    assert_int_equal(st.used_bytes, st0.used_bytes + ref->size);
+
+    // Buffers larger than the limit are not kept.
+    AVBufferRef *big = mp_image_buffer_alloc(limit + 1);
+    assert_true(big);
+    mp_image_buffer_get_stats(&st0);
+    av_buffer_unref(&big);
+    mp_image_buffer_get_stats(&st);
+    assert_int_equal(st.cached_bytes, st0.cached_bytes);
+
+    // Unregistering the user restores the previous limit, and drops buffers
+    // over it.
+    av_buffer_unref(&ref);
+    talloc_free(user);
+    mp_image_buffer_get_stats(&st);
+    assert_int_equal(st.limit, limit - 4 * MiB);
+    assert_true(st.cached_bytes <= st.limit);
+
+    // The largest limit of all users is used.
+    struct mp_image_buffer_user *a = mp_image_buffer_user_create(NULL);
+    struct mp_image_buffer_user *b = mp_image_buffer_user_create(NULL);
+    mp_image_buffer_set_limit(a, st.limit + 2 * MiB);
+    mp_image_buffer_set_limit(b, st.limit + 1 * MiB);
+    mp_image_buffer_get_stats(&st0);
+    assert_int_equal(st0.limit, st.limit + 2 * MiB);
+    talloc_free(a);
+    mp_image_buffer_get_stats(&st0);
+    assert_int_equal(st0.limit, st.limit + 1 * MiB);
+    talloc_free(b);
+    mp_image_buffer_get_stats(&st0);
+    assert_int_equal(st0.limit, st.limit);
+
+    // Huge page buffers (if supported) are accounted until they're unmapped.
+    // The size isn't a multiple of the huge page size.
+    struct mp_image_buffer_user *huge = mp_image_buffer_user_create(NULL);
+    mp_image_buffer_set_huge_pages(huge, MP_IMAGE_BUFFER_HUGE_EXPLICIT);
+    big = mp_image_buffer_alloc(st0.limit + 3 * MiB);
+    assert_true(big);
+    memset(big->data, 1, big->size);
+    mp_image_buffer_get_stats(&st);
+    assert_true(st.huge_bytes == st0.huge_bytes ||
+                st.huge_bytes == st0.huge_bytes + (int64_t)big->size);
+    av_buffer_unref(&big);
+    mp_image_buffer_get_stats(&st);
+    assert_int_equal(st.huge_bytes, st0.huge_bytes);
+    talloc_free(huge);
+}
+
+const struct unittest test_image_buffer = {
+    .name = "image-buffer",
+    .run = run,
+};
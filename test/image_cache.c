@@ -0,0 +1,184 @@
+#include "options/m_config.h"
+#include "video/image_cache.h"
+#include "video/mp_image.h"
+#include "tests.h"
+
+static struct mp_image *new_image(int w, int h, int seed)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, w, h);
+    assert_true(img);
+    mp_image_params_guess_csp(&img->params);
+    for (int p = 0; p < img->num_planes; p++) {
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *line = img->planes[p] + (ptrdiff_t)img->stride[p] * y;
+            for (int x = 0; x < mp_image_plane_w(img, p); x++)
+                line[x] = seed + p * 7 + y * 3 + x;
+        }
+    }
+    return img;
+}
+
+static void check_image(struct mp_image *a, struct mp_image *b)
+{
+    assert_true(a && b);
+    assert_int_equal(a->imgfmt, b->imgfmt);
+    assert_int_equal(a->w, b->w);
+    assert_int_equal(a->h, b->h);
+    for (int p = 0; p < a->num_planes; p++) {
+        for (int y = 0; y < mp_image_plane_h(a, p); y++) {
+            assert_true(memcmp(a->planes[p] + (ptrdiff_t)a->stride[p] * y,
+                               b->planes[p] + (ptrdiff_t)b->stride[p] * y,
+                               mp_image_plane_w(a, p)) == 0);
+        }
+    }
+}
+
+static void set_max_bytes(struct m_config_cache *cache, int64_t max_bytes)
+{
+    struct image_cache_opts *opts = cache->opts;
+    opts->max_bytes = max_bytes;
+    m_config_cache_write_opt(cache, &opts->max_bytes);
+}
+
+static void store_image(struct mp_image_cache *c, const char *key,
+                        struct mp_image *img)
+{
+    mp_image_cache_store(c, key, img);
+    mp_image_cache_flush(c);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    struct m_config_cache *cache =
+        m_config_cache_alloc(tmp, ctx->global, &image_cache_conf);
+    struct image_cache_opts *opts = cache->opts;
+    struct image_cache_opts orig = *opts;
+    orig.dir = talloc_strdup(tmp, opts->dir);
+
+    struct mp_image_cache *c = mp_image_cache_create(tmp, ctx->global, ctx->log);
+    struct mp_image_cache_stats st;
+
+    const char data_a[] = "image a", data_b[] = "image b", data_c[] = "image c";
+
+    // Disabled: no keys, so nothing is looked up or stored.
+    opts->enable = 0;
+    m_config_cache_write_opt(cache, &opts->enable);
+    assert_false(mp_image_cache_key(tmp, c, data_a, sizeof(data_a)));
+
+    talloc_free(opts->dir);
+    opts->dir = talloc_asprintf(NULL, "%s/image-cache", ctx->out_path);
+    m_config_cache_write_opt(cache, &opts->dir);
+    opts->enable = 1;
+    m_config_cache_write_opt(cache, &opts->enable);
+    opts->max_dim = 0;
+    m_config_cache_write_opt(cache, &opts->max_dim);
+    set_max_bytes(cache, 64 * 1024 * 1024);
+
+    // Remove leftovers of previous runs.
+    mp_image_cache_clear(c);
+
+    char *key_a = mp_image_cache_key(tmp, c, data_a, sizeof(data_a));
+    char *key_b = mp_image_cache_key(tmp, c, data_b, sizeof(data_b));
+    char *key_c = mp_image_cache_key(tmp, c, data_c, sizeof(data_c));
+    assert_true(key_a && key_b && key_c);
+    assert_int_equal(strlen(key_a), 64);
+    assert_string_equal(key_a, mp_image_cache_key(tmp, c, data_a, sizeof(data_a)));
+    assert_true(strcmp(key_a, key_b) != 0);
+
+    assert_false(mp_image_cache_load(c, key_a));
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.hits, 0);
+    assert_int_equal(st.misses, 1);
+
+    struct mp_image *img_a = new_image(32, 16, 1);
+    store_image(c, key_a, img_a);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.writes, 1);
+    assert_true(st.dir_bytes > 32 * 16);
+    int64_t entry_bytes = st.dir_bytes;
+
+    struct mp_image *res = mp_image_cache_load(c, key_a);
+    check_image(img_a, res);
+    talloc_free(res);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.hits, 1);
+    assert_int_equal(st.misses, 1);
+
+    // Replacing an entry doesn't count it twice.
+    store_image(c, key_a, img_a);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.writes, 2);
+    assert_int_equal(st.dir_bytes, entry_bytes);
+
+    // The directory size is tracked without rescanning, and the directory is
+    // pruned once it gets over the limit.
+    set_max_bytes(cache, entry_bytes * 5 / 2);
+    struct mp_image *img_b = new_image(32, 16, 2);
+    store_image(c, key_b, img_b);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.dir_bytes, 2 * entry_bytes);
+    struct mp_image *img_c = new_image(32, 16, 3);
+    store_image(c, key_c, img_c);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.writes, 4);
+    assert_int_equal(st.dir_bytes, 2 * entry_bytes);
+
+    int found = 0;
+    char *keys[] = {key_a, key_b, key_c};
+    for (int n = 0; n < MP_ARRAY_SIZE(keys); n++) {
+        res = mp_image_cache_load(c, keys[n]);
+        found += !!res;
+        talloc_free(res);
+    }
+    assert_int_equal(found, 2);
+
+    // Images which can't be stored are ignored.
+    store_image(c, key_a, NULL);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.writes, 4);
+
+    // Stores which find the cache disabled on the worker are dropped.
+    opts->enable = 0;
+    m_config_cache_write_opt(cache, &opts->enable);
+    store_image(c, key_a, img_a);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.writes, 4);
+    opts->enable = 1;
+    m_config_cache_write_opt(cache, &opts->enable);
+
+    mp_image_cache_clear(c);
+    mp_image_cache_get_stats(c, &st);
+    assert_int_equal(st.dir_bytes, 0);
+    assert_false(mp_image_cache_load(c, key_c));
+
+    // Freeing the cache waits for pending stores.
+    mp_image_cache_store(c, key_a, img_a);
+    talloc_free(c);
+    c = mp_image_cache_create(tmp, ctx->global, ctx->log);
+    res = mp_image_cache_load(c, key_a);
+    check_image(img_a, res);
+    talloc_free(res);
+    mp_image_cache_clear(c);
+    talloc_free(c);
+
+    talloc_free(img_a);
+    talloc_free(img_b);
+    talloc_free(img_c);
+
+    talloc_free(opts->dir);
+    opts->dir = talloc_strdup(NULL, orig.dir);
+    m_config_cache_write_opt(cache, &opts->dir);
+    opts->enable = orig.enable;
+    m_config_cache_write_opt(cache, &opts->enable);
+    opts->max_dim = orig.max_dim;
+    m_config_cache_write_opt(cache, &opts->max_dim);
+    set_max_bytes(cache, orig.max_bytes);
+
+    talloc_free(tmp);
+}
+
+const struct unittest test_image_cache = {
+    .name = "image-cache",
+    .run = run,
+};
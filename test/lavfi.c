@@ -0,0 +1,93 @@
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "video/mp_image.h"
+#include "tests.h"
+
+static struct mp_image *new_image(int w, int h, double pts)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, w, h);
+    assert_true(img);
+    mp_image_params_guess_csp(&img->params);
+    mp_image_clear(img, 0, 0, w, h);
+    img->pts = pts;
+    return img;
+}
+
+// Send img through the filter, and return the first output frame.
+static struct mp_image *filter_image(struct mp_filter *root,
+                                     struct mp_filter *f, struct mp_image *img)
+{
+    struct mp_pin *in = f->pins[0];
+    struct mp_pin *out = f->pins[1];
+    struct mp_image *res = NULL;
+
+    for (int n = 0; n < 100 && !res; n++) {
+        if (img && mp_pin_in_needs_data(in)) {
+            mp_pin_in_write(in, MAKE_FRAME(MP_FRAME_VIDEO, img));
+            img = NULL;
+        }
+        if (mp_pin_out_request_data(out)) {
+            struct mp_frame frame = mp_pin_out_read(out);
+            if (frame.type == MP_FRAME_VIDEO) {
+                res = frame.data;
+            } else {
+                mp_frame_unref(&frame);
+            }
+        }
+        mp_filter_graph_run(root);
+    }
+
+    assert_false(img);
+    assert_true(res);
+    assert_false(mp_filter_has_failed(f));
+    return res;
+}
+
+static void check_image(struct mp_image *img, int w, int h, double pts)
+{
+    assert_int_equal(img->w, w);
+    assert_int_equal(img->h, h);
+    assert_float_equal(img->pts, pts, 1e-6);
+    talloc_free(img);
+}
+
+// Alternate between input formats, so that prebuilt graphs get swapped in.
+static void run_formats(struct test_ctx *ctx, char **args)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_filter *f =
+        mp_create_user_filter(root, MP_OUTPUT_CHAIN_VIDEO, "lavfi", args);
+    assert_true(f);
+    mp_pin_set_manual_connection(f->pins[0], true);
+    mp_pin_set_manual_connection(f->pins[1], true);
+
+    static const int sizes[][2] = {{64, 48}, {32, 24}, {64, 48}, {32, 24},
+                                   {16, 16}, {64, 48}, {64, 48}, {32, 24}};
+    double pts = 0;
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        int w = sizes[n][0], h = sizes[n][1];
+        for (int i = 0; i < 3; i++) {
+            struct mp_image *img =
+                filter_image(root, f, new_image(w, h, pts));
+            check_image(img, w * 2, h, pts);
+            pts += 1;
+        }
+        // Like a seek: the graph is dropped, and the same format follows.
+        if (n == 5)
+            mp_filter_reset(f);
+    }
+
+    talloc_free(root);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    run_formats(ctx, (char *[]){"graph", "scale=2*iw:ih", NULL});
+    run_formats(ctx, (char *[]){"graph", "scale=2*iw:ih",
+                                "spare-graphs", "yes", NULL});
+}
+
+const struct unittest test_lavfi = {
+    .name = "lavfi",
+    .run = run,
+};
@@ -0,0 +1,121 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "common/common.h"
+#include "options/path.h"
+#include "player/lua_bytecode.h"
+#include "tests.h"
+
+// Number of files in dir, excluding "." and "..".
+static int count_files(const char *dir)
+{
+    int n = 0;
+    DIR *d = opendir(dir);
+    assert_true(d);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+            n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static void clear_dir(void *ta_parent, const char *dir)
+{
+    DIR *d = opendir(dir);
+    assert_true(d);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+            unlink(mp_path_join(ta_parent, dir, ent->d_name));
+    }
+    closedir(d);
+}
+
+static char *only_file(void *ta_parent, const char *dir)
+{
+    char *res = NULL;
+    DIR *d = opendir(dir);
+    assert_true(d);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+            res = mp_path_join(ta_parent, dir, ent->d_name);
+    }
+    closedir(d);
+    assert_true(res);
+    return res;
+}
+
+static void load_and_check(struct test_ctx *ctx, lua_State *L, const char *dir,
+                           const char *src)
+{
+    int r = mp_lua_load_cached(L, ctx->log, dir, src, strlen(src), "@test");
+    assert_int_equal(r, 0);
+    assert_int_equal(lua_pcall(L, 0, 1, 0), 0);
+    assert_int_equal(lua_tointeger(L, -1), 42);
+    lua_pop(L, 1);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+    char *dir = mp_path_join(tmp, ctx->out_path, "lua-bytecode");
+    mp_mkdirp(dir);
+    assert_true(mp_path_isdir(dir));
+    clear_dir(tmp, dir);
+
+    lua_State *L = luaL_newstate();
+    assert_true(L);
+    const char *src = "return 40 + 2";
+
+    // First load compiles and stores the bytecode (no temp files left).
+    load_and_check(ctx, L, dir, src);
+    assert_int_equal(count_files(dir), 1);
+
+    // Second load uses the cached entry.
+    load_and_check(ctx, L, dir, src);
+    assert_int_equal(count_files(dir), 1);
+
+    // Different source gives a separate entry.
+    load_and_check(ctx, L, dir, "return 41 + 1");
+    assert_int_equal(count_files(dir), 2);
+
+    // A corrupted entry is ignored and replaced.
+    clear_dir(tmp, dir);
+    load_and_check(ctx, L, dir, src);
+    char *fname = only_file(tmp, dir);
+    FILE *f = fopen(fname, "wb");
+    assert_true(f);
+    fputs("garbage", f);
+    fclose(f);
+    load_and_check(ctx, L, dir, src);
+    assert_int_equal(count_files(dir), 1);
+    char buf[16] = {0};
+    f = fopen(fname, "rb");
+    assert_true(f);
+    assert_true(fread(buf, 1, sizeof(buf) - 1, f) > 0);
+    fclose(f);
+    assert_true(strcmp(buf, "garbage") != 0);
+
+    // Syntax errors are reported, and nothing is stored.
+    clear_dir(tmp, dir);
+    const char *bad = "return (";
+    assert_true(mp_lua_load_cached(L, ctx->log, dir, bad, strlen(bad),
+                                   "@bad") != 0);
+    lua_pop(L, 1); // error message
+    assert_int_equal(count_files(dir), 0);
+
+    lua_close(L);
+    talloc_free(tmp);
+}
+
+const struct unittest test_lua_bytecode = {
+    .name = "lua-bytecode",
+    .run = run,
+};
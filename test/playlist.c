@@ -0,0 +1,64 @@
+#include "common/common.h"
+#include "common/playlist.h"
+#include "tests.h"
+
+static struct playlist *new_list(void *ta_parent, const char **names)
+{
+    struct playlist *pl = talloc_zero(ta_parent, struct playlist);
+    for (int n = 0; names[n]; n++)
+        playlist_add_file(pl, names[n]);
+    return pl;
+}
+
+static void check_list(struct playlist *pl, const char **names)
+{
+    int n = 0;
+    for (; names[n]; n++) {
+        struct playlist_entry *e = playlist_entry_from_index(pl, n);
+        assert_true(e);
+        assert_true(e->pl == pl);
+        assert_int_equal(e->pl_index, n);
+        assert_string_equal(e->filename, names[n]);
+    }
+    assert_int_equal(pl->num_entries, n);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct playlist *pl = new_list(tmp, (const char *[]){"a", "b", "c", NULL});
+    struct playlist_entry *b = playlist_entry_from_index(pl, 1);
+
+    // Insert after an entry in the middle.
+    struct playlist *add = new_list(tmp, (const char *[]){"x", "y", NULL});
+    playlist_transfer_entries_after(pl, b, add);
+    check_list(pl, (const char *[]){"a", "b", "x", "y", "c", NULL});
+    assert_int_equal(add->num_entries, 0);
+
+    // The source list can be reused after a transfer.
+    playlist_add_file(add, "z");
+    playlist_transfer_entries_after(pl, playlist_entry_from_index(pl, 3), add);
+    check_list(pl, (const char *[]){"a", "b", "x", "y", "z", "c", NULL});
+
+    // NULL appends.
+    playlist_add_file(add, "e");
+    playlist_transfer_entries_after(pl, NULL, add);
+    check_list(pl, (const char *[]){"a", "b", "x", "y", "z", "c", "e", NULL});
+
+    // A reserved entry survives removal, and is detectably detached; this is
+    // how the player notices that its insertion position is gone.
+    b->reserved += 1;
+    playlist_clear(pl);
+    assert_int_equal(pl->num_entries, 0);
+    assert_true(b->pl == NULL);
+    assert_true(b->removed);
+    playlist_entry_unref(b);
+
+    talloc_free(tmp);
+}
+
+const struct unittest test_playlist = {
+    .name = "playlist",
+    .run = run,
+};
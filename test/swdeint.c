@@ -0,0 +1,100 @@
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "video/mp_image.h"
+#include "tests.h"
+
+#define W 32
+#define H 24
+
+// Luma lines of the field that is kept in every frame are 50. The other field
+// changes from frame to frame (field_vals[frame]). Chroma is constant.
+static struct mp_image *new_image(int frame, bool tff, const int *field_vals)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, W, H);
+    assert_true(img);
+    mp_image_params_guess_csp(&img->params);
+    mp_image_clear(img, 0, 0, W, H);
+    for (int y = 0; y < H; y++) {
+        // With TFF, the first field (top, even lines) is kept.
+        bool kept = (y & 1) == !tff;
+        memset(img->planes[0] + img->stride[0] * y,
+               kept ? 50 : field_vals[frame], W);
+    }
+    img->pts = frame * 0.04;
+    img->fields = MP_IMGFIELD_INTERLACED | (tff ? MP_IMGFIELD_TOP_FIRST : 0);
+    return img;
+}
+
+static void run_order(struct test_ctx *ctx, bool tff)
+{
+    // The field between frames 0 and 1 changes little, but a lot in frame 2.
+    // The missing field of the first field of frame 1 must be interpolated
+    // from frames 0 and 1, not 1 and 2.
+    static const int field_vals[] = {100, 120, 200, 200};
+    int num_frames = MP_ARRAY_SIZE(field_vals);
+
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_filter *f =
+        mp_create_user_filter(root, MP_OUTPUT_CHAIN_VIDEO, "swdeint",
+            (char *[]){"mode", "field", "spatial-check", "no", "threads", "1",
+                       NULL});
+    assert_true(f);
+    mp_pin_set_manual_connection(f->pins[0], true);
+    mp_pin_set_manual_connection(f->pins[1], true);
+
+    struct mp_image *out[8] = {0};
+    int num_out = 0;
+    int frame = 0;
+    bool eof = false;
+    for (int n = 0; n < 1000 && num_out < 4; n++) {
+        if (mp_pin_in_needs_data(f->pins[0])) {
+            if (frame < num_frames) {
+                struct mp_image *img = new_image(frame++, tff, field_vals);
+                mp_pin_in_write(f->pins[0], MAKE_FRAME(MP_FRAME_VIDEO, img));
+            } else if (!eof) {
+                mp_pin_in_write(f->pins[0], MP_EOF_FRAME);
+                eof = true;
+            }
+        }
+        if (mp_pin_out_request_data(f->pins[1])) {
+            struct mp_frame res = mp_pin_out_read(f->pins[1]);
+            if (res.type == MP_FRAME_VIDEO) {
+                out[num_out++] = res.data;
+            } else {
+                mp_frame_unref(&res);
+            }
+        }
+        mp_filter_graph_run(root);
+    }
+    assert_int_equal(num_out, 4);
+    assert_false(mp_filter_has_failed(f));
+
+    // out[2] is the first field of frame 1.
+    struct mp_image *img = out[2];
+    assert_int_equal(img->w, W);
+    assert_int_equal(img->h, H);
+    for (int y = 0; y < H; y++) {
+        bool kept = (y & 1) == !tff;
+        // Interpolated: the temporal average (100 + 120) / 2 = 110, limited by
+        // the temporal difference 20 / 2 = 10.
+        int expect = kept ? 50 : 100;
+        uint8_t *line = img->planes[0] + img->stride[0] * y;
+        for (int x = 0; x < W; x++)
+            assert_int_equal(line[x], expect);
+    }
+
+    for (int n = 0; n < num_out; n++)
+        talloc_free(out[n]);
+    talloc_free(root);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    run_order(ctx, true);
+    run_order(ctx, false);
+}
+
+const struct unittest test_swdeint = {
+    .name = "swdeint",
+    .run = run,
+};
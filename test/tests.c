@@ -5,15 +5,29 @@
 
 static const struct unittest *unittests[] = {
     &test_chmap,
+    &test_client_events,
+    &test_demux_spill,
+    &test_dump_queue,
     &test_gl_video,
+    &test_image_buffer,
+    &test_image_cache,
     &test_img_format,
     &test_json,
+    &test_lavfi,
     &test_linked_list,
+#if HAVE_LUA
+    &test_lua_bytecode,
+#endif
     &test_paths,
+    &test_playlist,
+    &test_swdeint,
     &test_repack_sws,
 #if HAVE_ZIMG
     &test_repack, // zimg only due to cross-checking with zimg.c
     &test_repack_zimg,
+#endif
+#if HAVE_VAPOURSYNTH
+    &test_vapoursynth,
 #endif
     NULL
 };
@@ -34,6 +48,7 @@ bool run_tests(struct MPContext *mpctx)
     struct test_ctx ctx = {
         .global = mpctx->global,
         .log = mpctx->log,
+        .config = mpctx->mconfig,
         .ref_path = "test/ref",
         .out_path = "test/out",
     };
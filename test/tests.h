@@ -7,6 +7,7 @@
 #include "common/common.h"
 
 struct MPContext;
+struct m_config;
 
 bool run_tests(struct MPContext *mpctx);
 
@@ -14,6 +15,10 @@ struct test_ctx {
     struct mpv_global *global;
     struct mp_log *log;
 
+    // Player options. Tests which change options must restore them, e.g. with
+    // m_config_backup_opt() and m_config_restore_backups().
+    struct m_config *config;
+
     // Path for ref files, without trailing "/".
     const char *ref_path;
 
@@ -37,14 +42,24 @@ struct unittest {
 };
 
 extern const struct unittest test_chmap;
+extern const struct unittest test_client_events;
+extern const struct unittest test_demux_spill;
+extern const struct unittest test_dump_queue;
 extern const struct unittest test_gl_video;
+extern const struct unittest test_image_buffer;
+extern const struct unittest test_image_cache;
 extern const struct unittest test_img_format;
 extern const struct unittest test_json;
+extern const struct unittest test_lavfi;
 extern const struct unittest test_linked_list;
+extern const struct unittest test_lua_bytecode;
 extern const struct unittest test_repack_sws;
 extern const struct unittest test_repack_zimg;
 extern const struct unittest test_repack;
 extern const struct unittest test_paths;
+extern const struct unittest test_playlist;
+extern const struct unittest test_swdeint;
+extern const struct unittest test_vapoursynth;
 
 #define assert_true(x) assert(x)
 #define assert_false(x) assert(!(x))
@@ -0,0 +1,95 @@
+#include <stdio.h>
+
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "osdep/timer.h"
+#include "video/mp_image.h"
+#include "tests.h"
+
+#define NUM_FRAMES 8
+
+static struct mp_image *new_image(double pts)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, 64, 48);
+    assert_true(img);
+    mp_image_params_guess_csp(&img->params);
+    mp_image_clear(img, 0, 0, img->w, img->h);
+    img->pts = pts;
+    img->pkt_duration = 1.0 / 25;
+    return img;
+}
+
+// Feed frames starting at pts until NUM_FRAMES output frames were returned.
+// The output frames are kept referenced in out[].
+static void filter_frames(struct mp_filter *root, struct mp_filter *f,
+                          double pts, struct mp_image **out)
+{
+    struct mp_pin *in = f->pins[0];
+    struct mp_pin *res = f->pins[1];
+    int num_out = 0;
+
+    // VS returns frames asynchronously, so this can take a few iterations.
+    for (int n = 0; n < 10000 && num_out < NUM_FRAMES; n++) {
+        if (mp_pin_in_needs_data(in)) {
+            mp_pin_in_write(in, MAKE_FRAME(MP_FRAME_VIDEO, new_image(pts)));
+            pts += 1.0 / 25;
+        }
+        if (mp_pin_out_request_data(res)) {
+            struct mp_frame frame = mp_pin_out_read(res);
+            if (frame.type == MP_FRAME_VIDEO) {
+                out[num_out++] = frame.data;
+            } else {
+                mp_frame_unref(&frame);
+            }
+        }
+        mp_filter_graph_run(root);
+        mp_sleep_us(1000);
+    }
+
+    assert_int_equal(num_out, NUM_FRAMES);
+    assert_false(mp_filter_has_failed(f));
+}
+
+static void free_frames(struct mp_image **frames)
+{
+    for (int n = 0; n < NUM_FRAMES; n++)
+        TA_FREEP(&frames[n]);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    char *script = talloc_asprintf(NULL, "%s/vapoursynth.py", ctx->out_path);
+    FILE *fp = fopen(script, "w");
+    assert_true(fp);
+    fputs("video_in.set_output()\n", fp);
+    fclose(fp);
+
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_filter *f =
+        mp_create_user_filter(root, MP_OUTPUT_CHAIN_VIDEO, "vapoursynth",
+                              (char *[]){"file", script, NULL});
+    assert_true(f);
+    mp_pin_set_manual_connection(f->pins[0], true);
+    mp_pin_set_manual_connection(f->pins[1], true);
+
+    struct mp_image *first[NUM_FRAMES] = {0};
+    struct mp_image *second[NUM_FRAMES] = {0};
+
+    // Output frames reference the VS core. Resetting the filter (as on seeks)
+    // while they are alive must free the script's clips anyway.
+    filter_frames(root, f, 0, first);
+    mp_filter_reset(f);
+    filter_frames(root, f, 10, second);
+    free_frames(first);
+
+    // Frames may outlive the filter.
+    talloc_free(root);
+    free_frames(second);
+
+    talloc_free(script);
+}
+
+const struct unittest test_vapoursynth = {
+    .name = "vapoursynth",
+    .run = run,
+};
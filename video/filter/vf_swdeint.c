@@ -0,0 +1,378 @@
+/*
+ * This file is part of mpv.
+ *
+ * The deinterlacing algorithm is based on yadif from FFmpeg/MPlayer.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/m_option.h"
+#include "filters/filter.h"
+#include "filters/filter_internal.h"
+#include "filters/user_filters.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+#include "refqueue.h"
+
+// Software (CPU) deinterlacer. Uses the mp_refqueue past/future frame window
+// directly, so frames don't need to be converted to AVFrames and passed
+// through libavfilter.
+
+#define MAX_SLICES 64
+
+struct opts {
+    int field_output;
+    int spatial_check;
+    int interlaced_only;
+    int threads;
+};
+
+struct priv;
+
+struct slice {
+    struct priv *p;
+    int index;
+    struct mp_waiter waiter;
+};
+
+struct priv {
+    struct opts *opts;
+    struct mp_refqueue *queue;
+    struct mp_image_pool *pool;
+
+    struct mp_thread_pool *tp;
+    int num_slices;
+    struct slice slices[MAX_SLICES];
+
+    // Current job, set by render() for all slices.
+    struct mp_image *dst, *prev, *cur, *next;
+    int parity; // lines with (y ^ parity) & 1 == 0 are copied from cur
+    int tff;
+    int bytes; // bytes per sample
+};
+
+#define MIN3(a, b, c) MPMIN(MPMIN(a, b), c)
+#define MAX3(a, b, c) MPMAX(MPMAX(a, b), c)
+
+// Filter one line. src[] are the lines of the previous, current and next
+// frame, prefs[]/mrefs[] the offsets (in samples) to the line below/above in
+// the respective frame.
+// parity selects the frames the interpolated field is temporally predicted
+// from: prev/cur if set, cur/next otherwise (as in yadif, field parity ^ tff).
+// mode!=0 disables the spatial interlacing check (needed at the top/bottom).
+#define FILTER_LINE(NAME, T)                                                   \
+static void NAME(T *dst, const T *src[3], const ptrdiff_t prefs[3],            \
+                 const ptrdiff_t mrefs[3], int w, int parity, int mode)        \
+{                                                                              \
+    const T *prev = src[0], *cur = src[1], *next = src[2];                     \
+    const T *prev2 = src[parity ? 0 : 1], *next2 = src[parity ? 1 : 2];        \
+    ptrdiff_t pp = prefs[0], pm = mrefs[0];                                    \
+    ptrdiff_t cp = prefs[1], cm = mrefs[1];                                    \
+    ptrdiff_t np = prefs[2], nm = mrefs[2];                                    \
+    ptrdiff_t p2p = prefs[parity ? 0 : 1], p2m = mrefs[parity ? 0 : 1];        \
+    ptrdiff_t n2p = prefs[parity ? 1 : 2], n2m = mrefs[parity ? 1 : 2];        \
+    for (int x = 0; x < w; x++) {                                              \
+        int c = cur[x + cm];                                                   \
+        int d = (prev2[x] + next2[x]) >> 1;                                    \
+        int e = cur[x + cp];                                                   \
+        int tdiff0 = abs(prev2[x] - next2[x]);                                 \
+        int tdiff1 = (abs(prev[x + pm] - c) + abs(prev[x + pp] - e)) >> 1;     \
+        int tdiff2 = (abs(next[x + nm] - c) + abs(next[x + np] - e)) >> 1;     \
+        int diff = MAX3(tdiff0 >> 1, tdiff1, tdiff2);                          \
+        int spatial_pred = (c + e) >> 1;                                       \
+                                                                               \
+        if (x >= 3 && x < w - 3) {                                             \
+            int spatial_score = abs(cur[x + cm - 1] - cur[x + cp - 1]) +       \
+                                abs(c - e) +                                   \
+                                abs(cur[x + cm + 1] - cur[x + cp + 1]) - 1;    \
+            for (int j = -1; j >= -2; j--) {                                   \
+                int score = abs(cur[x + cm - 1 + j] - cur[x + cp - 1 - j]) +   \
+                            abs(cur[x + cm + j] - cur[x + cp - j]) +           \
+                            abs(cur[x + cm + 1 + j] - cur[x + cp + 1 - j]);    \
+                if (score >= spatial_score)                                    \
+                    break;                                                     \
+                spatial_score = score;                                         \
+                spatial_pred = (cur[x + cm + j] + cur[x + cp - j]) >> 1;       \
+            }                                                                  \
+            for (int j = 1; j <= 2; j++) {                                     \
+                int score = abs(cur[x + cm - 1 + j] - cur[x + cp - 1 - j]) +   \
+                            abs(cur[x + cm + j] - cur[x + cp - j]) +           \
+                            abs(cur[x + cm + 1 + j] - cur[x + cp + 1 - j]);    \
+                if (score >= spatial_score)                                    \
+                    break;                                                     \
+                spatial_score = score;                                         \
+                spatial_pred = (cur[x + cm + j] + cur[x + cp - j]) >> 1;       \
+            }                                                                  \
+        }                                                                      \
+                                                                               \
+        if (!mode) {                                                           \
+            int b = (prev2[x + 2 * p2m] + next2[x + 2 * n2m]) >> 1;            \
+            int f = (prev2[x + 2 * p2p] + next2[x + 2 * n2p]) >> 1;            \
+            int max = MAX3(d - e, d - c, MPMIN(b - c, f - e));                 \
+            int min = MIN3(d - e, d - c, MPMAX(b - c, f - e));                 \
+            diff = MAX3(diff, min, -max);                                      \
+        }                                                                      \
+                                                                               \
+        if (spatial_pred > d + diff) {                                         \
+            spatial_pred = d + diff;                                           \
+        } else if (spatial_pred < d - diff) {                                  \
+            spatial_pred = d - diff;                                           \
+        }                                                                      \
+                                                                               \
+        dst[x] = spatial_pred;                                                 \
+    }                                                                          \
+}
+
+FILTER_LINE(filter_line_8, uint8_t)
+FILTER_LINE(filter_line_16, uint16_t)
+
+static void filter_plane(struct priv *p, int plane, int y0, int y1)
+{
+    int w = mp_image_plane_w(p->dst, plane);
+    int h = mp_image_plane_h(p->dst, plane);
+    struct mp_image *refs[3] = {p->prev, p->cur, p->next};
+    int mode_edge = !p->opts->spatial_check;
+
+    for (int y = y0; y < y1; y++) {
+        uint8_t *dst = p->dst->planes[plane] + p->dst->stride[plane] * y;
+
+        if (!((y ^ p->parity) & 1)) {
+            memcpy(dst, p->cur->planes[plane] + p->cur->stride[plane] * y,
+                   w * p->bytes);
+            continue;
+        }
+
+        const void *src[3];
+        ptrdiff_t prefs[3], mrefs[3];
+        for (int n = 0; n < 3; n++) {
+            ptrdiff_t stride = refs[n]->stride[plane];
+            ptrdiff_t line = stride / p->bytes; // in samples
+            src[n] = refs[n]->planes[plane] + stride * y;
+            prefs[n] = y + 1 < h ? line : -line;
+            mrefs[n] = y ? -line : line;
+        }
+        int mode = mode_edge || y < 2 || y + 2 >= h;
+
+        if (p->bytes == 1) {
+            filter_line_8(dst, (const uint8_t **)src, prefs, mrefs, w,
+                          p->parity ^ p->tff, mode);
+        } else {
+            filter_line_16((uint16_t *)dst, (const uint16_t **)src, prefs,
+                           mrefs, w, p->parity ^ p->tff, mode);
+        }
+    }
+}
+
+static void filter_slice(struct slice *s)
+{
+    struct priv *p = s->p;
+
+    for (int plane = 0; plane < p->dst->num_planes; plane++) {
+        int h = mp_image_plane_h(p->dst, plane);
+        int y0 = (int64_t)h * s->index / p->num_slices;
+        int y1 = (int64_t)h * (s->index + 1) / p->num_slices;
+        filter_plane(p, plane, y0, y1);
+    }
+}
+
+static void filter_slice_thread(void *ptr)
+{
+    struct slice *s = ptr;
+
+    filter_slice(s);
+    mp_waiter_wakeup(&s->waiter, 0);
+}
+
+static struct mp_image *render(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    struct mp_image *cur = mp_refqueue_get(p->queue, 0);
+    struct mp_image *prev = mp_refqueue_get(p->queue, -1);
+    struct mp_image *next = mp_refqueue_get(p->queue, 1);
+
+    struct mp_image *dst = mp_image_pool_get(p->pool, cur->imgfmt, cur->w,
+                                             cur->h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, cur);
+    dst->fields &= ~(unsigned)(MP_IMGFIELD_INTERLACED | MP_IMGFIELD_TOP_FIRST |
+                               MP_IMGFIELD_REPEAT_FIRST);
+
+    int tff = mp_refqueue_top_field_first(p->queue);
+    int second = mp_refqueue_is_second_field(p->queue);
+
+    p->dst = dst;
+    p->cur = cur;
+    // No past/future frame at start/end of the stream.
+    p->prev = prev ? prev : cur;
+    p->next = next ? next : cur;
+    p->parity = tff ^ !second;
+    p->tff = tff;
+    p->bytes = (mp_imgfmt_get_desc(cur->imgfmt).bpp[0] + 7) / 8;
+
+    for (int n = 1; n < p->num_slices; n++) {
+        struct slice *s = &p->slices[n];
+        s->waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+        bool r = mp_thread_pool_run(p->tp, filter_slice_thread, s);
+        // Guaranteed by the API, since the pool was created with all threads.
+        assert(r);
+    }
+
+    filter_slice(&p->slices[0]);
+
+    for (int n = 1; n < p->num_slices; n++)
+        mp_waiter_wait(&p->slices[n].waiter);
+
+    p->dst = p->prev = p->cur = p->next = NULL;
+    return dst;
+}
+
+static void vf_swdeint_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    mp_refqueue_execute_reinit(p->queue);
+
+    if (!mp_refqueue_can_output(p->queue))
+        return;
+
+    if (!mp_refqueue_should_deint(p->queue)) {
+        struct mp_image *in = mp_refqueue_get(p->queue, 0);
+        mp_refqueue_write_out_pin(p->queue, mp_image_new_ref(in));
+    } else {
+        mp_refqueue_write_out_pin(p->queue, render(f));
+    }
+}
+
+static void vf_swdeint_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    mp_refqueue_flush(p->queue);
+}
+
+static void vf_swdeint_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+    talloc_free(p->queue);
+    talloc_free(p->tp);
+}
+
+static const struct mp_filter_info vf_swdeint_filter = {
+    .name = "swdeint",
+    .process = vf_swdeint_process,
+    .reset = vf_swdeint_reset,
+    .destroy = vf_swdeint_destroy,
+    .priv_size = sizeof(struct priv),
+};
+
+static bool is_supported_format(int imgfmt)
+{
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(imgfmt);
+    if (!(desc.flags & (MP_IMGFLAG_YUV_P | MP_IMGFLAG_RGB_P)) ||
+        !(desc.flags & MP_IMGFLAG_NE) ||
+        (desc.flags & MP_IMGFLAG_TYPE_MASK) != MP_IMGFLAG_TYPE_UINT)
+        return false;
+    for (int n = 0; n < desc.num_planes; n++) {
+        if (desc.bpp[n] != desc.bpp[0])
+            return false;
+    }
+    return desc.bpp[0] == 8 || desc.bpp[0] == 16;
+}
+
+static struct mp_filter *vf_swdeint_create(struct mp_filter *parent,
+                                           void *options)
+{
+    struct mp_filter *f = mp_filter_create(parent, &vf_swdeint_filter);
+    if (!f) {
+        talloc_free(options);
+        return NULL;
+    }
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    struct priv *p = f->priv;
+    p->opts = talloc_steal(p, options);
+    p->pool = mp_image_pool_new(p);
+
+    p->queue = mp_refqueue_alloc(f);
+
+    mp_refqueue_set_refs(p->queue, 1, 1);
+    mp_refqueue_set_mode(p->queue,
+        MP_MODE_DEINT |
+        (p->opts->interlaced_only ? MP_MODE_INTERLACED_ONLY : 0) |
+        (p->opts->field_output ? MP_MODE_OUTPUT_FIELDS : 0));
+
+    for (int n = IMGFMT_START; n < IMGFMT_END; n++) {
+        if (is_supported_format(n))
+            mp_refqueue_add_in_format(p->queue, n, 0);
+    }
+
+    int slices = p->opts->threads;
+    if (slices < 1)
+        slices = av_cpu_count();
+    p->num_slices = MPCLAMP(slices, 1, MAX_SLICES);
+    for (int n = 0; n < p->num_slices; n++)
+        p->slices[n] = (struct slice){.p = p, .index = n};
+
+    int threads = p->num_slices - 1;
+    if (threads) {
+        p->tp = mp_thread_pool_create(NULL, threads, threads, threads);
+        if (!p->tp) {
+            MP_ERR(f, "Failed to create worker threads.\n");
+            goto error;
+        }
+    }
+
+    return f;
+
+error:
+    talloc_free(f);
+    return NULL;
+}
+
+#define OPT_BASE_STRUCT struct opts
+static const m_option_t vf_opts_fields[] = {
+    {"mode", OPT_CHOICE(field_output, {"frame", 0}, {"field", 1})},
+    {"spatial-check", OPT_FLAG(spatial_check)},
+    {"interlaced-only", OPT_FLAG(interlaced_only)},
+    {"threads", OPT_INT(threads), M_RANGE(0, MAX_SLICES)},
+    {0}
+};
+
+const struct mp_user_filter_entry vf_swdeint = {
+    .desc = {
+        .description = "software deinterlacer",
+        .name = "swdeint",
+        .priv_size = sizeof(OPT_BASE_STRUCT),
+        .priv_defaults = &(const OPT_BASE_STRUCT){
+            .field_output = 1,
+            .spatial_check = 1,
+        },
+        .options = vf_opts_fields,
+    },
+    .create = vf_swdeint_create,
+};
@@ -34,6 +34,7 @@
 #include "common/msg.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "osdep/atomic.h"
 #include "filters/f_autoconvert.h"
 #include "filters/f_utils.h"
 #include "filters/filter.h"
@@ -51,6 +52,16 @@ struct vapoursynth_opts {
     const struct script_driver *drv;
 };
 
+// Keeps a VS core alive as long as the filter or frames exported from it
+// (see wrap_vs_frame()) reference it, because output frames can outlive the
+// filter instance.
+struct vs_core_ref {
+    atomic_int refs;
+    const VSAPI *vsapi;
+    void *drv_priv;
+    void (*destroy)(struct vs_core_ref *ref); // frees the core and ref itself
+};
+
 struct priv {
     struct mp_log *log;
     struct vapoursynth_opts *opts;
@@ -58,13 +69,13 @@ struct priv {
 
     VSCore *vscore;
     const VSAPI *vsapi;
+    struct vs_core_ref *core_ref; // set by drv->load_core()
     VSNodeRef *out_node;
     VSNodeRef *in_node;
 
     const struct script_driver *drv;
     // drv_vss
     bool vs_initialized;
-    struct VSScript *se;
 
     struct mp_filter *f;
     struct mp_pin *in_pin;
@@ -85,6 +96,8 @@ struct priv {
     struct mp_image **requested;// frame callback results (can point to dummy_img)
                                 // requested[0] is the frame to return first
     int max_requests;           // upper bound for requested[] array
+    int *active_frames;         // input frames of running infiltGetFrame() calls
+    int num_active_frames;
     bool failed;                // frame callback returned with an error
     bool shutdown;              // ask node to return
     bool eof;                   // drain remaining data
@@ -104,11 +117,35 @@ static int reinit_vs(struct priv *p, struct mp_image *input);
 struct script_driver {
     int (*init)(struct priv *p);                // first time init
     void (*uninit)(struct priv *p);             // last time uninit
-    int (*load_core)(struct priv *p);           // make vsapi/vscore available
+    int (*load_core)(struct priv *p);           // make vsapi/vscore/core_ref
+                                                // available
     int (*load)(struct priv *p, VSMap *vars);   // also sets p->out_node
-    void (*unload)(struct priv *p);             // unload script and maybe vs
+    void (*unload)(struct priv *p);             // release the script's clips
 };
 
+static void unref_vs_core(struct vs_core_ref *ref)
+{
+    if (ref && atomic_fetch_add(&ref->refs, -1) == 1)
+        ref->destroy(ref);
+}
+
+// Output frames are passed on without copying if their planes are aligned
+// enough for mpv's SIMD code (AVX2).
+#define WRAP_ALIGN 32
+
+struct wrapped_frame {
+    struct vs_core_ref *core_ref;
+    const VSFrameRef *frame;
+};
+
+static void free_wrapped_frame(void *arg)
+{
+    struct wrapped_frame *w = arg;
+    w->core_ref->vsapi->freeFrame(w->frame);
+    unref_vs_core(w->core_ref);
+    talloc_free(w);
+}
+
 struct mpvs_fmt {
     VSPresetFormat vs;
     int bits, xs, ys;
@@ -252,6 +289,30 @@ static struct mp_image map_vs_frame(struct priv *p, const VSFrameRef *ref,
     return img;
 }
 
+// Return a read-only mp_image referencing the planes of f, or NULL if the
+// planes are not aligned enough. Takes over the f reference on success.
+static struct mp_image *wrap_vs_frame(struct priv *p, struct mp_image *img,
+                                      const VSFrameRef *f)
+{
+    for (int n = 0; n < img->num_planes; n++) {
+        if ((uintptr_t)img->planes[n] % WRAP_ALIGN ||
+            img->stride[n] % WRAP_ALIGN)
+            return NULL;
+    }
+
+    struct wrapped_frame *w = talloc_ptrtype(NULL, w);
+    *w = (struct wrapped_frame){p->core_ref, f};
+    // The frame callback can run only while the core is referenced by us.
+    atomic_fetch_add(&p->core_ref->refs, 1);
+
+    struct mp_image *res = mp_image_new_custom_ref(img, w, free_wrapped_frame);
+    if (!res) {
+        unref_vs_core(w->core_ref);
+        talloc_free(w);
+    }
+    return res;
+}
+
 static void drain_oldest_buffered_frame(struct priv *p)
 {
     if (!p->num_buffered)
@@ -263,6 +324,25 @@ static void drain_oldest_buffered_frame(struct priv *p)
     p->in_frameno++;
 }
 
+static void remove_active_frame(struct priv *p, int frameno)
+{
+    for (int n = 0; n < p->num_active_frames; n++) {
+        if (p->active_frames[n] == frameno) {
+            MP_TARRAY_REMOVE_AT(p->active_frames, p->num_active_frames, n);
+            return;
+        }
+    }
+}
+
+// Lowest input frame number a running infiltGetFrame() call is waiting for.
+static int min_active_frame(struct priv *p)
+{
+    int res = INT_MAX;
+    for (int n = 0; n < p->num_active_frames; n++)
+        res = MPMIN(res, p->active_frames[n]);
+    return res;
+}
+
 static void VS_CC vs_frame_done(void *userData, const VSFrameRef *f, int n,
                                 VSNodeRef *node, const char *errorMsg)
 {
@@ -284,8 +364,11 @@ static void VS_CC vs_frame_done(void *userData, const VSFrameRef *f, int n,
         }
         if (img.pkt_duration < 0)
             MP_ERR(p, "No PTS after filter at frame %d!\n", n);
-        res = mp_image_new_copy(&img);
-        p->vsapi->freeFrame(f);
+        res = wrap_vs_frame(p, &img, f);
+        if (!res) {
+            res = mp_image_new_copy(&img);
+            p->vsapi->freeFrame(f);
+        }
     }
 
     pthread_mutex_lock(&p->lock);
@@ -472,6 +555,10 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
 
     pthread_mutex_lock(&p->lock);
     MP_TRACE(p, "VS asking for frame %d (at %d)\n", frameno, p->in_frameno);
+    // With fmParallel, requests run concurrently; make sure others don't drain
+    // the frame this one is waiting for.
+    MP_TARRAY_APPEND(p, p->active_frames, p->num_active_frames, frameno);
+    bool active = true;
     while (1) {
         if (p->shutdown) {
             p->vsapi->setFilterError("EOF or filter reset/uninit", frameCtx);
@@ -503,17 +590,19 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
             p->vsapi->setFilterError(msg, frameCtx);
             break;
         }
-        if (frameno >= p->in_frameno + MP_TALLOC_AVAIL(p->buffered)) {
+        if (frameno >= p->in_frameno + MP_TALLOC_AVAIL(p->buffered) &&
+            p->num_buffered)
+        {
             // Too far in the future. Remove frames, so that the main thread can
-            // queue new frames.
-            if (p->num_buffered) {
+            // queue new frames. If another request still waits for the oldest
+            // frame, wait until it got it.
+            if (p->in_frameno < min_active_frame(p)) {
                 drain_oldest_buffered_frame(p);
                 pthread_cond_broadcast(&p->wakeup);
                 mp_filter_wakeup(p->f);
                 continue;
             }
-        }
-        if (frameno >= p->in_frameno + p->num_buffered) {
+        } else if (frameno >= p->in_frameno + p->num_buffered) {
             // If there won't be any new frames, abort the request.
             if (p->eof) {
                 p->vsapi->setFilterError("EOF or filter EOF/reinit", frameCtx);
@@ -533,17 +622,25 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
                 break;
             }
 
+            // Other requests can drain the buffered frame while copying.
+            img = mp_image_new_ref(img);
+            MP_HANDLE_OOM(img);
+            remove_active_frame(p, frameno);
+            active = false;
             pthread_mutex_unlock(&p->lock);
             struct mp_image vsframe = map_vs_frame(p, ret, true);
             mp_image_copy(&vsframe, img);
             int res = 1e6;
             int dur = img->pkt_duration * res + 0.5;
             set_vs_frame_props(p, ret, img, dur, res);
+            talloc_free(img);
             pthread_mutex_lock(&p->lock);
             break;
         }
         pthread_cond_wait(&p->wakeup, &p->lock);
     }
+    if (active)
+        remove_active_frame(p, frameno);
     pthread_cond_broadcast(&p->wakeup);
     pthread_mutex_unlock(&p->lock);
     return ret;
@@ -569,6 +666,24 @@ static int num_requested(struct priv *p)
     return r;
 }
 
+// Resize the request and input queues. Must not be called while VS is
+// initialized.
+static void set_max_requests(struct priv *p, int max_requests)
+{
+    pthread_mutex_lock(&p->lock);
+    assert(!p->num_buffered && !num_requested(p));
+    if (max_requests != p->max_requests) {
+        MP_VERBOSE(p, "using %d concurrent requests.\n", max_requests);
+        p->max_requests = max_requests;
+        talloc_free(p->buffered);
+        talloc_free(p->requested);
+        p->buffered = talloc_array(p, struct mp_image *,
+                                   p->opts->maxbuffer * max_requests);
+        p->requested = talloc_zero_array(p, struct mp_image *, max_requests);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
 static void destroy_vs(struct priv *p)
 {
     if (!p->out_node && !p->initializing)
@@ -593,7 +708,16 @@ static void destroy_vs(struct priv *p)
         p->vsapi->freeNode(p->out_node);
     p->in_node = p->out_node = NULL;
 
-    p->drv->unload(p);
+    // This frees the input node (and calls infiltFree()) now, while the core
+    // may be kept alive by output frames still referenced elsewhere.
+    if (p->core_ref)
+        p->drv->unload(p);
+
+    // The core is destroyed once all output frames are released.
+    unref_vs_core(p->core_ref);
+    p->core_ref = NULL;
+    p->vsapi = NULL;
+    p->vscore = NULL;
 
     assert(!p->in_node_active);
     assert(num_requested(p) == 0); // async callback didn't return?
@@ -636,7 +760,7 @@ static int reinit_vs(struct priv *p, struct mp_image *input)
     p->initializing = true;
     p->out_pts = MP_NOPTS_VALUE;
 
-    if (p->drv->load_core(p) < 0 || !p->vsapi || !p->vscore) {
+    if (p->drv->load_core(p) < 0 || !p->vsapi || !p->vscore || !p->core_ref) {
         MP_FATAL(p, "Could not get vapoursynth API handle.\n");
         goto error;
     }
@@ -647,8 +771,10 @@ static int reinit_vs(struct priv *p, struct mp_image *input)
     if (!in || !out || !vars)
         goto error;
 
+    // infiltGetFrame() is thread-safe, so VS can copy input frames for
+    // concurrent requests in parallel.
     p->vsapi->createFilter(in, out, "Input", infiltInit, infiltGetFrame,
-                           infiltFree, fmSerial, 0, p, p->vscore);
+                           infiltFree, fmParallel, 0, p, p->vscore);
     int vserr;
     p->in_node = p->vsapi->propGetNode(out, "clip", 0, &vserr);
     if (!p->in_node) {
@@ -688,6 +814,12 @@ static int reinit_vs(struct priv *p, struct mp_image *input)
         goto error;
     }
 
+    // Checked after loading the script, which can change the thread count.
+    if (p->opts->maxrequests < 0) {
+        const VSCoreInfo *core_info = p->vsapi->getCoreInfo(p->vscore);
+        set_max_requests(p, MPMAX(core_info->numThreads, 1));
+    }
+
     pthread_mutex_lock(&p->lock);
     p->initializing = false;
     pthread_mutex_unlock(&p->lock);
@@ -761,13 +893,12 @@ static struct mp_filter *vf_vapoursynth_create(struct mp_filter *parent,
     }
     p->script_path = mp_get_user_path(p, f->global, p->opts->file);
 
-    p->max_requests = p->opts->maxrequests;
-    if (p->max_requests < 0)
-        p->max_requests = av_cpu_count();
-    MP_VERBOSE(p, "using %d concurrent requests.\n", p->max_requests);
-    int maxbuffer = p->opts->maxbuffer * p->max_requests;
-    p->buffered = talloc_array(p, struct mp_image *, maxbuffer);
-    p->requested = talloc_zero_array(p, struct mp_image *, p->max_requests);
+    // With "auto", this is updated to the VS thread count once the core is
+    // created.
+    int max_requests = p->opts->maxrequests;
+    if (max_requests < 0)
+        max_requests = av_cpu_count();
+    set_max_requests(p, max_requests);
 
     struct mp_autoconvert *conv = mp_autoconvert_create(f);
     if (!conv)
@@ -827,36 +958,61 @@ static void drv_vss_uninit(struct priv *p)
     p->vs_initialized = false;
 }
 
+static void drv_vss_destroy_core(struct vs_core_ref *ref)
+{
+    // drv_vss_unload() already released all clips, so this does not call back
+    // into the (possibly freed) filter.
+    vsscript_freeScript(ref->drv_priv);
+    // Pairs with the vsscript_init() in drv_vss_load_core(); the script
+    // environment must outlive frames released after the filter was destroyed.
+    vsscript_finalize();
+    talloc_free(ref);
+}
+
 static int drv_vss_load_core(struct priv *p)
 {
     // First load an empty script to get a VSScript, so that we get the vsapi
     // and vscore.
-    if (vsscript_createScript(&p->se))
+    VSScript *se = NULL;
+    if (vsscript_createScript(&se))
         return -1;
-    p->vsapi = vsscript_getVSApi();
-    p->vscore = vsscript_getCore(p->se);
+    if (!vsscript_init()) {
+        vsscript_freeScript(se);
+        return -1;
+    }
+    p->core_ref = talloc_ptrtype(NULL, p->core_ref);
+    *p->core_ref = (struct vs_core_ref){
+        .vsapi = vsscript_getVSApi(),
+        .drv_priv = se,
+        .destroy = drv_vss_destroy_core,
+    };
+    atomic_store(&p->core_ref->refs, 1);
+    p->vsapi = p->core_ref->vsapi;
+    p->vscore = vsscript_getCore(se);
     return 0;
 }
 
 static int drv_vss_load(struct priv *p, VSMap *vars)
 {
-    vsscript_setVariable(p->se, vars);
+    VSScript *se = p->core_ref->drv_priv;
+    vsscript_setVariable(se, vars);
 
-    if (vsscript_evaluateFile(&p->se, p->script_path, 0)) {
-        MP_FATAL(p, "Script evaluation failed:\n%s\n", vsscript_getError(p->se));
+    int err = vsscript_evaluateFile(&se, p->script_path, 0);
+    p->core_ref->drv_priv = se;
+    if (err) {
+        MP_FATAL(p, "Script evaluation failed:\n%s\n", vsscript_getError(se));
         return -1;
     }
-    p->out_node = vsscript_getOutput(p->se, 0);
+    p->out_node = vsscript_getOutput(se, 0);
     return 0;
 }
 
 static void drv_vss_unload(struct priv *p)
 {
-    if (p->se)
-        vsscript_freeScript(p->se);
-    p->se = NULL;
-    p->vsapi = NULL;
-    p->vscore = NULL;
+    VSScript *se = p->core_ref->drv_priv;
+    // The output clip and the script's variables reference the input node.
+    vsscript_clearOutput(se, 0);
+    vsscript_clearEnvironment(se);
 }
 
 static const struct script_driver drv_vss = {
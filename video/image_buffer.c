@@ -0,0 +1,304 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <libavutil/buffer.h>
+#include <libavutil/mem.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#if HAVE_POSIX && defined(MADV_HUGEPAGE)
+#define HAVE_HUGE_PAGES 1
+#else
+#define HAVE_HUGE_PAGES 0
+#endif
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "image_buffer.h"
+
+// Smallest cached size (smaller allocations are cheap enough for malloc).
+#define MIN_CLASS_SHIFT 16
+// Number of size classes; the largest one is just below 2 GiB.
+#define NUM_CLASSES 60
+// Maximum number of unused buffers kept (on top of the byte limit).
+#define MAX_CACHED 64
+// Huge page size used for mapped buffers (x86 and most ARM configs).
+#define HUGE_PAGE_SHIFT 21
+#define HUGE_PAGE_SIZE ((size_t)1 << HUGE_PAGE_SHIFT)
+// Set in the AVBuffer opaque (which is otherwise the class size) if the
+// buffer was allocated with mmap(). Class sizes are always even.
+#define OPAQUE_MAPPED 1
+
+struct cached_buffer {
+    uint8_t *data;
+    size_t size;
+    bool mapped;
+};
+
+struct mp_image_buffer_user {
+    int64_t limit;
+    int huge_pages;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    // Unused buffers, least recently freed first.
+    struct cached_buffer entries[MAX_CACHED];
+    int num_entries;
+    // Settings of all users combined. 0 if there are no users.
+    int64_t limit;
+    int huge_pages;
+    struct mp_image_buffer_stats stats;
+    struct mp_image_buffer_user **users;
+    int num_users;
+} cache;
+
+// Buffers removed from the cache while cache_lock is held. They are freed
+// after unlocking, so that munmap() etc. don't block other threads.
+struct free_list {
+    struct cached_buffer entries[MAX_CACHED + 1];
+    int num_entries;
+};
+
+static uint8_t *alloc_data(size_t size, int huge_pages, bool *mapped)
+{
+    *mapped = false;
+#if HAVE_HUGE_PAGES
+    if (huge_pages && size >= HUGE_PAGE_SIZE) {
+        size_t len = MP_ALIGN_UP(size, HUGE_PAGE_SIZE);
+        void *p = MAP_FAILED;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+        // Request HUGE_PAGE_SIZE pages explicitly, rather than the system's
+        // default huge page size, so that len is a valid munmap() length.
+        // Fails if no huge pages were reserved; use THP as fallback.
+        if (huge_pages == MP_IMAGE_BUFFER_HUGE_EXPLICIT) {
+            p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                     (HUGE_PAGE_SHIFT << MAP_HUGE_SHIFT), -1, 0);
+        }
+#endif
+        if (p == MAP_FAILED) {
+            p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED)
+                madvise(p, len, MADV_HUGEPAGE);
+        }
+        if (p != MAP_FAILED) {
+            *mapped = true;
+            return p;
+        }
+    }
+#endif
+    return av_malloc(size);
+}
+
+static void free_data(uint8_t *data, size_t size, bool mapped)
+{
+#if HAVE_HUGE_PAGES
+    if (mapped) {
+        munmap(data, MP_ALIGN_UP(size, HUGE_PAGE_SIZE));
+        return;
+    }
+#endif
+    av_free(data);
+}
+
+// Must be called with cache_lock held. The buffer is freed by free_buffers().
+static void drop_buffer(struct free_list *fl, struct cached_buffer e)
+{
+    assert(fl->num_entries < MP_ARRAY_SIZE(fl->entries));
+    if (e.mapped)
+        cache.stats.huge_bytes -= e.size;
+    fl->entries[fl->num_entries++] = e;
+}
+
+// Must be called without cache_lock held.
+static void free_buffers(struct free_list *fl)
+{
+    for (int n = 0; n < fl->num_entries; n++) {
+        struct cached_buffer *e = &fl->entries[n];
+        free_data(e->data, e->size, e->mapped);
+    }
+    fl->num_entries = 0;
+}
+
+// Return the size class for size, or 0 if such allocations are not cached.
+static size_t get_class_size(size_t size)
+{
+    if (size < ((size_t)1 << MIN_CLASS_SHIFT))
+        return 0;
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        size_t class_size = (size_t)(4 + c % 4) << (MIN_CLASS_SHIFT - 2 + c / 4);
+        if (class_size >= size)
+            return class_size;
+    }
+    return 0;
+}
+
+// Remove the oldest entry, and add it to fl.
+static void evict_oldest(struct free_list *fl)
+{
+    assert(cache.num_entries > 0);
+    struct cached_buffer e = cache.entries[0];
+    MP_TARRAY_REMOVE_AT(cache.entries, cache.num_entries, 0);
+    cache.stats.cached_bytes -= e.size;
+    drop_buffer(fl, e);
+}
+
+// Can be called from any thread.
+static void release_buffer(void *opaque, uint8_t *data)
+{
+    size_t size = (uintptr_t)opaque & ~(uintptr_t)OPAQUE_MAPPED;
+    bool mapped = (uintptr_t)opaque & OPAQUE_MAPPED;
+    struct cached_buffer buf = {data, size, mapped};
+    struct free_list fl = {0};
+
+    pthread_mutex_lock(&cache_lock);
+    cache.stats.used_bytes -= size;
+    if ((int64_t)size <= cache.limit) {
+        while (cache.num_entries > 0 &&
+               (cache.num_entries == MAX_CACHED ||
+                cache.stats.cached_bytes + size > cache.limit))
+            evict_oldest(&fl);
+        cache.entries[cache.num_entries++] = buf;
+        cache.stats.cached_bytes += size;
+    } else {
+        drop_buffer(&fl, buf);
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    free_buffers(&fl);
+}
+
+struct AVBufferRef *mp_image_buffer_alloc(size_t size)
+{
+    size_t class_size = get_class_size(size);
+    if (!class_size)
+        return av_buffer_alloc(size);
+
+    uint8_t *data = NULL;
+    bool mapped = false;
+    pthread_mutex_lock(&cache_lock);
+    // Prefer the most recently freed buffer, which is more likely to be hot.
+    for (int n = cache.num_entries - 1; n >= 0; n--) {
+        if (cache.entries[n].size == class_size) {
+            data = cache.entries[n].data;
+            mapped = cache.entries[n].mapped;
+            MP_TARRAY_REMOVE_AT(cache.entries, cache.num_entries, n);
+            cache.stats.cached_bytes -= class_size;
+            break;
+        }
+    }
+    int huge_pages = cache.huge_pages;
+    if (data) {
+        cache.stats.hits++;
+        cache.stats.used_bytes += class_size;
+    } else {
+        cache.stats.misses++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    if (!data) {
+        data = alloc_data(class_size, huge_pages, &mapped);
+        if (data) {
+            pthread_mutex_lock(&cache_lock);
+            cache.stats.used_bytes += class_size;
+            if (mapped)
+                cache.stats.huge_bytes += class_size;
+            pthread_mutex_unlock(&cache_lock);
+        }
+    }
+
+    if (!data)
+        return NULL;
+
+    void *opaque = (void *)(uintptr_t)(class_size | (mapped ? OPAQUE_MAPPED : 0));
+    AVBufferRef *ref = av_buffer_create(data, class_size, release_buffer,
+                                        opaque, 0);
+    if (!ref)
+        release_buffer(opaque, data);
+    return ref;
+}
+
+// Must be called with cache_lock held.
+static void update_settings(struct free_list *fl)
+{
+    cache.limit = 0;
+    cache.huge_pages = MP_IMAGE_BUFFER_HUGE_NO;
+    for (int n = 0; n < cache.num_users; n++) {
+        cache.limit = MPMAX(cache.limit, cache.users[n]->limit);
+        cache.huge_pages = MPMAX(cache.huge_pages, cache.users[n]->huge_pages);
+    }
+    cache.stats.limit = cache.limit;
+    while (cache.stats.cached_bytes > cache.limit)
+        evict_oldest(fl);
+}
+
+static void destroy_user(void *p)
+{
+    struct mp_image_buffer_user *user = p;
+    struct free_list fl = {0};
+
+    pthread_mutex_lock(&cache_lock);
+    for (int n = 0; n < cache.num_users; n++) {
+        if (cache.users[n] == user) {
+            MP_TARRAY_REMOVE_AT(cache.users, cache.num_users, n);
+            break;
+        }
+    }
+    if (!cache.num_users)
+        TA_FREEP(&cache.users);
+    update_settings(&fl);
+    pthread_mutex_unlock(&cache_lock);
+
+    free_buffers(&fl);
+}
+
+struct mp_image_buffer_user *mp_image_buffer_user_create(void *ta_parent)
+{
+    struct mp_image_buffer_user *user =
+        talloc_zero(ta_parent, struct mp_image_buffer_user);
+    ta_set_destructor(user, destroy_user);
+
+    pthread_mutex_lock(&cache_lock);
+    MP_TARRAY_APPEND(NULL, cache.users, cache.num_users, user);
+    pthread_mutex_unlock(&cache_lock);
+    return user;
+}
+
+void mp_image_buffer_set_limit(struct mp_image_buffer_user *user, int64_t bytes)
+{
+    struct free_list fl = {0};
+
+    pthread_mutex_lock(&cache_lock);
+    user->limit = MPMAX(bytes, 0);
+    update_settings(&fl);
+    pthread_mutex_unlock(&cache_lock);
+
+    free_buffers(&fl);
+}
+
+void mp_image_buffer_set_huge_pages(struct mp_image_buffer_user *user, int mode)
+{
+    struct free_list fl = {0};
+
+    pthread_mutex_lock(&cache_lock);
+    user->huge_pages = mode;
+    update_settings(&fl);
+    pthread_mutex_unlock(&cache_lock);
+
+    free_buffers(&fl);
+}
+
+void mp_image_buffer_get_stats(struct mp_image_buffer_stats *st)
+{
+    pthread_mutex_lock(&cache_lock);
+    *st = cache.stats;
+    pthread_mutex_unlock(&cache_lock);
+}
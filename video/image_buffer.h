@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Process-wide cache for large image data allocations, used by
+// mp_image_alloc(). Allocations are rounded up to size classes (4 per power
+// of 2), so that a freed buffer can be reused for any image of roughly the
+// same byte size, regardless of format and dimensions. Buffers are returned to
+// the cache when the last reference is dropped, which can happen on any
+// thread. The cache is bounded by a memory budget (least recently freed
+// buffers are released first).
+//
+// The settings are owned by the users of the cache (normally one per player
+// instance). The cache uses the largest limit and huge page mode requested by
+// any user, and drops all unused buffers once the last user is gone.
+
+struct AVBufferRef;
+struct mp_image_buffer_user;
+
+// Return a buffer with at least size bytes. Small sizes are not cached, and
+// are simply passed to av_buffer_alloc(). Returns NULL on OOM.
+struct AVBufferRef *mp_image_buffer_alloc(size_t size);
+
+// Register a user of the cache; its settings are initially 0. Free it with
+// talloc_free() to unregister it.
+struct mp_image_buffer_user *mp_image_buffer_user_create(void *ta_parent);
+
+// Set the maximum total size of unused buffers this user wants the cache to
+// keep. If it's 0 for all users, the cache is disabled (and all unused buffers
+// are freed).
+void mp_image_buffer_set_limit(struct mp_image_buffer_user *user, int64_t bytes);
+
+enum {
+    MP_IMAGE_BUFFER_HUGE_NO,
+    MP_IMAGE_BUFFER_HUGE_TRANSPARENT,   // madvise(MADV_HUGEPAGE)
+    MP_IMAGE_BUFFER_HUGE_EXPLICIT,      // MAP_HUGETLB, THP as fallback
+};
+
+// Set how buffers of at least the huge page size are allocated (one of the
+// MP_IMAGE_BUFFER_HUGE_* values). Affects only new allocations. Ignored on
+// systems without madvise(MADV_HUGEPAGE).
+void mp_image_buffer_set_huge_pages(struct mp_image_buffer_user *user, int mode);
+
+struct mp_image_buffer_stats {
+    int64_t hits;           // allocations satisfied by the cache
+    int64_t misses;         // allocations which had to allocate new memory
+    int64_t cached_bytes;   // total size of unused buffers in the cache
+    int64_t used_bytes;     // total size of cacheable buffers currently in use
+    int64_t huge_bytes;     // total size of buffers allocated with huge pages
+    int64_t limit;          // current limit for cached_bytes
+};
+
+void mp_image_buffer_get_stats(struct mp_image_buffer_stats *st);
@@ -0,0 +1,518 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+#include <libswscale/swscale.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <utime.h>
+#endif
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/ctype.h"
+#include "misc/thread_pool.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
+
+#include "image_cache.h"
+#include "mp_image.h"
+#include "sws_utils.h"
+
+#define OPT_BASE_STRUCT struct image_cache_opts
+
+const struct m_sub_options image_cache_conf = {
+    .opts = (const struct m_option[]){
+        {"image-cache", OPT_FLAG(enable)},
+        {"image-cache-dir", OPT_STRING(dir), .flags = M_OPT_FILE},
+        {"image-cache-max-bytes", OPT_BYTE_SIZE(max_bytes),
+            M_RANGE(0, M_MAX_MEM_BYTES)},
+        {"image-cache-max-dim", OPT_INT(max_dim), M_RANGE(0, 16384)},
+        {0}
+    },
+    .size = sizeof(struct image_cache_opts),
+    .defaults = &(const struct image_cache_opts){
+        .dir = "~~home/image-cache",
+        .max_bytes = 256 * 1024 * 1024,
+    },
+};
+
+// Changing the entry layout requires changing this.
+static const char cache_header[] = "mpv image cache v1\n";
+
+struct entry_header {
+    char imgfmt[32];            // image format name (enum values can change)
+    uint32_t params_size;       // sizeof(struct mp_image_params)
+    struct mp_image_params params;
+};
+
+// Keys are hex SHA-256 hashes.
+#define KEY_LEN (256 / 8 * 2)
+
+// Maximum number of images queued for storing.
+#define MAX_PENDING 4
+
+struct dir_entry {
+    char *path;
+    int64_t size;
+    time_t mtime;
+};
+
+struct mp_image_cache {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_thread_pool *pool;    // single thread for writing entries
+
+    // Serializes directory scans (pruning, clearing).
+    pthread_mutex_t dir_lock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    int pending;                    // number of queued stores
+    struct mp_image_cache_stats stats;
+    char *dir_bytes_path;           // directory stats.dir_bytes refers to
+};
+
+struct store_job {
+    struct mp_image_cache *c;
+    char *key;
+    struct mp_image *img;
+};
+
+static void destroy_cache(void *p)
+{
+    struct mp_image_cache *c = p;
+
+    // Blocks until all pending stores are done.
+    talloc_free(c->pool);
+    pthread_cond_destroy(&c->wakeup);
+    pthread_mutex_destroy(&c->lock);
+    pthread_mutex_destroy(&c->dir_lock);
+}
+
+struct mp_image_cache *mp_image_cache_create(void *ta_parent,
+                                             struct mpv_global *global,
+                                             struct mp_log *log)
+{
+    struct mp_image_cache *c = talloc_ptrtype(ta_parent, c);
+    *c = (struct mp_image_cache){
+        .global = global,
+        .log = log,
+        .stats = {.dir_bytes = -1},
+    };
+    pthread_mutex_init(&c->dir_lock, NULL);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wakeup, NULL);
+    c->pool = mp_thread_pool_create(c, 0, 0, 1);
+    ta_set_destructor(c, destroy_cache);
+    return c;
+}
+
+static bool is_key(const char *name)
+{
+    if (strlen(name) != KEY_LEN)
+        return false;
+    for (int n = 0; n < KEY_LEN; n++) {
+        char c = mp_tolower(name[n]);
+        if (!mp_isdigit(c) && !(c >= 'a' && c <= 'f'))
+            return false;
+    }
+    return true;
+}
+
+// Return NULL if the cache is disabled.
+static struct image_cache_opts *get_opts(void *ta_parent,
+                                         struct mpv_global *global)
+{
+    struct image_cache_opts *opts =
+        mp_get_config_group(ta_parent, global, &image_cache_conf);
+    return opts->enable && opts->dir && opts->dir[0] ? opts : NULL;
+}
+
+static char *get_dir(void *ta_parent, struct mpv_global *global,
+                     struct image_cache_opts *opts)
+{
+    return mp_get_user_path(ta_parent, global, opts->dir);
+}
+
+char *mp_image_cache_key(void *ta_parent, struct mp_image_cache *c,
+                         const void *data, size_t size)
+{
+    void *tmp = talloc_new(NULL);
+    struct image_cache_opts *opts = get_opts(tmp, c->global);
+    char *key = NULL;
+    if (!opts)
+        goto done;
+
+    struct AVSHA *sha = av_sha_alloc();
+    MP_HANDLE_OOM(sha);
+    av_sha_init(sha, 256);
+    av_sha_update(sha, data, size);
+    // Entries are stored downscaled, so the size limit is part of the key.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "\nmax-dim=%d", opts->max_dim);
+    av_sha_update(sha, suffix, strlen(suffix));
+
+    uint8_t hash[256 / 8];
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    key = talloc_zero_size(ta_parent, KEY_LEN + 1);
+    for (int n = 0; n < 256 / 8; n++)
+        snprintf(key + n * 2, KEY_LEN + 1 - n * 2, "%02x", hash[n]);
+
+done:
+    talloc_free(tmp);
+    return key;
+}
+
+static size_t plane_line_bytes(struct mp_image *img, int plane)
+{
+    return (mp_image_plane_w(img, plane) * img->fmt.bpp[plane] + 7) / 8;
+}
+
+static struct mp_image *read_entry(FILE *f)
+{
+    char header[sizeof(cache_header) - 1];
+    struct entry_header eh;
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+        memcmp(header, cache_header, sizeof(header)) != 0 ||
+        fread(&eh, sizeof(eh), 1, f) != 1 ||
+        eh.params_size != sizeof(eh.params))
+        return NULL;
+
+    eh.imgfmt[sizeof(eh.imgfmt) - 1] = '\0';
+    struct mp_image_params params = eh.params;
+    params.imgfmt = mp_imgfmt_from_name(bstr0(eh.imgfmt));
+    params.hw_subfmt = 0;
+    if (!params.imgfmt || params.w < 1 || params.h < 1 ||
+        params.w > 65536 || params.h > 65536)
+        return NULL;
+
+    struct mp_image *img = mp_image_alloc(params.imgfmt, params.w, params.h);
+    if (!img)
+        return NULL;
+    mp_image_set_params(img, &params);
+
+    for (int n = 0; n < img->num_planes; n++) {
+        size_t line_bytes = plane_line_bytes(img, n);
+        int plane_h = mp_image_plane_h(img, n);
+        for (int y = 0; y < plane_h; y++) {
+            uint8_t *line = img->planes[n] + (ptrdiff_t)img->stride[n] * y;
+            if (fread(line, line_bytes, 1, f) != 1) {
+                talloc_free(img);
+                return NULL;
+            }
+        }
+    }
+
+    return img;
+}
+
+struct mp_image *mp_image_cache_load(struct mp_image_cache *c, const char *key)
+{
+    void *tmp = talloc_new(NULL);
+    struct image_cache_opts *opts = get_opts(tmp, c->global);
+    struct mp_image *img = NULL;
+    if (!opts || !key)
+        goto done;
+
+    char *path = mp_path_join(tmp, get_dir(tmp, c->global, opts), key);
+    FILE *f = fopen(path, "rb");
+    if (f) {
+        img = read_entry(f);
+        fclose(f);
+        if (!img)
+            MP_WARN(c, "Ignoring invalid image cache entry %s\n", path);
+    }
+
+#if HAVE_POSIX
+    // Mark as recently used for pruning.
+    if (img)
+        utime(path, NULL);
+#endif
+
+    pthread_mutex_lock(&c->lock);
+    if (img) {
+        c->stats.hits++;
+    } else {
+        c->stats.misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    MP_VERBOSE(c, "Image cache %s: %s\n", img ? "hit" : "miss", key);
+
+done:
+    talloc_free(tmp);
+    return img;
+}
+
+static int compare_mtime(const void *pa, const void *pb)
+{
+    const struct dir_entry *a = pa, *b = pb;
+    return a->mtime < b->mtime ? -1 : (a->mtime > b->mtime ? 1 : 0);
+}
+
+// Remove the least recently used entries until the total size is below
+// max_bytes. max_bytes=-1 removes all entries. Returns the size of the
+// remaining entries, or -1 if the directory can't be read. Must be called with
+// dir_lock.
+static int64_t prune_dir(struct mp_log *log, const char *dir, int64_t max_bytes)
+{
+    void *tmp = talloc_new(NULL);
+    struct dir_entry *entries = NULL;
+    int num_entries = 0;
+    int64_t total = -1;
+
+    DIR *d = opendir(dir);
+    if (!d)
+        goto done;
+    total = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (!is_key(de->d_name))
+            continue;
+        char *path = mp_path_join(tmp, dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0)
+            continue;
+        struct dir_entry e = {path, st.st_size, st.st_mtime};
+        MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+        total += e.size;
+    }
+    closedir(d);
+
+    if (total <= max_bytes)
+        goto done;
+
+    qsort(entries, num_entries, sizeof(entries[0]), compare_mtime);
+    for (int n = 0; n < num_entries && total > max_bytes; n++) {
+        mp_verbose(log, "Removing image cache entry %s\n", entries[n].path);
+        if (unlink(entries[n].path) == 0)
+            total -= entries[n].size;
+    }
+
+done:
+    talloc_free(tmp);
+    return total;
+}
+
+// Update the known directory size after a write or a scan. If rescan is set,
+// size is the result of prune_dir(); otherwise it is the change in size.
+// Returns whether the directory needs to be scanned and pruned.
+static bool update_dir_bytes(struct mp_image_cache *c, const char *dir,
+                             int64_t size, bool rescan, int64_t max_bytes)
+{
+    pthread_mutex_lock(&c->lock);
+    bool known = c->dir_bytes_path && strcmp(c->dir_bytes_path, dir) == 0;
+    if (rescan) {
+        talloc_free(c->dir_bytes_path);
+        c->dir_bytes_path = size >= 0 ? talloc_strdup(c, dir) : NULL;
+        c->stats.dir_bytes = size;
+    } else if (known) {
+        c->stats.dir_bytes += size;
+    }
+    bool over = !known || c->stats.dir_bytes > max_bytes;
+    pthread_mutex_unlock(&c->lock);
+    return over;
+}
+
+static void scan_dir(struct mp_image_cache *c, const char *dir,
+                     int64_t max_bytes)
+{
+    pthread_mutex_lock(&c->dir_lock);
+    int64_t total = prune_dir(c->log, dir, max_bytes);
+    update_dir_bytes(c, dir, total, true, max_bytes);
+    pthread_mutex_unlock(&c->dir_lock);
+}
+
+static int64_t get_file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+static bool write_entry(FILE *f, struct mp_image *img)
+{
+    struct entry_header eh = {
+        .params_size = sizeof(eh.params),
+        .params = img->params,
+    };
+    snprintf(eh.imgfmt, sizeof(eh.imgfmt), "%s", mp_imgfmt_to_name(img->imgfmt));
+    if (fwrite(cache_header, sizeof(cache_header) - 1, 1, f) != 1 ||
+        fwrite(&eh, sizeof(eh), 1, f) != 1)
+        return false;
+
+    for (int n = 0; n < img->num_planes; n++) {
+        size_t line_bytes = plane_line_bytes(img, n);
+        int plane_h = mp_image_plane_h(img, n);
+        for (int y = 0; y < plane_h; y++) {
+            uint8_t *line = img->planes[n] + (ptrdiff_t)img->stride[n] * y;
+            if (fwrite(line, line_bytes, 1, f) != 1)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Return a downscaled copy if img is larger than max_dim, otherwise a new
+// reference. Returns NULL on failure.
+static struct mp_image *downscale(struct mp_image *img, int max_dim)
+{
+    if (!max_dim || (img->w <= max_dim && img->h <= max_dim))
+        return mp_image_new_ref(img);
+
+    double scale = max_dim / (double)MPMAX(img->w, img->h);
+    int w = MPCLAMP(lrint(img->w * scale), 1, max_dim);
+    int h = MPCLAMP(lrint(img->h * scale), 1, max_dim);
+
+    struct mp_image *res = mp_image_alloc(img->imgfmt, w, h);
+    if (!res)
+        return NULL;
+    mp_image_copy_attributes(res, img);
+    if (mp_image_swscale(res, img, SWS_BICUBIC | SWS_ACCURATE_RND) < 0) {
+        talloc_free(res);
+        return NULL;
+    }
+    return res;
+}
+
+// Runs on the worker thread.
+static void write_store(struct mp_image_cache *c, const char *key,
+                        struct mp_image *img)
+{
+    void *tmp = talloc_new(NULL);
+    struct image_cache_opts *opts = get_opts(tmp, c->global);
+    if (!opts)
+        goto done;
+
+    struct mp_image *scaled = downscale(img, opts->max_dim);
+    if (!scaled)
+        goto done;
+    talloc_steal(tmp, scaled);
+
+    char *dir = get_dir(tmp, c->global, opts);
+    char *path = mp_path_join(tmp, dir, key);
+    // Write to a temporary file first, so readers never see partial entries.
+    char *tmp_path = talloc_asprintf(tmp, "%s.tmp", path);
+
+    mp_mkdirp(dir);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        MP_WARN(c, "Could not create image cache entry %s\n", tmp_path);
+        goto done;
+    }
+    bool ok = write_entry(f, scaled);
+    ok &= fclose(f) == 0;
+    int64_t old_size = get_file_size(path);
+    if (!ok || rename(tmp_path, path) != 0) {
+        MP_WARN(c, "Could not write image cache entry %s\n", path);
+        unlink(tmp_path);
+        goto done;
+    }
+
+    MP_VERBOSE(c, "Added image cache entry %s (%dx%d)\n", key,
+               scaled->w, scaled->h);
+
+    pthread_mutex_lock(&c->lock);
+    c->stats.writes++;
+    pthread_mutex_unlock(&c->lock);
+
+    // Scan the directory only if the size is not known yet, or exceeded.
+    if (update_dir_bytes(c, dir, get_file_size(path) - old_size, false,
+                         opts->max_bytes))
+        scan_dir(c, dir, opts->max_bytes);
+
+done:
+    talloc_free(tmp);
+}
+
+static void store_worker(void *p)
+{
+    struct store_job *job = p;
+    struct mp_image_cache *c = job->c;
+
+    write_store(c, job->key, job->img);
+    talloc_free(job);
+
+    pthread_mutex_lock(&c->lock);
+    c->pending--;
+    pthread_cond_broadcast(&c->wakeup);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mp_image_cache_store(struct mp_image_cache *c, const char *key,
+                          struct mp_image *img)
+{
+    if (!key || !img || !img->num_planes || img->icc_profile ||
+        (img->fmt.flags & (MP_IMGFLAG_HWACCEL | MP_IMGFLAG_PAL)))
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    bool busy = c->pending >= MAX_PENDING;
+    if (!busy)
+        c->pending++;
+    pthread_mutex_unlock(&c->lock);
+    if (busy) {
+        MP_VERBOSE(c, "Too many pending image cache writes; skipping %s\n", key);
+        return;
+    }
+
+    struct store_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct store_job){
+        .c = c,
+        .key = talloc_strdup(job, key),
+        .img = mp_image_new_ref(img),
+    };
+    talloc_steal(job, job->img);
+    if (!job->img || !mp_thread_pool_queue(c->pool, store_worker, job)) {
+        talloc_free(job);
+        pthread_mutex_lock(&c->lock);
+        c->pending--;
+        pthread_cond_broadcast(&c->wakeup);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+void mp_image_cache_flush(struct mp_image_cache *c)
+{
+    pthread_mutex_lock(&c->lock);
+    while (c->pending)
+        pthread_cond_wait(&c->wakeup, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void mp_image_cache_clear(struct mp_image_cache *c)
+{
+    // Don't let pending stores add entries right after clearing.
+    mp_image_cache_flush(c);
+
+    void *tmp = talloc_new(NULL);
+    struct image_cache_opts *opts =
+        mp_get_config_group(tmp, c->global, &image_cache_conf);
+    if (opts->dir && opts->dir[0])
+        scan_dir(c, get_dir(tmp, c->global, opts), -1);
+    talloc_free(tmp);
+}
+
+void mp_image_cache_get_stats(struct mp_image_cache *c,
+                              struct mp_image_cache_stats *st)
+{
+    pthread_mutex_lock(&c->lock);
+    *st = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
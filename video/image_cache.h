@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent on-disk cache for decoded still images (such as cover art).
+// Entries are keyed by a hash of the encoded image data, so the same image
+// embedded in many files is decoded only once. The cache directory is bounded
+// by a byte limit; the least recently used entries are removed first.
+// There is normally one mp_image_cache per player instance, which keeps the
+// statistics and the estimated directory size. All functions are thread-safe.
+
+struct m_sub_options;
+struct mpv_global;
+struct mp_log;
+struct mp_image;
+
+struct image_cache_opts {
+    int enable;
+    char *dir;
+    int64_t max_bytes;
+    int max_dim;
+};
+
+extern const struct m_sub_options image_cache_conf;
+
+struct mp_image_cache;
+
+// Free with talloc_free(). This waits until pending stores are written.
+struct mp_image_cache *mp_image_cache_create(void *ta_parent,
+                                             struct mpv_global *global,
+                                             struct mp_log *log);
+
+// Return the cache key for the given encoded image data, or NULL if the cache
+// is disabled. The result is allocated with ta_parent.
+char *mp_image_cache_key(void *ta_parent, struct mp_image_cache *c,
+                         const void *data, size_t size);
+
+// Return the cached image for the key, or NULL if there is none.
+struct mp_image *mp_image_cache_load(struct mp_image_cache *c, const char *key);
+
+// Add the decoded image to the cache. This only takes a new reference, and
+// returns immediately; downscaling and writing happens on a worker thread.
+// The image is downscaled if it is larger than configured. Images which can't
+// be stored (hardware surfaces, palette formats, images with ICC profiles) are
+// silently ignored, and so are images stored while too many others are still
+// pending.
+void mp_image_cache_store(struct mp_image_cache *c, const char *key,
+                          struct mp_image *img);
+
+// Wait until all pending stores are done.
+void mp_image_cache_flush(struct mp_image_cache *c);
+
+// Remove all entries from the cache directory.
+void mp_image_cache_clear(struct mp_image_cache *c);
+
+struct mp_image_cache_stats {
+    int64_t hits;       // lookups which found an entry
+    int64_t misses;     // lookups which didn't
+    int64_t writes;     // entries added
+    int64_t dir_bytes;  // estimated size of the directory (-1 if not known)
+};
+
+void mp_image_cache_get_stats(struct mp_image_cache *c,
+                              struct mp_image_cache_stats *st);
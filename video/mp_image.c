@@ -39,6 +39,7 @@
 #include "common/av_common.h"
 #include "common/common.h"
 #include "hwdec.h"
+#include "image_buffer.h"
 #include "mp_image.h"
 #include "sws_utils.h"
 #include "fmt-conversion.h"
@@ -177,7 +178,7 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
         return false;
 
     // Note: mp_image_pool assumes this creates only 1 AVBufferRef.
-    mpi->bufs[0] = av_buffer_alloc(size + align);
+    mpi->bufs[0] = mp_image_buffer_alloc(size + align);
     if (!mpi->bufs[0])
         return false;
 
@@ -1055,10 +1056,11 @@ struct mp_image *mp_image_from_av_frame(struct AVFrame *src)
 }
 
 
-// Convert the mp_image reference to a AVFrame reference.
-struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
+// Takes ownership of new_ref, which is src itself or a new reference to it.
+// All buffer references are moved from new_ref to the AVFrame.
+static struct AVFrame *image_to_av_frame(struct mp_image *src,
+                                         struct mp_image *new_ref)
 {
-    struct mp_image *new_ref = mp_image_new_ref(src);
     AVFrame *dst = av_frame_alloc();
     if (!dst || !new_ref) {
         talloc_free(new_ref);
@@ -1145,9 +1147,20 @@ struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
     return dst;
 }
 
+// Convert the mp_image reference to a AVFrame reference.
+struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
+{
+    return image_to_av_frame(src, mp_image_new_ref(src));
+}
+
 // Same as mp_image_to_av_frame(), but unref img. (It does so even on failure.)
+// If img is refcounted, its references are moved to the AVFrame, instead of
+// creating new ones.
 struct AVFrame *mp_image_to_av_frame_and_unref(struct mp_image *img)
 {
+    if (img && img->bufs[0])
+        return image_to_av_frame(img, img);
+
     AVFrame *frame = mp_image_to_av_frame(img);
     talloc_free(img);
     return frame;
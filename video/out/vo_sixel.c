@@ -21,8 +21,10 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <libswscale/swscale.h>
 #include <sixel.h>
@@ -30,6 +32,7 @@
 #include "config.h"
 #include "options/m_config.h"
 #include "osdep/terminal.h"
+#include "osdep/threads.h"
 #include "sub/osd.h"
 #include "vo.h"
 #include "video/sws_utils.h"
@@ -48,6 +51,15 @@
 #define ESC_GOTOXY                  "\033[%d;%df"
 #define ESC_USE_GLOBAL_COLOR_REG    "\033[?1070l"
 
+// A (partial) image to be encoded and written by the encoder thread.
+struct sixel_job {
+    uint8_t *buffer;            // full image
+    sixel_dither_t *dither;
+    int width, height;          // full image size
+    int y0, y1;                 // range of rows to encode
+    int top, left;              // cell position of row y0 (1 based)
+};
+
 struct priv {
 
     // User specified options
@@ -64,6 +76,7 @@ struct priv {
     int opt_rows;
     int opt_cols;
     int opt_clear;
+    int opt_incremental;
 
     // Internal data
     sixel_output_t *output;
@@ -72,9 +85,15 @@ struct priv {
     uint8_t        *buffer;
     bool            skip_frame_draw;
 
+    // Last image passed to the encoder (i.e. what's on screen)
+    uint8_t        *shown;
+    sixel_dither_t *shown_dither;
+    bool            shown_valid;
+
     int left, top;  // image origin cell (1 based)
     int width, height;  // actual image px size - always reflects dst_rect.
     int num_cols, num_rows;  // terminal size in cells
+    int cell_height;  // exact cell height in px, or 0 if unknown
     int canvas_ok;  // whether canvas vo->dwidth and vo->dheight are positive
 
     int previous_histgram_colors;
@@ -84,6 +103,17 @@ struct priv {
     struct mp_osd_res osd;
     struct mp_image *frame;
     struct mp_sws_context *sws;
+
+    // Encoder thread; encodes and writes a frame while the next one is
+    // being prepared.
+    pthread_t thread;
+    bool thread_ok;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    bool busy;                  // job is set and being encoded
+    bool terminate;
+    struct sixel_job job;
 };
 
 static const unsigned int depth = 3;
@@ -115,15 +145,91 @@ static int detect_scene_change(struct vo* vo)
 
 }
 
+static void encode_job(struct priv *priv, struct sixel_job *job)
+{
+    // Go to the offset row and column, then display the image
+    printf(ESC_GOTOXY, job->top, job->left);
+    sixel_encode(job->buffer + job->y0 * job->width * depth, job->width,
+                 job->y1 - job->y0, depth, job->dither, priv->output);
+    fflush(stdout);
+}
+
+static void *encode_thread(void *p)
+{
+    struct priv *priv = p;
+
+    mpthread_set_name("sixel");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (priv->busy) {
+            struct sixel_job job = priv->job;
+            pthread_mutex_unlock(&priv->lock);
+            encode_job(priv, &job);
+            pthread_mutex_lock(&priv->lock);
+            priv->busy = false;
+            pthread_cond_broadcast(&priv->wakeup);
+            continue;
+        }
+        if (priv->terminate)
+            break;
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    }
+    pthread_mutex_unlock(&priv->lock);
+
+    return NULL;
+}
+
+// Wait until the encoder is done with the previous frame. Must be called
+// before touching the terminal or the shown image.
+static void wait_encoder(struct priv *priv)
+{
+    if (!priv->thread_ok)
+        return;
+
+    pthread_mutex_lock(&priv->lock);
+    while (priv->busy)
+        pthread_cond_wait(&priv->wakeup, &priv->lock);
+    pthread_mutex_unlock(&priv->lock);
+}
+
+static void start_encoder(struct priv *priv, struct sixel_job *job)
+{
+    if (!priv->thread_ok) {
+        encode_job(priv, job);
+        return;
+    }
+
+    pthread_mutex_lock(&priv->lock);
+    assert(!priv->busy);
+    priv->job = *job;
+    priv->busy = true;
+    pthread_cond_broadcast(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+}
+
 static void dealloc_dithers_and_buffers(struct vo* vo)
 {
     struct priv* priv = vo->priv;
 
+    wait_encoder(priv);
+
     if (priv->buffer) {
         talloc_free(priv->buffer);
         priv->buffer = NULL;
     }
 
+    if (priv->shown) {
+        talloc_free(priv->shown);
+        priv->shown = NULL;
+    }
+    priv->shown_valid = false;
+
+    if (priv->shown_dither) {
+        sixel_dither_unref(priv->shown_dither);
+        priv->shown_dither = NULL;
+    }
+
     if (priv->frame) {
         talloc_free(priv->frame);
         priv->frame = NULL;
@@ -150,9 +256,9 @@ static SIXELSTATUS prepare_static_palette(struct vo* vo)
             return SIXEL_FALSE;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opt_diffuse);
+        sixel_dither_set_body_only(priv->dither, 0);
     }
 
-    sixel_dither_set_body_only(priv->dither, 0);
     return SIXEL_OK;
 }
 
@@ -184,12 +290,13 @@ static SIXELSTATUS prepare_dynamic_palette(struct vo *vo)
             return status;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opt_diffuse);
+        // (Set only on new dithers; the encoder thread might use the old one.)
+        sixel_dither_set_body_only(priv->dither, 0);
     } else {
         if (priv->dither == NULL)
             return SIXEL_FALSE;
     }
 
-    sixel_dither_set_body_only(priv->dither, 0);
     return status;
 }
 
@@ -205,6 +312,8 @@ static void update_canvas_dimensions(struct vo *vo)
 
     terminal_get_size2(&num_rows, &num_cols, &total_px_width, &total_px_height);
 
+    bool px_height_known = total_px_height > 0 || priv->opt_height > 0;
+
     // If the user has specified rows/cols use them for further calculations
     num_rows = (priv->opt_rows > 0) ? priv->opt_rows : num_rows;
     num_cols = (priv->opt_cols > 0) ? priv->opt_cols : num_cols;
@@ -259,6 +368,11 @@ static void update_canvas_dimensions(struct vo *vo)
     priv->num_rows = num_rows;
     priv->num_cols = num_cols;
 
+    // Partial updates must start exactly at a cell boundary.
+    priv->cell_height = 0;
+    if (px_height_known && num_rows > 0 && total_px_height % num_rows == 0)
+        priv->cell_height = total_px_height / num_rows;
+
     priv->canvas_ok = vo->dwidth > 0 && vo->dheight > 0;
 }
 
@@ -322,6 +436,8 @@ static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
 
     priv->buffer =
         talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
+    priv->shown =
+        talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
 
     return 0;
 }
@@ -336,6 +452,8 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         ret = update_sixel_swscaler(vo, params);
     }
 
+    wait_encoder(priv);
+    priv->shown_valid = false;
     printf(ESC_CLEAR_SCREEN);
     vo->want_redraw = true;
 
@@ -365,6 +483,7 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
         // with a failed reconfig.
         update_sixel_swscaler(vo, vo->params);
 
+        wait_encoder(priv);
         printf(ESC_CLEAR_SCREEN);
         resized = true;
     }
@@ -427,6 +546,30 @@ static int sixel_write(char *data, int size, void *priv)
     return fwrite(data, 1, size, (FILE *)priv);
 }
 
+// Find the rows which changed compared to the shown image, and align them
+// for a partial update. Returns false if nothing changed.
+static bool find_changed_rows(struct priv *priv, int *out_y0, int *out_y1)
+{
+    size_t stride = depth * priv->width;
+    int first = 0, last = priv->height - 1;
+
+    while (first <= last &&
+           !memcmp(priv->buffer + first * stride, priv->shown + first * stride,
+                   stride))
+        first++;
+    if (first > last)
+        return false;
+    while (!memcmp(priv->buffer + last * stride, priv->shown + last * stride,
+                   stride))
+        last--;
+
+    // The image must start at a cell, and sixel bands are 6 pixels high. Rows
+    // after the changed ones are simply re-encoded with the same content.
+    *out_y0 = first / priv->cell_height * priv->cell_height;
+    *out_y1 = MPMIN(*out_y0 + MP_ALIGN_UP(last + 1 - *out_y0, 6), priv->height);
+    return true;
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv* priv = vo->priv;
@@ -441,11 +584,38 @@ static void flip_page(struct vo *vo)
     if (priv->buffer == NULL || priv->dither == NULL)
         return;
 
-    // Go to the offset row and column, then display the image
-    printf(ESC_GOTOXY, priv->top, priv->left);
-    sixel_encode(priv->buffer, priv->width, priv->height,
-                 depth, priv->dither, priv->output);
-    fflush(stdout);
+    wait_encoder(priv);
+
+    struct sixel_job job = {
+        .dither = priv->dither,
+        .width = priv->width,
+        .height = priv->height,
+        .y0 = 0,
+        .y1 = priv->height,
+        .top = priv->top,
+        .left = priv->left,
+    };
+
+    // A new palette changes the output for all pixels.
+    if (priv->opt_incremental && priv->cell_height > 0 && priv->shown_valid &&
+        priv->shown_dither == priv->dither)
+    {
+        if (!find_changed_rows(priv, &job.y0, &job.y1))
+            return;
+        job.top += job.y0 / priv->cell_height;
+    }
+
+    MPSWAP(uint8_t *, priv->buffer, priv->shown);
+    job.buffer = priv->shown;
+    priv->shown_valid = true;
+
+    // Keep the dither alive while the encoder is using it.
+    sixel_dither_ref(priv->dither);
+    if (priv->shown_dither)
+        sixel_dither_unref(priv->shown_dither);
+    priv->shown_dither = priv->dither;
+
+    start_encoder(priv, &job);
 }
 
 static int preinit(struct vo *vo)
@@ -487,6 +657,12 @@ static int preinit(struct vo *vo)
 
     priv->previous_histgram_colors = 0;
 
+    pthread_mutex_init(&priv->lock, NULL);
+    pthread_cond_init(&priv->wakeup, NULL);
+    priv->thread_ok = !pthread_create(&priv->thread, NULL, encode_thread, priv);
+    if (!priv->thread_ok)
+        MP_WARN(vo, "Failed to create encoder thread, encoding synchronously.\n");
+
     return 0;
 }
 
@@ -507,6 +683,15 @@ static void uninit(struct vo *vo)
 {
     struct priv *priv = vo->priv;
 
+    if (priv->thread_ok) {
+        pthread_mutex_lock(&priv->lock);
+        priv->terminate = true;
+        pthread_cond_broadcast(&priv->wakeup);
+        pthread_mutex_unlock(&priv->lock);
+        pthread_join(priv->thread, NULL);
+        priv->thread_ok = false;
+    }
+
     printf(ESC_RESTORE_CURSOR);
 
     if (priv->opt_clear) {
@@ -521,6 +706,9 @@ static void uninit(struct vo *vo)
     }
 
     dealloc_dithers_and_buffers(vo);
+
+    pthread_cond_destroy(&priv->wakeup);
+    pthread_mutex_destroy(&priv->lock);
 }
 
 #define OPT_BASE_STRUCT struct priv
@@ -550,6 +738,7 @@ const struct vo_driver video_out_sixel = {
         .opt_rows = 0,
         .opt_cols = 0,
         .opt_clear = 1,
+        .opt_incremental = 1,
     },
     .options = (const m_option_t[]) {
         {"dither", OPT_CHOICE(opt_diffuse,
@@ -574,6 +763,7 @@ const struct vo_driver video_out_sixel = {
         {"rows", OPT_INT(opt_rows)},
         {"cols", OPT_INT(opt_cols)},
         {"exit-clear", OPT_FLAG(opt_clear), },
+        {"incremental", OPT_FLAG(opt_incremental)},
         {0}
     },
     .options_prefix = "vo-sixel",
@@ -15,7 +15,9 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <config.h>
 
@@ -25,6 +27,7 @@
 
 #include <libswscale/swscale.h>
 
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "config.h"
 #include "osdep/terminal.h"
@@ -43,18 +46,22 @@
 #define ESC_CLEAR_SCREEN "\033[2J"
 #define ESC_CLEAR_COLORS "\033[0m"
 #define ESC_GOTOXY "\033[%d;%df"
+#define ESC_CURSOR_FORWARD "\033[%dC"
 #define ESC_COLOR_BG "\033[48;2"
 #define ESC_COLOR_FG "\033[38;2"
 #define ESC_COLOR256_BG "\033[48;5"
 #define ESC_COLOR256_FG "\033[38;5"
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
+#define NO_COLOR UINT32_MAX
 
 struct vo_tct_opts {
     int algo;
     int width;   // 0 -> default
     int height;  // 0 -> default
     int term256;  // 0 -> true color
+    int delta;
+    int delta_threshold;
 };
 
 #define OPT_BASE_STRUCT struct vo_tct_opts
@@ -66,10 +73,13 @@ static const struct m_sub_options vo_tct_conf = {
         {"vo-tct-width", OPT_INT(width)},
         {"vo-tct-height", OPT_INT(height)},
         {"vo-tct-256", OPT_FLAG(term256)},
+        {"vo-tct-delta", OPT_FLAG(delta)},
+        {"vo-tct-delta-threshold", OPT_INT(delta_threshold), M_RANGE(0, 255)},
         {0}
     },
     .defaults = &(const struct vo_tct_opts) {
         .algo = ALGO_HALF_BLOCKS,
+        .delta = 1,
     },
     .size = sizeof(struct vo_tct_opts),
 };
@@ -89,6 +99,12 @@ struct priv {
     struct mp_rect dst;
     struct mp_sws_context *sws;
     struct lut_item lut[256];
+    struct stats_ctx *stats;
+    bstr out;               // output buffer, reused for each frame
+    uint32_t *cells;        // bg/fg colors of each cell on the terminal
+    bool cells_valid;       // cells[] match the terminal contents
+    int cur_col, cur_row;   // terminal cursor position while writing a frame
+    uint32_t cur_bg, cur_fg;
 };
 
 // Convert RGB24 to xterm-256 8-bit value
@@ -120,96 +136,155 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
     return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
 }
 
-static void print_seq3(struct lut_item *lut, const char* prefix,
-                       uint8_t r, uint8_t g, uint8_t b)
+static void append_seq3(struct priv *p, const char *prefix,
+                        uint8_t r, uint8_t g, uint8_t b)
 {
-// The fwrite implementation is about 25% faster than the printf code
-// (even if we use *.s with the lut values), however,
-// on windows we need to use printf in order to translate escape sequences and
-// UTF8 output for the console.
-#ifndef _WIN32
-    fputs(prefix, stdout);
-    fwrite(lut[r].str, lut[r].width, 1, stdout);
-    fwrite(lut[g].str, lut[g].width, 1, stdout);
-    fwrite(lut[b].str, lut[b].width, 1, stdout);
-    fputc('m', stdout);
-#else
-    printf("%s;%d;%d;%dm", prefix, (int)r, (int)g, (int)b);
-#endif
+    struct lut_item *lut = p->lut;
+    bstr_xappend(p, &p->out, bstr0(prefix));
+    bstr_xappend(p, &p->out, (bstr){lut[r].str, lut[r].width});
+    bstr_xappend(p, &p->out, (bstr){lut[g].str, lut[g].width});
+    bstr_xappend(p, &p->out, (bstr){lut[b].str, lut[b].width});
+    bstr_xappend(p, &p->out, bstr0("m"));
 }
 
-static void print_seq1(struct lut_item *lut, const char* prefix, uint8_t c)
+static void append_seq1(struct priv *p, const char *prefix, uint8_t c)
 {
-#ifndef _WIN32
-    fputs(prefix, stdout);
-    fwrite(lut[c].str, lut[c].width, 1, stdout);
-    fputc('m', stdout);
-#else
-    printf("%s;%dm", prefix, (int)c);
-#endif
+    struct lut_item *lut = p->lut;
+    bstr_xappend(p, &p->out, bstr0(prefix));
+    bstr_xappend(p, &p->out, (bstr){lut[c].str, lut[c].width});
+    bstr_xappend(p, &p->out, bstr0("m"));
+}
+
+static void append_color(struct priv *p, bool fg, uint32_t c)
+{
+    if (p->opts->term256) {
+        append_seq1(p, fg ? ESC_COLOR256_FG : ESC_COLOR256_BG, c);
+    } else {
+        append_seq3(p, fg ? ESC_COLOR_FG : ESC_COLOR_BG,
+                    (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF);
+    }
 }
 
+static uint32_t get_color(struct priv *p, const unsigned char *px)
+{
+    unsigned char b = px[0], g = px[1], r = px[2];
+    if (p->opts->term256)
+        return rgb_to_x256(r, g, b);
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256, struct lut_item *lut)
+static bool color_close(struct priv *p, uint32_t a, uint32_t b)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                print_seq1(lut, ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                print_seq3(lut, ESC_COLOR_BG, r, g, b);
-            }
-            printf(" ");
+    int t = p->opts->delta_threshold;
+    if (p->opts->term256 || !t)
+        return a == b;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+        if (abs(ca - cb) > t)
+            return false;
+    }
+    return true;
+}
+
+// Write a cell at the given 1-based terminal position, and avoid cursor
+// movement and color changes where possible.
+static void write_cell(struct priv *p, int col, int row, uint32_t bg,
+                       uint32_t fg, bool half_block)
+{
+    if (p->cur_row != row || p->cur_col != col) {
+        if (p->cur_row == row && p->cur_col < col) {
+            bstr_xappend_asprintf(p, &p->out, ESC_CURSOR_FORWARD,
+                                  col - p->cur_col);
+        } else {
+            bstr_xappend_asprintf(p, &p->out, ESC_GOTOXY, row, col);
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+    if (p->cur_bg != bg)
+        append_color(p, false, bg);
+    p->cur_bg = bg;
+    if (half_block) {
+        if (p->cur_fg != fg)
+            append_color(p, true, fg);
+        p->cur_fg = fg;
+        // UTF8 bytes of U+2584 (lower half block)
+        bstr_xappend(p, &p->out, bstr0("\xe2\x96\x84"));
+    } else {
+        bstr_xappend(p, &p->out, bstr0(" "));
+    }
+    p->cur_col = col + 1;
+    p->cur_row = row;
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256, struct lut_item *lut)
+// Build the frame in p->out. Cells which didn't change since the last frame
+// are skipped if delta encoding is enabled.
+static void write_frame(struct vo *vo, const unsigned char *source,
+                        int source_stride)
 {
+    struct priv *p = vo->priv;
     assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                print_seq1(lut, ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                print_seq1(lut, ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                print_seq3(lut, ESC_COLOR_BG, r_up, g_up, b_up);
-                print_seq3(lut, ESC_COLOR_FG, r_down, g_down, b_down);
-            }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+
+    bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    bool delta = p->opts->delta && p->cells_valid;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+
+    p->out.len = 0;
+    p->cur_col = p->cur_row = -1;
+    p->cur_bg = p->cur_fg = NO_COLOR;
+
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *row_up = source;
+        const unsigned char *row_down = NULL;
+        if (half_blocks) {
+            row_up += y * 2 * source_stride;
+            row_down = row_up + source_stride;
+        } else {
+            row_up += y * source_stride;
+        }
+        uint32_t *cells = &p->cells[y * p->swidth * 2];
+        for (int x = 0; x < p->swidth; x++) {
+            uint32_t bg = get_color(p, row_up + x * 3);
+            uint32_t fg = row_down ? get_color(p, row_down + x * 3) : 0;
+            uint32_t *cell = &cells[x * 2];
+            if (delta && color_close(p, cell[0], bg) &&
+                color_close(p, cell[1], fg))
+                continue;
+            cell[0] = bg;
+            cell[1] = fg;
+            write_cell(p, tx + x + 1, ty + y + 1, bg, fg, half_blocks);
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+
+    p->cells_valid = true;
+
+    if (p->out.len) {
+        bstr_xappend(p, &p->out, bstr0(ESC_CLEAR_COLORS));
+        bstr_xappend_asprintf(p, &p->out, ESC_GOTOXY, ty + p->sheight + 1, 1);
+    }
+}
+
+// Write p->out to the terminal with a single call.
+static void flush_output(struct priv *p)
+{
+#ifndef _WIN32
+    fflush(stdout); // don't reorder with other stdout output
+    const char *buf = p->out.start;
+    size_t left = p->out.len;
+    while (left > 0) {
+        ssize_t r = write(STDOUT_FILENO, buf, left);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        buf += r;
+        left -= r;
+    }
+#else
+    // printf translates escape sequences and UTF8 for the console.
+    printf("%.*s", BSTR_P(p->out));
+    fflush(stdout);
+#endif
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -252,6 +327,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (!p->frame)
         return -1;
 
+    p->cells = talloc_realloc(p, p->cells, uint32_t, p->swidth * p->sheight * 2);
+    p->cells_valid = false;
+
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
@@ -280,18 +358,9 @@ static void flip_page(struct vo *vo)
     if (vo->dwidth != width || vo->dheight != height)
         reconfig(vo, vo->params);
 
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256, p->lut);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256, p->lut);
-    }
-    fflush(stdout);
+    write_frame(vo, p->frame->planes[0], p->frame->stride[0]);
+    stats_size_value(p->stats, "bytes-per-frame", p->out.len);
+    flush_output(p);
 }
 
 static void uninit(struct vo *vo)
@@ -314,6 +383,7 @@ static int preinit(struct vo *vo)
     p->opts = mp_get_config_group(vo, vo->global, &vo_tct_conf);
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
+    p->stats = stats_ctx_create(p, vo->global, "vo/tct");
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
 
     for (int i = 0; i < 256; ++i) {
@@ -0,0 +1,289 @@
+#include <math.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "common/av_common.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/packet.h"
+#include "demux/stheader.h"
+#include "misc/thread_tools.h"
+#include "stream/stream.h"
+
+#include "mp_image.h"
+#include "sws_utils.h"
+#include "thumbnailer.h"
+
+struct thumb_ctx {
+    struct mp_log *log;
+    struct mpv_global *global;
+    struct mp_cancel *cancel;
+
+    struct demuxer *demuxer;
+    struct sh_stream *sh;
+
+    AVCodecContext *avctx;
+    AVRational tb;
+    AVFrame *frame;
+
+    struct mp_thumbnails *res;
+    struct mp_sws_context **sws; // one per sheet
+    int *widths;
+};
+
+static bool init_decoder(struct thumb_ctx *ctx)
+{
+    struct mp_codec_params *c = ctx->sh->codec;
+    const AVCodec *codec =
+        avcodec_find_decoder(mp_codec_to_av_codec_id(c->codec));
+    if (!codec) {
+        MP_ERR(ctx, "No decoder for codec '%s'.\n", c->codec);
+        return false;
+    }
+
+    ctx->avctx = avcodec_alloc_context3(codec);
+    ctx->frame = av_frame_alloc();
+    if (!ctx->avctx || !ctx->frame)
+        return false;
+
+    AVCodecParameters *par = mp_codec_params_to_av(c);
+    if (!par || avcodec_parameters_to_context(ctx->avctx, par) < 0) {
+        avcodec_parameters_free(&par);
+        return false;
+    }
+    avcodec_parameters_free(&par);
+
+    ctx->tb = mp_get_codec_timebase(c);
+    ctx->avctx->pkt_timebase = ctx->tb;
+    // Every keyframe is decoded on its own, so frame threading can't help.
+    ctx->avctx->thread_type = FF_THREAD_SLICE;
+    mp_set_avcodec_threads(ctx->log, ctx->avctx, 0);
+    ctx->avctx->skip_frame = AVDISCARD_NONKEY;
+    // Deblocking artifacts are invisible after downscaling.
+    ctx->avctx->skip_loop_filter = AVDISCARD_ALL;
+
+    if (avcodec_open2(ctx->avctx, codec, NULL) < 0) {
+        MP_ERR(ctx, "Could not open decoder.\n");
+        return false;
+    }
+    return true;
+}
+
+static struct mp_image *decode_keyframe(struct thumb_ctx *ctx,
+                                        struct demux_packet *pkt)
+{
+    AVCodecContext *avctx = ctx->avctx;
+    struct mp_image *img = NULL;
+
+    avcodec_flush_buffers(avctx);
+
+    AVPacket avpkt;
+    mp_set_av_packet(&avpkt, pkt, &ctx->tb);
+    if (avcodec_send_packet(avctx, &avpkt) < 0)
+        return NULL;
+    // Drain, so the frame is returned even with decoders that have delay.
+    avcodec_send_packet(avctx, NULL);
+
+    while (avcodec_receive_frame(avctx, ctx->frame) >= 0) {
+        if (!img)
+            img = mp_image_from_av_frame(ctx->frame);
+        av_frame_unref(ctx->frame);
+    }
+
+    if (img)
+        mp_image_params_guess_csp(&img->params);
+    return img;
+}
+
+// Seek to the keyframe before pts, and return its packet.
+static struct demux_packet *read_keyframe(struct thumb_ctx *ctx, double pts)
+{
+    demux_seek(ctx->demuxer, pts, 0);
+
+    while (!mp_cancel_test(ctx->cancel)) {
+        struct demux_packet *pkt = demux_read_any_packet(ctx->demuxer);
+        if (!pkt)
+            break;
+        if (pkt->stream == ctx->sh->index && pkt->keyframe)
+            return pkt;
+        talloc_free(pkt);
+    }
+    return NULL;
+}
+
+static bool create_sheets(struct thumb_ctx *ctx, struct mp_image *img,
+                          int columns)
+{
+    struct mp_thumbnails *res = ctx->res;
+    int count = res->num_thumbnails;
+    if (columns <= 0)
+        columns = ceil(sqrt(count));
+    columns = MPMIN(columns, count);
+    int rows = (count + columns - 1) / columns;
+
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (d_w < 1 || d_h < 1)
+        return false;
+
+    for (int n = 0; n < res->num_sheets; n++) {
+        struct mp_thumbnail_sheet *s = &res->sheets[n];
+        s->tile_w = ctx->widths[n];
+        s->tile_h = MPMAX(lrint(s->tile_w * (double)d_h / d_w), 1);
+        s->columns = columns;
+        s->rows = rows;
+        s->image = mp_image_alloc(IMGFMT_BGR0, columns * s->tile_w,
+                                  rows * s->tile_h);
+        if (!s->image)
+            return false;
+        talloc_steal(res, s->image);
+        mp_image_params_guess_csp(&s->image->params);
+        mp_image_clear(s->image, 0, 0, s->image->w, s->image->h);
+
+        ctx->sws[n] = mp_sws_alloc(ctx->sws);
+        mp_sws_enable_cmdline_opts(ctx->sws[n], ctx->global);
+    }
+    return true;
+}
+
+static void render_tile(struct thumb_ctx *ctx, int index, struct mp_image *img)
+{
+    struct mp_thumbnails *res = ctx->res;
+    for (int n = 0; n < res->num_sheets; n++) {
+        struct mp_thumbnail_sheet *s = &res->sheets[n];
+        int x = (index % s->columns) * s->tile_w;
+        int y = (index / s->columns) * s->tile_h;
+        // Render directly into the sheet through a view of the tile.
+        struct mp_image tile = *s->image;
+        mp_image_crop(&tile, x, y, x + s->tile_w, y + s->tile_h);
+        if (mp_sws_scale(ctx->sws[n], &tile, img) < 0)
+            MP_WARN(ctx, "Could not scale thumbnail %d.\n", index);
+    }
+}
+
+static bool generate(struct thumb_ctx *ctx, const char *url, int columns,
+                     bool rebase)
+{
+    struct demuxer_params params = {
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+    };
+    ctx->demuxer = demux_open_url(url, &params, ctx->cancel, ctx->global);
+    if (!ctx->demuxer)
+        return false;
+
+    for (int n = 0; n < demux_get_num_stream(ctx->demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(ctx->demuxer, n);
+        bool video = sh->type == STREAM_VIDEO && !sh->attached_picture &&
+                     !sh->image;
+        if (video && !ctx->sh)
+            ctx->sh = sh;
+        demuxer_select_track(ctx->demuxer, sh, MP_NOPTS_VALUE, sh == ctx->sh);
+    }
+    if (!ctx->sh) {
+        MP_ERR(ctx, "No video stream.\n");
+        return false;
+    }
+
+    double duration = ctx->demuxer->duration;
+    if (!ctx->demuxer->seekable || !(duration > 0)) {
+        MP_ERR(ctx, "File is not seekable or has unknown duration.\n");
+        return false;
+    }
+    double start = rebase ? 0 : ctx->demuxer->start_time;
+    if (rebase)
+        demux_set_ts_offset(ctx->demuxer, -ctx->demuxer->start_time);
+
+    if (!init_decoder(ctx))
+        return false;
+
+    struct mp_thumbnails *res = ctx->res;
+    struct mp_image *prev = NULL;
+    double prev_pts = MP_NOPTS_VALUE;
+    int decoded = 0;
+
+    for (int i = 0; i < res->num_thumbnails; i++) {
+        res->timestamps[i] = MP_NOPTS_VALUE;
+
+        double target = start + duration * (i + 0.5) / res->num_thumbnails;
+        struct demux_packet *pkt = read_keyframe(ctx, target);
+        if (mp_cancel_test(ctx->cancel)) {
+            talloc_free(pkt);
+            break;
+        }
+        if (!pkt)
+            continue;
+
+        // Close positions often map to the same keyframe.
+        struct mp_image *img = NULL;
+        if (prev && pkt->pts != MP_NOPTS_VALUE && pkt->pts == prev_pts) {
+            img = mp_image_new_ref(prev);
+        } else {
+            img = decode_keyframe(ctx, pkt);
+        }
+        double pts = pkt->pts;
+        talloc_free(pkt);
+        if (!img) {
+            MP_WARN(ctx, "Could not decode keyframe at %f.\n", pts);
+            continue;
+        }
+
+        if (!res->sheets[0].image && !create_sheets(ctx, img, columns)) {
+            talloc_free(img);
+            break;
+        }
+
+        render_tile(ctx, i, img);
+        res->timestamps[i] = pts;
+        decoded++;
+
+        talloc_free(prev);
+        prev = img;
+        prev_pts = pts;
+    }
+    talloc_free(prev);
+
+    MP_VERBOSE(ctx, "Decoded %d/%d thumbnails.\n", decoded, res->num_thumbnails);
+    return decoded > 0 && !mp_cancel_test(ctx->cancel);
+}
+
+struct mp_thumbnails *mp_thumbnails_generate(void *ta_parent,
+                                             struct mpv_global *global,
+                                             struct mp_log *log,
+                                             struct mp_cancel *cancel,
+                                             const char *url, int count,
+                                             int *widths, int num_widths,
+                                             int columns, bool rebase)
+{
+    if (count < 1 || num_widths < 1)
+        return NULL;
+
+    void *tmp = talloc_new(NULL);
+    struct thumb_ctx *ctx = talloc_ptrtype(tmp, ctx);
+    *ctx = (struct thumb_ctx){
+        .log = log,
+        .global = global,
+        .cancel = cancel,
+        .widths = widths,
+        .sws = talloc_zero_array(tmp, struct mp_sws_context *, num_widths),
+    };
+
+    struct mp_thumbnails *res = talloc_zero(tmp, struct mp_thumbnails);
+    res->num_thumbnails = count;
+    res->timestamps = talloc_array(res, double, count);
+    res->num_sheets = num_widths;
+    res->sheets = talloc_zero_array(res, struct mp_thumbnail_sheet, num_widths);
+    ctx->res = res;
+
+    bool ok = generate(ctx, url, columns, rebase);
+
+    if (ctx->avctx)
+        avcodec_free_context(&ctx->avctx);
+    av_frame_free(&ctx->frame);
+    demux_free(ctx->demuxer);
+
+    if (ok)
+        talloc_steal(ta_parent, res);
+    talloc_free(tmp);
+    return ok ? res : NULL;
+}
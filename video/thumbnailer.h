@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+
+struct mpv_global;
+struct mp_log;
+struct mp_cancel;
+struct mp_image;
+
+struct mp_thumbnail_sheet {
+    int tile_w, tile_h;         // size of a single thumbnail
+    int columns, rows;          // thumbnails are laid out row by row
+    struct mp_image *image;     // IMGFMT_BGR0, columns*tile_w x rows*tile_h
+};
+
+struct mp_thumbnails {
+    // Timestamp of each thumbnail (MP_NOPTS_VALUE if it could not be decoded;
+    // the tile is black then).
+    double *timestamps;
+    int num_thumbnails;
+    // One sheet per requested width.
+    struct mp_thumbnail_sheet *sheets;
+    int num_sheets;
+};
+
+// Decode count frames evenly distributed over the file at url, and render
+// them into one sprite sheet for each entry in widths[]. Tile heights follow
+// the video's display aspect ratio. columns=0 picks a roughly square layout.
+//
+// Only keyframes are decoded: for each position, the demuxer seeks to the
+// previous keyframe, which is decoded on its own. This uses its own demuxer
+// and decoder instance and runs synchronously, so it can be called from any
+// thread, and does not interfere with playback of the same file.
+// If rebase is set, timestamps are relative to the start time of the file
+// (like with --rebase-start-time).
+// Returns NULL on failure or if cancel was triggered.
+struct mp_thumbnails *mp_thumbnails_generate(void *ta_parent,
+                                             struct mpv_global *global,
+                                             struct mp_log *log,
+                                             struct mp_cancel *cancel,
+                                             const char *url, int count,
+                                             int *widths, int num_widths,
+                                             int columns, bool rebase);
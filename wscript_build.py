@@ -298,8 +298,10 @@ def build(ctx):
         ( "demux/demux_playlist.c" ),
         ( "demux/demux_raw.c" ),
         ( "demux/demux_timeline.c" ),
+        ( "demux/dump_queue.c" ),
         ( "demux/ebml.c" ),
         ( "demux/packet.c" ),
+        ( "demux/probe.c" ),
         ( "demux/timeline.c" ),
 
         ( "filters/f_async_queue.c" ),
@@ -312,6 +314,7 @@ def build(ctx):
         ( "filters/f_output_chain.c" ),
         ( "filters/f_swresample.c" ),
         ( "filters/f_swscale.c" ),
+        ( "filters/f_threaded.c" ),
         ( "filters/f_utils.c" ),
         ( "filters/filter.c" ),
         ( "filters/frame.c" ),
@@ -403,16 +406,26 @@ def build(ctx):
 
         ## Tests
         ( "test/chmap.c",                        "tests" ),
+        ( "test/client_events.c",                "tests" ),
+        ( "test/demux_spill.c",                  "tests" ),
+        ( "test/dump_queue.c",                   "tests" ),
         ( "test/gl_video.c",                     "tests" ),
+        ( "test/image_buffer.c",                 "tests" ),
+        ( "test/image_cache.c",                  "tests" ),
         ( "test/img_format.c",                   "tests" ),
         ( "test/json.c",                         "tests" ),
+        ( "test/lavfi.c",                        "tests" ),
         ( "test/linked_list.c",                  "tests" ),
+        ( "test/lua_bytecode.c",                 "tests && lua" ),
         ( "test/paths.c",                        "tests" ),
+        ( "test/playlist.c",                     "tests" ),
         ( "test/repack.c",                       "tests && zimg" ),
         ( "test/scale_sws.c",                    "tests" ),
         ( "test/scale_test.c",                   "tests" ),
         ( "test/scale_zimg.c",                   "tests && zimg" ),
+        ( "test/swdeint.c",                      "tests" ),
         ( "test/tests.c",                        "tests" ),
+        ( "test/vapoursynth.c",                  "tests && vapoursynth" ),
 
         ## Video
         ( "video/csputils.c" ),
@@ -426,11 +439,14 @@ def build(ctx):
         ( "video/filter/vf_format.c" ),
         ( "video/filter/vf_gpu.c",               "egl-helpers && gl && egl" ),
         ( "video/filter/vf_sub.c" ),
+        ( "video/filter/vf_swdeint.c" ),
         ( "video/filter/vf_vapoursynth.c",       "vapoursynth" ),
         ( "video/filter/vf_vavpp.c",             "vaapi" ),
         ( "video/filter/vf_vdpaupp.c",           "vdpau" ),
         ( "video/fmt-conversion.c" ),
         ( "video/hwdec.c" ),
+        ( "video/image_buffer.c" ),
+        ( "video/image_cache.c" ),
         ( "video/image_loader.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
@@ -549,6 +565,7 @@ def build(ctx):
         ( "video/out/x11_common.c",              "x11" ),
         ( "video/repack.c" ),
         ( "video/sws_utils.c" ),
+        ( "video/thumbnailer.c" ),
         ( "video/zimg.c",                        "zimg" ),
         ( "video/vaapi.c",                       "vaapi" ),
         ( "video/vdpau.c",                       "vdpau" ),